@@ -71,6 +71,7 @@
  * - \ref balerd "balerd"
  *   - \ref bin_tcp "Input Plugin for TCP transport"
  *   - \ref bin_udp "Input Plugin for UDP transport"
+ *   - \ref bin_file "Input Plugin for bulk import of log files"
  *   - \ref bout_store_msg "Output Plugin for Message Storage"
  *   - \ref bout_store_hist "Output Plugin for Histogram Processing and Storage"
  * - \ref bq "bq"
@@ -135,12 +136,73 @@
  * \par -I NUMBER
  * Specify the number of input worker threads (default: 1).
  *
+ * \par -i CPU_LIST
+ * Pin the input worker threads to the CPUs in \c CPU_LIST, e.g. "0-3,8"
+ * (default: no affinity). The i-th worker is pinned to the i-th CPU of the
+ * list (round-robin if there are more workers than CPUs). The input queue is
+ * allocated while running on these CPUs so that its memory comes from their
+ * NUMA node.
+ *
  * \par -O NUMBER
- * Specify the number of output worker threads (default: 1).
+ * Specify the number of output worker threads (default: 1). Each output
+ * worker has its own queue, and each output plugin is processed by the least
+ * busy worker at the time it is loaded (see also the \b partition option in
+ * \ref config_command).
+ *
+ * \par -o CPU_LIST
+ * Pin the output worker threads to the CPUs in \c CPU_LIST, in the same
+ * manner as \c -i. The queue of each output worker is allocated on the NUMA
+ * node of the CPU of the worker.
  *
  * \par -Q NUMBER
  * Specify the work queue depth (default: 1024).
  *
+ * \par -T NUMBER
+ * Specify the number of tokens cached by each input worker (default: 65536).
+ * The cache maps token text to token ID so that the frequently seen tokens do
+ * not have to go through the store for every message. The token counts are
+ * accumulated in the cache and written to the store periodically, and when
+ * \b balerd terminates. \c 0 disables the cache.
+ *
+ * \par -B NUMBER
+ * Specify the maximum number of queue entries a worker takes from its queue
+ * at once (default: 64). The output workers hand the entries of the same
+ * output plugin to the plugin as a batch (see \c process_output_batch in
+ * boutput.h), e.g. \b bout_store_msg stores them with a single
+ * bstore_msg_add_batch() call.
+ *
+ * \par -P SECONDS
+ * Specify the flush interval of the in-memory pattern table (default: 1).
+ * \b balerd keeps all known patterns in memory and only writes the pattern
+ * statistics (count, first seen and last seen) back to the store every \c
+ * SECONDS, and when \b balerd terminates. New patterns are still added to
+ * the store immediately. \c 0 disables the pattern table. The pattern table
+ * is also disabled if the store plugin does not support it.
+ *
+ * \par -m PATH
+ * Write the runtime statistics to the file \c PATH (default: disabled). The
+ * file is replaced every \c -M seconds with "NAME VALUE" lines: the depths
+ * of the input queue and of each output queue, the cache hit counts, and the
+ * count, mean, p50, p99 and max latency (in microseconds) of each stage:
+ * parse (input plugins), binq wait, token add and pattern add (per message),
+ * boutq wait and the processing time of each output plugin. The statistics
+ * are not collected if \c -m is not given.
+ *
+ * \par -M SECONDS
+ * Specify the statistics file update interval (default: 1).
+ *
+ * \par -X PATH
+ * Spill the input entries to the disk-backed queue (bmqueue) at \c PATH when
+ * the input queue is filled over the high watermark (see \c -W), instead of
+ * blocking the input plugins (default: disabled). The input workers drain the
+ * spilled entries once the input queue is at or below half of the high
+ * watermark. The entries left in the spill queue are processed when \b balerd
+ * restarts.
+ *
+ * \par -W NUMBER
+ * Specify the input queue high watermark for \c -X (default: 3/4 of the
+ * queue depth).
+ *
  * \par -v (DEBUG|INFO|WARN|ERROR)
  * Specify the log level (default: WARN).
  *
@@ -170,6 +232,23 @@
  * input before the output plugins finish loading. Please see each plugin
  * documentation for its specific options (e.g. \b bin_tcp(5), \b
  * bout_store_msg(5), or \c bout_store_hist(5)).
+ * \par
+ * Each output plugin is assigned to the least busy output worker (see \b
+ * -O). For an output plugin, \b balerd also takes the following options:
+ * \par
+ * \b partition=ptn_id|comp_id|none spreads the work of the plugin over
+ * several output workers by the hash of the pattern ID or the component ID
+ * of the message (default: none). The messages with the same key are always
+ * handled by the same worker, in order. The plugin must tolerate concurrent
+ * process_output() calls.
+ * \par
+ * \b partition_workers=NUMBER is the number of output workers for the
+ * partitioned plugin (default: all output workers).
+ * \par
+ * For any plugin, \b cpus=CPU_LIST pins the threads that the plugin creates
+ * when it is configured or started to the CPUs in \c CPU_LIST (default: no
+ * affinity). For \b bin_tcp and \b bin_udp, these are the I/O threads and
+ * the \b parse_threads pool, which are all created in start().
  *
  * \par # comment
  * The '#' comment at the beginning of each line is supported. However, the
@@ -188,7 +267,7 @@
  *
  * # Histogram output, with token histogram, pattern histogram
  * # (pattern-component histogram included), and pattern-token histogram.
- * plugin name=bout_store_hist tkn=1 ptn=1 ptn_tkn=1
+ * plugin name=bout_store_hist tkn=1 ptn=1 ptn_tkn=1 partition=ptn_id
  *
  * # Message output
  * plugin name=bout_store_msg
@@ -227,9 +306,39 @@
  * back to strings at the output, and the last inserted text is found first in
  * the translation.
  *
+ * \section environment ENVIRONMENT
+ * The following variables tune the \b bstore_sos store plugin.
+ *
+ * \par BSTORE_SOS_PART_PERIOD=SECONDS (default: 0)
+ * Roll the messages over to a new SOS partition for each \c SECONDS of the
+ * message time (e.g. 86400 for daily partitions). 0 keeps them in a single
+ * partition. The messages stamped more than a period ahead of the clock are
+ * kept in the current partition. The histograms are not partitioned.
+ *
+ * \par BSTORE_SOS_RETENTION=SECONDS (default: 0)
+ * With BSTORE_SOS_PART_PERIOD, drop the message partitions of the periods
+ * that ended more than \c SECONDS before the current one. 0 keeps all of the
+ * messages. The histograms are kept.
+ *
+ * \par BSTORE_SOS_PTN_CACHE=NUMBER (default: 16384)
+ * The number of patterns cached to read the messages. 0 disables the cache.
+ *
+ * \par BSTORE_SOS_MSG_INDICES=NAME[:MODE][,...] (default: pt,ct)
+ * The secondary message indices of a new store; it has no effect on the
+ * existing stores. \c NAME is \c pt (by pattern) or \c ct (by component) and
+ * \c MODE is \c sync (index each message as it is stored, the default),
+ * \c deferred (index the messages in bulk in the background) or \c off
+ * (don't keep the index, the queries by pattern or component scan the
+ * messages by time instead). The time index is always kept.
+ *
+ * \par BSTORE_SOS_IDX_INTERVAL=SECONDS (default: 10)
+ * How often the deferred indices catch up with the new messages. The queries
+ * using a deferred index may miss the messages of the last interval.
+ *
  * \section see_also SEE ALSO
- * \ref bin_tcp "bin_tcp(5)", \ref bin_udp "bin_udp(5)", \ref bout_store_msg
- * "bout_store_msg(5)", \ref bout_store_hist "bout_store_hist(5)".
+ * \ref bin_tcp "bin_tcp(5)", \ref bin_udp "bin_udp(5)", \ref bin_file
+ * "bin_file(5)", \ref bout_store_msg "bout_store_msg(5)", \ref bout_store_hist
+ * "bout_store_hist(5)".
  */
 
 /**
@@ -239,6 +348,7 @@
  */
 #include <stdio.h>
 #include <pthread.h>
+#include <sched.h>
 #include <limits.h>
 #include <ctype.h>
 #include <dlfcn.h>
@@ -266,6 +376,9 @@ int ocm_cb(struct ocm_event *e);
 #include "bptn.h"
 #include "bwqueue.h"
 #include "bstore.h"
+#include "btkn_cache.h"
+#include "bptn_cache.h"
+#include "bstats.h"
 
 /***** Definitions *****/
 typedef enum bmap_idx_enum {
@@ -304,7 +417,7 @@ struct bzmsg *bzmsg_alloc(size_t bstr_len)
 }
 
 /***** Command line arguments ****/
-#define BALER_OPT_STR "FC:l:s:S:v:I:O:Q:V?"
+#define BALER_OPT_STR "FC:l:s:S:v:I:i:O:o:Q:T:P:B:m:M:X:W:V?"
 #ifdef ENABLE_OCM
 const char *optstring = BALER_OPT_STR "z:";
 #else
@@ -330,8 +443,23 @@ void display_help_msg()
 "	-v <LEVEL>	Set verbosity level (DEBUG, INFO, WARN, ERROR).\n"
 "			The default value is WARN.\n"
 "	-I <number>	The number of input queue worker.\n"
+"	-i <cpus>	Pin the input workers to the CPU list (e.g. 0-3,8).\n"
 "	-O <number>	The number of output queue worker.\n"
+"	-o <cpus>	Pin the output workers to the CPU list.\n"
 "	-Q <number>	The queue depth (applied to input and output queues).\n"
+"	-T <number>	The number of tokens cached by each input worker\n"
+"			(default: 65536, 0 to disable the cache).\n"
+"	-B <number>	The maximum number of queue entries processed\n"
+"			as a batch by a worker (default: 64).\n"
+"	-P <sec>	The pattern table flush interval in seconds\n"
+"			(default: 1, 0 to disable the pattern table).\n"
+"	-m <path>	Write the runtime statistics to the file.\n"
+"	-M <sec>	The statistics file update interval (default: 1).\n"
+"	-X <path>	Spill the input entries to the disk-backed queue\n"
+"			at the path when the input queue is over the high\n"
+"			watermark (default: disabled).\n"
+"	-W <number>	The input queue high watermark for -X\n"
+"			(default: 3/4 of the queue depth).\n"
 "	-V		Print the verion and exit.\n"
 "	-?		Show help message\n"
 "\n"
@@ -348,9 +476,19 @@ void display_help_msg()
 int binqwkrN = 1; /**< Input Worker Thread Number */
 int boutqwkrN = 1; /**< Output Worker Thread Number */
 int qdepth = 1024; /**< Input/Output queue depth */
+int tkn_cache_size = 65536; /**< Token cache size per input worker */
+int ptn_flush_interval = 1; /**< Pattern table flush interval (sec) */
+int wkr_batch = 64; /**< Max queue entries per worker batch */
 int is_foreground = 0; /**< Run as foreground? */
+const char *stats_path = NULL; /**< Statistics file, NULL if disabled */
+int stats_interval = 1; /**< Statistics file update interval (sec) */
+const char *spill_path = NULL; /**< Input spill queue path, NULL if disabled */
+int spill_hwm = 0; /**< Input spill high watermark, 0 for the default */
+cpu_set_t binqwkr_cpus; /**< Input worker CPUs, empty for no affinity */
+cpu_set_t boutqwkr_cpus; /**< Output worker CPUs, empty for no affinity */
 
 struct timeval reconnect_interval = {.tv_sec = 2};
+struct timeval tkn_cache_flush_interval = {.tv_sec = 1};
 
 /**\}*/
 
@@ -395,6 +533,29 @@ enum BCFG_CMD bcfg_cmd_str2enum(const char *s)
  */
 pthread_t *binqwkr;
 
+/**
+ * Context for Input Worker.
+ */
+struct bin_wkr_ctxt {
+	int worker_id; /**< Worker ID */
+	btkn_cache_t tkn_cache; /**< Token ID cache, NULL if disabled */
+	struct bwq_entry **ents; /**< Dequeue buffer (wkr_batch entries) */
+	struct bstr *ptn; /**< Pattern buffer, reused for every message */
+	uint32_t ptn_max; /**< Token capacity of \c ptn */
+	uint64_t msg_count; /**< Number of processed messages */
+	struct bstats_lat qwait_lat; /**< binq wait */
+	struct bstats_lat tkn_add_lat; /**< Token add time per message */
+	struct bstats_lat ptn_add_lat; /**< Pattern add time */
+};
+
+struct bin_wkr_ctxt *binqwkr_ctxt; /* one per input worker */
+
+/**
+ * In-memory pattern table, NULL if disabled.
+ */
+bptn_cache_t ptn_cache;
+pthread_t ptn_flush_thread;
+
 /**
  * Head of the ::bconfig_list.
  */
@@ -446,8 +607,15 @@ int *boutq_busy_count; /* queue busy count */
  */
 struct bout_wkr_ctxt {
 	int worker_id; /**< Worker ID */
+	struct bwq_entry **ents; /**< Dequeue buffer (wkr_batch entries) */
+	struct boutq_data **odata; /**< Batch buffer (wkr_batch entries) */
+	struct bstats_lat qwait_lat; /**< boutq wait */
 };
 
+struct bout_wkr_ctxt **boutqwkr_ctxt; /* one per output worker */
+
+pthread_t stats_thread;
+
 bstore_t bstore = NULL;
 
 /*********************************************/
@@ -535,8 +703,72 @@ struct bwq *get_least_busy_boutq()
 	return &boutq[mini];
 }
 
+/**
+ * Assign \c n distinct least-busy output queues to the partitioned plugin
+ * \c p.
+ * \retval 0 If success.
+ * \retval errno If error.
+ */
+int boutq_partition(struct boutplugin *p, boutq_part_t part, int n)
+{
+	int i, k, mini;
+	char *used;
+	if (n < 1 || n > boutqwkrN)
+		n = boutqwkrN;
+	used = calloc(boutqwkrN, 1);
+	p->_outqs = calloc(n, sizeof(*p->_outqs));
+	if (!used || !p->_outqs) {
+		free(used);
+		free(p->_outqs);
+		p->_outqs = NULL;
+		return ENOMEM;
+	}
+	for (k = 0; k < n; k++) {
+		mini = -1;
+		for (i = 0; i < boutqwkrN; i++) {
+			if (used[i])
+				continue;
+			if (mini < 0 || boutq_busy_count[i] < boutq_busy_count[mini])
+				mini = i;
+		}
+		used[mini] = 1;
+		boutq_busy_count[mini]++;
+		p->_outqs[k] = &boutq[mini];
+	}
+	free(used);
+	p->_outq = p->_outqs[0];
+	p->_outq_n = n;
+	p->_outq_part = part;
+	return 0;
+}
+
+/**
+ * The output queue for \c msg of the plugin \c p.
+ */
+static inline
+struct bwq *boutq_select(struct boutplugin *p, bmsg_t msg)
+{
+	uint32_t key;
+	switch (p->_outq_part) {
+	case BOUTQ_PART_PTN_ID:
+		key = msg->ptn_id;
+		break;
+	case BOUTQ_PART_COMP_ID:
+		key = msg->comp_id;
+		break;
+	default:
+		return p->_outq;
+	}
+	/* Fibonacci hashing, the IDs are mostly sequential: the mixed high
+	 * bits of the product select the queue */
+	key *= 2654435761U;
+	return p->_outqs[((uint64_t)key * p->_outq_n) >> 32];
+}
+
 void* binqwkr_routine(void *arg);
 void* boutqwkr_routine(void *arg);
+void* ptn_flush_routine(void *arg);
+void* stats_routine(void *arg);
 
 void bconfig_list_free(struct bconfig_list *bl) {
 	struct bpair_str *bp;
@@ -555,6 +787,82 @@ bzmsg_type_e bzmsg_type_inverse(bzmsg_type_e type)
 	return (type ^ 1);
 }
 
+/**
+ * The original CPU affinity of the main thread.
+ */
+static cpu_set_t main_cpus;
+
+/**
+ * Parse the CPU list \c str (e.g. "0-3,8,10-11") into \c set.
+ *
+ * \retval 0 If success.
+ * \retval EINVAL If \c str is not a valid CPU list.
+ */
+static int cpulist_parse(const char *str, cpu_set_t *set)
+{
+	const char *s = str;
+	char *end;
+	long a, b;
+	CPU_ZERO(set);
+	while (*s) {
+		a = strtol(s, &end, 10);
+		if (end == s || a < 0 || a >= CPU_SETSIZE)
+			return EINVAL;
+		b = a;
+		s = end;
+		if (*s == '-') {
+			s++;
+			b = strtol(s, &end, 10);
+			if (end == s || b < a || b >= CPU_SETSIZE)
+				return EINVAL;
+			s = end;
+		}
+		for (; a <= b; a++)
+			CPU_SET(a, set);
+		if (*s == ',')
+			s++;
+		else if (*s)
+			return EINVAL;
+	}
+	return CPU_COUNT(set)?0:EINVAL;
+}
+
+/**
+ * Move the calling thread to the CPUs in \c set, or back to the original CPUs
+ * of the main thread if \c set is \c NULL.
+ *
+ * The threads created by the calling thread afterward inherit the affinity,
+ * and the memory it touches first is allocated from the NUMA node of the CPUs
+ * (with the default first-touch policy).
+ */
+static void pin_self(cpu_set_t *set)
+{
+	int rc = pthread_setaffinity_np(pthread_self(), sizeof(*set),
+					set?set:&main_cpus);
+	if (rc)
+		bwarn("pthread_setaffinity_np error: %d", rc);
+}
+
+/**
+ * Pin the calling thread to the \c n-th CPU of \c set (round-robin). Do
+ * nothing if \c set is empty.
+ */
+static void pin_self_nth(cpu_set_t *set, int n)
+{
+	cpu_set_t one;
+	int cpu;
+	if (!CPU_COUNT(set))
+		return;
+	n %= CPU_COUNT(set);
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (CPU_ISSET(cpu, set) && 0 == n--)
+			break;
+	}
+	CPU_ZERO(&one);
+	CPU_SET(cpu, &one);
+	pin_self(&one);
+}
+
 /**
  * Baler Daemon Initialization.
  */
@@ -573,12 +881,39 @@ void initialize_daemon()
 	}
 	umask(0);
 
+	rc = pthread_getaffinity_np(pthread_self(), sizeof(main_cpus),
+				    &main_cpus);
+	if (rc) {
+		berr("pthread_getaffinity_np error: %d", rc);
+		exit(-1);
+	}
+
 	/* Input/Output Work Queue */
+	if (CPU_COUNT(&binqwkr_cpus))
+		pin_self(&binqwkr_cpus);
 	binq = bwq_alloci(qdepth);
+	pin_self(NULL);
 	if (!binq) {
 		berror("(binq) bwq_alloci");
 		exit(-1);
 	}
+	if (spill_path) {
+		if (!spill_hwm)
+			spill_hwm = qdepth * 3 / 4;
+		if (spill_hwm < 1 || spill_hwm > qdepth) {
+			berr("Invalid spill high watermark: %d", spill_hwm);
+			exit(-1);
+		}
+		rc = binq_spill_open(spill_path, spill_hwm);
+		if (rc) {
+			berr("Cannot open the spill queue %s, error: %d",
+			     spill_path, rc);
+			exit(-1);
+		}
+		if (binq_spill_pending())
+			binfo("%lu spilled input entries pending",
+			      binq_spill_pending());
+	}
 
 	/* Open store plugin */
 	binfo("Opening Plugin Store.");
@@ -591,18 +926,60 @@ void initialize_daemon()
 		exit(-1);
 	}
 
+	/* Pattern table */
+	if (ptn_flush_interval > 0) {
+		ptn_cache = bptn_cache_new(bstore, 65536);
+		if (!ptn_cache && errno != ENOSYS) {
+			berror("bptn_cache_new");
+			exit(-1);
+		}
+		if (!ptn_cache) {
+			bwarn("Store plugin '%s' does not support pattern "
+			      "statistics update, pattern table disabled.",
+			      bget_store_plugin());
+		} else if ((rc = pthread_create(&ptn_flush_thread, NULL,
+					ptn_flush_routine, NULL)) != 0) {
+			berr("pthread_create error code: %d\n", rc);
+			exit(-1);
+		}
+	}
+
 	/* Input worker threads */
 	binqwkr = malloc(sizeof(*binqwkr)*binqwkrN);
 	if (!binqwkr) {
 		berror("malloc for binqwkr");
 		exit(-1);
 	}
+	binqwkr_ctxt = calloc(binqwkrN, sizeof(*binqwkr_ctxt));
+	if (!binqwkr_ctxt) {
+		berror("calloc for binqwkr_ctxt");
+		exit(-1);
+	}
 	for (i=0; i<binqwkrN; i++) {
-		if ((rc = pthread_create(binqwkr+i, NULL, binqwkr_routine, NULL)) != 0) {
+		/* The worker and its data live on the CPU of the worker */
+		pin_self_nth(&binqwkr_cpus, i);
+		binqwkr_ctxt[i].worker_id = i;
+		binqwkr_ctxt[i].ents = calloc(wkr_batch,
+					      sizeof(*binqwkr_ctxt[i].ents));
+		if (!binqwkr_ctxt[i].ents) {
+			berror("calloc for binqwkr_ctxt ents");
+			exit(-1);
+		}
+		if (tkn_cache_size > 0) {
+			binqwkr_ctxt[i].tkn_cache = btkn_cache_new(bstore,
+							tkn_cache_size);
+			if (!binqwkr_ctxt[i].tkn_cache) {
+				berror("btkn_cache_new");
+				exit(-1);
+			}
+		}
+		if ((rc = pthread_create(binqwkr+i, NULL, binqwkr_routine,
+					 &binqwkr_ctxt[i])) != 0) {
 			berr("pthread_create error code: %d\n", rc);
 			exit(-1);
 		}
 	}
+	pin_self(NULL);
 
 	/* Output worker threads */
 	boutqwkr = malloc(sizeof(*boutqwkr)*boutqwkrN);
@@ -615,26 +992,54 @@ void initialize_daemon()
 		berror("calloc for boutqwkr_busy_count");
 		exit(-1);
 	}
-	boutq = malloc(sizeof(*boutq) * boutqwkrN);
-	if (!boutq) {
-		berror("malloc for boutq");
+	/* bwq keeps head and tail on separate cache lines */
+	rc = posix_memalign((void**)&boutq, 64, sizeof(*boutq) * boutqwkrN);
+	if (rc) {
+		berr("posix_memalign for boutq, rc: %d", rc);
+		exit(-1);
+	}
+	boutqwkr_ctxt = calloc(boutqwkrN, sizeof(*boutqwkr_ctxt));
+	if (!boutqwkr_ctxt) {
+		berror("calloc for boutqwkr_ctxt");
 		exit(-1);
 	}
 	struct bout_wkr_ctxt *octxt;
 	for (i=0; i<boutqwkrN; i++) {
-		bwq_init(&boutq[i], qdepth);
+		pin_self_nth(&boutqwkr_cpus, i);
+		rc = bwq_init(&boutq[i], qdepth);
+		if (rc) {
+			berr("bwq_init for boutq[%d], rc: %d", i, rc);
+			exit(-1);
+		}
 		octxt = calloc(1, sizeof(*octxt));
 		if (!octxt) {
 			berror("calloc for octxt");
 			exit(-1);
 		}
 		octxt->worker_id = i;
+		boutqwkr_ctxt[i] = octxt;
+		octxt->ents = calloc(wkr_batch, sizeof(*octxt->ents));
+		octxt->odata = calloc(wkr_batch, sizeof(*octxt->odata));
+		if (!octxt->ents || !octxt->odata) {
+			berror("calloc for octxt batch");
+			exit(-1);
+		}
 		if ((rc = pthread_create(boutqwkr+i, NULL, boutqwkr_routine,
 						octxt)) != 0) {
 			berr("pthread_create error, code: %d\n", rc);
 			exit(-1);
 		}
 	}
+	pin_self(NULL);
+
+	/* Statistics file writer */
+	if (stats_path) {
+		if ((rc = pthread_create(&stats_thread, NULL, stats_routine,
+					 NULL)) != 0) {
+			berr("pthread_create error code: %d\n", rc);
+			exit(-1);
+		}
+	}
 
 	/* OCM */
 #ifdef ENABLE_OCM
@@ -702,14 +1107,32 @@ int load_plugin(struct bconfig_list *pcl, struct bplugin_head *inst_head)
 		goto out;
 	}
 	LIST_INSERT_HEAD(inst_head, p, link);
+
+	/* The plugin threads inherit the affinity of this thread */
+	struct bpair_str *bcpus = bpair_str_search(&pcl->arg_head_s,
+			"cpus", NULL);
+	cpu_set_t cpus;
+	if (bcpus) {
+		if ((rc = cpulist_parse(bcpus->s1, &cpus))) {
+			berr("Invalid CPU list: %s", bcpus->s1);
+			goto out;
+		}
+		pin_self(&cpus);
+	}
+
 	/* Configure the plugin. */
 	if ((rc = p->config(p, &pcl->arg_head_s))) {
 		berr("Config error, code: %d\n", rc);
+		if (bcpus)
+			pin_self(NULL);
 		goto out;
 	}
 
 	/* And start the plugin. Plugin should not block this though. */
-	if ((rc = p->start(p))) {
+	rc = p->start(p);
+	if (bcpus)
+		pin_self(NULL);
+	if (rc) {
 		berr("Plugin %s start error, code: %d\n", bname->s1,
 				rc);
 		goto out;
@@ -832,7 +1255,29 @@ int process_cmd_plugin(struct bconfig_list *cfg)
 			return rc;
 		/* An output plugin needs an output queue */
 		struct boutplugin *p = (typeof(p))LIST_FIRST(&bop_head_s);
-		p->_outq = get_least_busy_boutq();
+		bp = bpair_str_search(&cfg->arg_head_s, "partition", NULL);
+		if (!bp || 0 == strcmp(bp->s1, "none")) {
+			p->_outq = get_least_busy_boutq();
+			return 0;
+		}
+		boutq_part_t part;
+		if (0 == strcmp(bp->s1, "ptn_id")) {
+			part = BOUTQ_PART_PTN_ID;
+		} else if (0 == strcmp(bp->s1, "comp_id")) {
+			part = BOUTQ_PART_COMP_ID;
+		} else {
+			berr("Unknown partition '%s', expecting ptn_id, "
+			     "comp_id or none", bp->s1);
+			return EINVAL;
+		}
+		bp = bpair_str_search(&cfg->arg_head_s, "partition_workers",
+				      NULL);
+		rc = boutq_partition(p, part, bp ? atoi(bp->s1) : 0);
+		if (rc)
+			return rc;
+		binfo("%s: output partitioned by %s over %d workers",
+		      p->base.name, part == BOUTQ_PART_PTN_ID ? "ptn_id" :
+		      "comp_id", p->_outq_n);
 		return 0;
 	}
 	return EINVAL;
@@ -1159,12 +1604,58 @@ next_arg:
 	case 'I':
 		binqwkrN = atoi(optarg);
 		break;
+	case 'i':
+		if (cpulist_parse(optarg, &binqwkr_cpus)) {
+			berr("Invalid CPU list: %s", optarg);
+			exit(-1);
+		}
+		break;
 	case 'O':
 		boutqwkrN = atoi(optarg);
 		break;
+	case 'o':
+		if (cpulist_parse(optarg, &boutqwkr_cpus)) {
+			berr("Invalid CPU list: %s", optarg);
+			exit(-1);
+		}
+		break;
 	case 'Q':
 		qdepth = atoi(optarg);
 		break;
+	case 'T':
+		tkn_cache_size = atoi(optarg);
+		break;
+	case 'P':
+		ptn_flush_interval = atoi(optarg);
+		break;
+	case 'm':
+		stats_path = strdup(optarg);
+		bstats_enabled = 1;
+		break;
+	case 'M':
+		stats_interval = atoi(optarg);
+		if (stats_interval < 1) {
+			berr("Invalid statistics interval: %s", optarg);
+			exit(-1);
+		}
+		break;
+	case 'X':
+		spill_path = strdup(optarg);
+		break;
+	case 'W':
+		spill_hwm = atoi(optarg);
+		if (spill_hwm < 1) {
+			berr("Invalid spill high watermark: %s", optarg);
+			exit(-1);
+		}
+		break;
+	case 'B':
+		wkr_batch = atoi(optarg);
+		if (wkr_batch < 1) {
+			berr("Invalid batch size: %s", optarg);
+			exit(-1);
+		}
+		break;
 	case 'V':
 		printf("Version: %s\n", bversion());
 		printf("  GIT-SHA: %s\n", bgitsha());
@@ -1198,31 +1689,65 @@ static int queue_output(bmsg_t msg)
 {
 	int rc = 0;
 	struct bplugin *p;
+	uint64_t ts = bstats_ts();
 	LIST_FOREACH(p, &bop_head_s, link) {
-		/* Copy msg to omsg for future usage in output queue. */
-		struct bmsg *omsg = bmsg_alloc(msg->argc);
-		if (!omsg) {
-			rc = ENOMEM;
-			break;
-		}
-		memcpy(omsg, msg, BMSG_SZ(msg));
 		/* Prepare output queue entry. */
 		struct bwq_entry *oent = malloc(sizeof(*oent));
 		if (!oent) {
-			bmsg_free(omsg);
 			rc = ENOMEM;
 			break;
 		}
+		/* The message is shared by the output plugins */
+		boutq_msg_get(msg);
 		struct boutq_data *odata = &oent->data.out;
 		odata->comp_id = msg->comp_id;
 		odata->tv = msg->timestamp;
-		odata->msg = omsg;
+		odata->msg = msg;
 		odata->plugin = (struct boutplugin *)p;
-		bwq_nq(boutq, oent);
+		oent->nq_ts = ts;
+		bwq_nq(boutq_select(odata->plugin, msg), oent);
 	}
 	return rc;
 }
 
+/**
+ * Add the token through the worker's token cache, if enabled.
+ */
+static inline btkn_id_t wkr_tkn_add(struct bin_wkr_ctxt *ctxt, btkn_t tkn)
+{
+	if (ctxt->tkn_cache)
+		return btkn_cache_tkn_add(ctxt->tkn_cache, tkn);
+	return bstore_tkn_add(bstore, tkn);
+}
+
+/**
+ * Add the pattern through the pattern table, if enabled.
+ */
+static inline bptn_id_t wkr_ptn_add(struct timeval *tv, bstr_t ptn)
+{
+	if (ptn_cache)
+		return bptn_cache_ptn_add(ptn_cache, tv, ptn);
+	return bstore_ptn_add(bstore, tv, ptn);
+}
+
+/**
+ * The pattern buffer of the worker, with room for \c tkn_count tokens.
+ */
+static struct bstr *wkr_ptn_buf(struct bin_wkr_ctxt *ctxt, uint32_t tkn_count)
+{
+	struct bstr *ptn;
+	if (ctxt->ptn && tkn_count <= ctxt->ptn_max)
+		return ctxt->ptn;
+	ptn = bstr_alloc(tkn_count * sizeof(uint64_t));
+	if (!ptn)
+		return NULL;
+	if (ctxt->ptn)
+		bstr_free(ctxt->ptn);
+	ctxt->ptn = ptn;
+	ctxt->ptn_max = tkn_count;
+	return ptn;
+}
+
 /**
  * Core processing of an input entry.
  * \param ent Input entry.
@@ -1230,7 +1755,8 @@ static int queue_output(bmsg_t msg)
  * \return 0 on success.
  * \return errno on error.
  */
-static int process_input_entry(struct bwq_entry *bwq_ent, void *arg)
+static int process_input_entry(struct bwq_entry *bwq_ent,
+			       struct bin_wkr_ctxt *ctxt)
 {
 	int rc;
 	binq_data_t in_data = &bwq_ent->data.in;
@@ -1240,19 +1766,21 @@ static int process_input_entry(struct bwq_entry *bwq_ent, void *arg)
 	struct bstr *ptn;
 	struct bmsg *msg;
 	btkn_tailq_entry_t ent;
+	uint64_t ts;
 
 	rc = EINVAL;
 	if (in_data->type != BINQ_DATA_MSG)
 		goto err_0;
 
 	rc = ENOMEM;
-	ptn = bstr_alloc(in_data->tkn_count * sizeof(uint64_t));
+	ptn = wkr_ptn_buf(ctxt, in_data->tkn_count);
 	if (!ptn)
 		goto err_0;
 
-	msg = bmsg_alloc(in_data->tkn_count);
+	/* The message is handed over to the output plugins as is */
+	msg = boutq_msg_alloc(in_data->tkn_count);
 	if (!msg)
-		goto err_1;
+		goto err_0;
 
 	/*
 	 * Add each token to the token store if not already present;
@@ -1260,12 +1788,13 @@ static int process_input_entry(struct bwq_entry *bwq_ent, void *arg)
 	 * token id into a bstr in the field position this token
 	 * occupied in the message.
 	 */
+	ts = bstats_ts();
 	tkn_idx = 0;
 	comp_id = 0;
 	TAILQ_FOREACH(ent, &in_data->tkn_q, link) {
 		btkn_type_t tkn_type = btkn_first_type(ent->tkn);
 		ent->tkn->tkn_count = 1;
-		tkn_id = bstore_tkn_add(bstore, ent->tkn);
+		tkn_id = wkr_tkn_add(ctxt, ent->tkn);
 		if (!tkn_id) {
 			rc = errno;
 			goto cleanup;
@@ -1310,25 +1839,27 @@ static int process_input_entry(struct bwq_entry *bwq_ent, void *arg)
 		btkn_t tkn = btkn_alloc(0, BTKN_TYPE_MASK(BTKN_TYPE_HOSTNAME),
 					in_data->hostname->cstr,
 					in_data->hostname->blen);
-		tkn_id = bstore_tkn_add(bstore, tkn);
+		tkn_id = wkr_tkn_add(ctxt, tkn);
 		msg->comp_id = tkn_id;
 		btkn_free(tkn);
 	}
 	ptn->blen = tkn_idx * sizeof(uint64_t);
 	msg->argc = tkn_idx;
 	msg->timestamp = in_data->tv;
-	msg->ptn_id = bstore_ptn_add(bstore, &in_data->tv, ptn);
+	bstats_lat_since(&ctxt->tkn_add_lat, ts);
+	ts = bstats_ts();
+	msg->ptn_id = wkr_ptn_add(&in_data->tv, ptn);
+	bstats_lat_since(&ctxt->ptn_add_lat, ts);
 	if (!msg->ptn_id) {
 		berr("bstore_add_pattern() failed, errno: %d", errno);
 		rc = errno;
 		goto cleanup;
 	}
 	rc = queue_output(msg);
+	ctxt->msg_count++;
 cleanup:
 	binq_entry_free(bwq_ent);
-	bmsg_free(msg);
- err_1:
-	bstr_free(ptn);
+	boutq_msg_put(msg);
  err_0:
 	return rc;
 }
@@ -1338,34 +1869,58 @@ cleanup:
  * one of the input queue workers will get an access to the input queue.
  * It then consume the input entry and release the input queue lock so that
  * the other workers can work on the next entry.
- * \param arg Ignored
+ * \param arg A pointer to ::bin_wkr_ctxt.
  * \return NULL (should be ignored)
  */
 void* binqwkr_routine(void *arg)
 {
+	struct bin_wkr_ctxt *ctxt = arg;
 	struct timeval start_time = { 0, 0 };
 	struct timeval end_time = { 0, 0 };
+	struct timeval flush_time;
 	int inp_count = 0;
-	struct bwq_entry *ent;
+	int i, n;
 	sigset_t sigset;
 	sigfillset(&sigset);
 	pthread_sigmask(SIG_SETMASK, &sigset, NULL); /* block all signals */
+	/* Only allow cancellation while waiting for the input so that
+	 * thread_join() can safely flush the token cache afterward. */
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
 	gettimeofday(&start_time, NULL);
+	timeradd(&start_time, &tkn_cache_flush_interval, &flush_time);
 loop:
-	/* bwq_dq will block the execution if the queue is empty. */
-	ent = bwq_dq(binq);
-	if (!ent) {
-		/* This is not supposed to happen. */
-		berr("Error, ent == NULL\n");
+	n = 0;
+	/* Drain the spill once the pressure on binq drops */
+	if (binq_spill_pending() && bwq_depth(binq) <= binq_spill_hwm() / 2)
+		n = binq_spill_dq_batch(ctxt->ents, wkr_batch);
+	if (!n) {
+		/* bwq_dq_batch will block the execution if the queue is
+		 * empty. */
+		pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+		n = bwq_dq_batch(binq, ctxt->ents, wkr_batch);
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
 	}
 	if (!inp_count)
 		gettimeofday(&start_time, NULL);
-	if (process_input_entry(ent, (struct bin_wkr_ctxt*) arg) == -1) {
-		/* XXX Do better error handling ... */
-		berr("process input error ...");
+	for (i = 0; i < n; i++) {
+		bstats_lat_since(&ctxt->qwait_lat, ctxt->ents[i]->nq_ts);
+		if (process_input_entry(ctxt->ents[i], ctxt) == -1) {
+			/* XXX Do better error handling ... */
+			berr("process input error ...");
+		}
 	}
-	inp_count++;
+	inp_count += n;
 	gettimeofday(&end_time, NULL);
+	if (ctxt->tkn_cache && timercmp(&end_time, &flush_time, >=)) {
+		btkn_cache_t c = ctxt->tkn_cache;
+		if (btkn_cache_flush(c))
+			bwarn("input worker %d: token cache flush error",
+			      ctxt->worker_id);
+		bdebug("input worker %d: token cache hit: %lu, miss: %lu, "
+		       "evict: %lu", ctxt->worker_id, c->hit, c->miss,
+		       c->evict);
+		timeradd(&end_time, &tkn_cache_flush_interval, &flush_time);
+	}
 	double start = (double)start_time.tv_sec * 1.0e6 + (double)start_time.tv_usec;
 	double end = (double)end_time.tv_sec * 1.0e6 + (double)end_time.tv_usec;
 	double dur = (end - start) / 1.0e6;
@@ -1377,6 +1932,139 @@ loop:
 	goto loop;
 }
 
+/**
+ * Periodically write the pattern statistics in the pattern table back to the
+ * store.
+ * \param arg Ignored
+ * \return NULL (should be ignored)
+ */
+void* ptn_flush_routine(void *arg)
+{
+	sigset_t sigset;
+	sigfillset(&sigset);
+	pthread_sigmask(SIG_SETMASK, &sigset, NULL); /* block all signals */
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+loop:
+	pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+	sleep(ptn_flush_interval);
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+	if (bptn_cache_flush(ptn_cache))
+		bwarn("pattern table flush error");
+	goto loop;
+}
+
+/**
+ * Write the statistics to \c f.
+ */
+static void stats_print(FILE *f, struct timespec *t0)
+{
+	struct bstats_lat qwait, tkn_add, ptn_add;
+	struct timespec now;
+	struct bplugin *bp;
+	struct boutplugin *p;
+	uint64_t msgs = 0, hit = 0, miss = 0;
+	size_t count;
+	char name[256];
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	fprintf(f, "uptime_sec %ld\n", now.tv_sec - t0->tv_sec);
+
+	fprintf(f, "binq.depth %lu\n", bwq_depth(binq));
+	fprintf(f, "binq.size %lu\n", bwq_size(binq));
+	if (spill_path)
+		fprintf(f, "binq.spill_pending %lu\n", binq_spill_pending());
+	for (i = 0; i < boutqwkrN; i++) {
+		fprintf(f, "boutq.%d.depth %lu\n", i, bwq_depth(&boutq[i]));
+		fprintf(f, "boutq.%d.size %lu\n", i, bwq_size(&boutq[i]));
+	}
+
+	bstats_lat_print(f, "parse", &binp_parse_lat);
+
+	memset(&qwait, 0, sizeof(qwait));
+	memset(&tkn_add, 0, sizeof(tkn_add));
+	memset(&ptn_add, 0, sizeof(ptn_add));
+	for (i = 0; i < binqwkrN; i++) {
+		struct bin_wkr_ctxt *ctxt = &binqwkr_ctxt[i];
+		msgs += ctxt->msg_count;
+		bstats_lat_merge(&qwait, &ctxt->qwait_lat);
+		bstats_lat_merge(&tkn_add, &ctxt->tkn_add_lat);
+		bstats_lat_merge(&ptn_add, &ctxt->ptn_add_lat);
+		if (ctxt->tkn_cache) {
+			hit += ctxt->tkn_cache->hit;
+			miss += ctxt->tkn_cache->miss;
+		}
+	}
+	fprintf(f, "input.messages %lu\n", msgs);
+	bstats_lat_print(f, "binq_wait", &qwait);
+	bstats_lat_print(f, "tkn_add", &tkn_add);
+	bstats_lat_print(f, "ptn_add", &ptn_add);
+	if (tkn_cache_size > 0) {
+		fprintf(f, "tkn_cache.hit %lu\n", hit);
+		fprintf(f, "tkn_cache.miss %lu\n", miss);
+	}
+	if (ptn_cache) {
+		bptn_cache_stat(ptn_cache, &hit, &miss, &count);
+		fprintf(f, "ptn_cache.hit %lu\n", hit);
+		fprintf(f, "ptn_cache.miss %lu\n", miss);
+		fprintf(f, "ptn_cache.patterns %zu\n", count);
+	}
+
+	memset(&qwait, 0, sizeof(qwait));
+	for (i = 0; i < boutqwkrN; i++)
+		bstats_lat_merge(&qwait, &boutqwkr_ctxt[i]->qwait_lat);
+	bstats_lat_print(f, "boutq_wait", &qwait);
+	LIST_FOREACH(bp, &bop_head_s, link) {
+		p = (typeof(p))bp;
+		snprintf(name, sizeof(name), "output.%s", bp->name);
+		fprintf(f, "%s.entries %lu\n", name, p->_proc_count);
+		bstats_lat_print(f, name, &p->_proc_lat);
+	}
+}
+
+/**
+ * Replace the statistics file with the current statistics.
+ */
+static void stats_write(struct timespec *t0)
+{
+	char tmp[PATH_MAX];
+	FILE *f;
+	snprintf(tmp, sizeof(tmp), "%s.tmp", stats_path);
+	f = fopen(tmp, "w");
+	if (!f) {
+		bwarn("Cannot open the statistics file %s: %m", tmp);
+		return;
+	}
+	stats_print(f, t0);
+	if (fclose(f)) {
+		bwarn("Cannot write the statistics file %s: %m", tmp);
+		return;
+	}
+	if (rename(tmp, stats_path))
+		bwarn("Cannot rename %s to %s: %m", tmp, stats_path);
+}
+
+/**
+ * Periodically write the statistics file.
+ * \param arg Ignored
+ * \return NULL (should be ignored)
+ */
+void* stats_routine(void *arg)
+{
+	struct timespec t0;
+	sigset_t sigset;
+	sigfillset(&sigset);
+	pthread_sigmask(SIG_SETMASK, &sigset, NULL); /* block all signals */
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+loop:
+	pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+	sleep(stats_interval);
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+	stats_write(&t0);
+	goto loop;
+}
+
 int process_output_entry(struct bwq_entry *ent, struct bout_wkr_ctxt *ctxt)
 {
 	int rc = 0;
@@ -1402,22 +2090,43 @@ void* boutqwkr_routine(void *arg)
 {
 	int rc;
 	struct bout_wkr_ctxt *octxt= arg;
-	struct bwq_entry *ent;
+	struct boutplugin *p;
+	uint64_t ts;
+	int i, j, k, n;
 	sigset_t sigset;
 	sigfillset(&sigset);
 	pthread_sigmask(SIG_SETMASK, &sigset, NULL); /* block all signals */
 loop:
-	/* bwq_dq will block the execution if the queue is empty. */
-	ent = bwq_dq(&boutq[octxt->worker_id]);
-	if (!ent) {
-		/* This is not supposed to happen. */
-		berr("Error, ent == NULL\n");
-	}
-	rc = ent->data.out.plugin->
-		process_output(ent->data.out.plugin, &ent->data.out);
-	if (rc)
-		berr("process input error, code %d\n", errno);
-	boutq_entry_free(ent);
+	/* bwq_dq_batch will block the execution if the queue is empty. */
+	n = bwq_dq_batch(&boutq[octxt->worker_id], octxt->ents, wkr_batch);
+	for (i = 0; i < n; i++)
+		bstats_lat_since(&octxt->qwait_lat, octxt->ents[i]->nq_ts);
+	/* Hand each run of entries of the same plugin over as a batch */
+	for (i = 0; i < n; i = j) {
+		p = octxt->ents[i]->data.out.plugin;
+		for (j = i; j < n && octxt->ents[j]->data.out.plugin == p; j++)
+			octxt->odata[j - i] = &octxt->ents[j]->data.out;
+		if (bstats_enabled)
+			__atomic_add_fetch(&p->_proc_count, j - i,
+					   __ATOMIC_RELAXED);
+		if (p->process_output_batch) {
+			ts = bstats_ts();
+			rc = p->process_output_batch(p, j - i, octxt->odata);
+			bstats_lat_since(&p->_proc_lat, ts);
+			if (rc)
+				berr("process output error, code %d\n", rc);
+			continue;
+		}
+		for (k = 0; k < j - i; k++) {
+			ts = bstats_ts();
+			rc = p->process_output(p, octxt->odata[k]);
+			bstats_lat_since(&p->_proc_lat, ts);
+			if (rc)
+				berr("process output error, code %d\n", rc);
+		}
+	}
+	for (i = 0; i < n; i++)
+		boutq_entry_free(octxt->ents[i]);
 	goto loop;
 }
 
@@ -1426,21 +2135,56 @@ loop:
  */
 void thread_join()
 {
+	struct bplugin *p;
 	int i;
+	if (stats_path) {
+		pthread_cancel(stats_thread);
+		pthread_join(stats_thread, NULL);
+	}
+	/* Stop the input plugins first. Their threads may be blocked posting
+	 * to a full input queue with cancellation disabled, and only the
+	 * input queue workers can unblock them. */
+	LIST_FOREACH(p, &bip_head_s, link)
+		p->stop(p);
+
 	/* Joining the input queue workers */
 	for (i=0; i<binqwkrN; i++){
 		pthread_cancel(binqwkr[i]);
 		pthread_join(binqwkr[i], NULL);
 	}
+	/* The input plugins and the input queue workers are stopped, the rest
+	 * of the spill is kept on disk for the next run */
+	binq_spill_close();
+
+	/* Write the pending token counts back to the store */
+	for (i=0; i<binqwkrN; i++) {
+		btkn_cache_t c = binqwkr_ctxt[i].tkn_cache;
+		if (!c)
+			continue;
+		if (btkn_cache_flush(c))
+			berr("input worker %d: token cache flush error", i);
+		binfo("input worker %d: token cache hit: %lu, miss: %lu, "
+		      "evict: %lu", i, c->hit, c->miss, c->evict);
+	}
+
+	/* Write the pending pattern statistics back to the store */
+	if (ptn_cache) {
+		uint64_t hit, miss;
+		size_t count;
+		pthread_cancel(ptn_flush_thread);
+		pthread_join(ptn_flush_thread, NULL);
+		if (bptn_cache_flush(ptn_cache))
+			berr("pattern table flush error");
+		bptn_cache_stat(ptn_cache, &hit, &miss, &count);
+		binfo("pattern table patterns: %zu, hit: %lu, miss: %lu",
+		      count, hit, miss);
+	}
 
 	/* Joining the output queue workers */
 	for (i=0; i<boutqwkrN; i++){
 		pthread_cancel(boutqwkr[i]);
 		pthread_join(boutqwkr[i], NULL);
 	}
-	struct bplugin *p;
-	LIST_FOREACH(p, &bip_head_s, link)
-		p->stop(p);
 	LIST_FOREACH(p, &bop_head_s, link)
 		p->stop(p);
 }
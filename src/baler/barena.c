@@ -0,0 +1,169 @@
+/* -*- c-basic-offset: 8 -*-
+ * Copyright (c) 2026 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2026 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "barena.h"
+
+/* The global pool of free arenas */
+static pthread_mutex_t barena_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct barena *barena_pool;
+static int barena_pool_n;
+
+/* The per-thread cache of free arenas */
+struct barena_cache {
+	int n;
+	struct barena *a[BARENA_CACHE_SZ];
+};
+static __thread struct barena_cache barena_cache;
+
+static pthread_once_t barena_once = PTHREAD_ONCE_INIT;
+static pthread_key_t barena_key;
+static __thread int barena_key_set;
+
+static inline void __barena_reset(barena_t a)
+{
+	struct barena_chunk *c;
+	while ((c = a->chunks)) {
+		a->chunks = c->next;
+		free(c);
+	}
+	a->cur = a->data;
+	a->end = a->data + BARENA_SZ;
+}
+
+/* Move \c n arenas from the cache \c c to the pool */
+static void __barena_cache_drain(struct barena_cache *c, int n)
+{
+	struct barena *a;
+	pthread_mutex_lock(&barena_pool_lock);
+	while (n-- && c->n) {
+		a = c->a[--c->n];
+		if (barena_pool_n >= BARENA_POOL_MAX) {
+			free(a);
+			continue;
+		}
+		a->next = barena_pool;
+		barena_pool = a;
+		barena_pool_n++;
+	}
+	pthread_mutex_unlock(&barena_pool_lock);
+}
+
+/* Return the cached arenas of an exiting thread to the pool */
+static void __barena_cache_destroy(void *arg)
+{
+	struct barena_cache *c = arg;
+	__barena_cache_drain(c, c->n);
+}
+
+static void __barena_once(void)
+{
+	pthread_key_create(&barena_key, __barena_cache_destroy);
+}
+
+static struct barena_cache *__barena_cache(void)
+{
+	if (!barena_key_set) {
+		pthread_once(&barena_once, __barena_once);
+		pthread_setspecific(barena_key, &barena_cache);
+		barena_key_set = 1;
+	}
+	return &barena_cache;
+}
+
+barena_t barena_get()
+{
+	struct barena_cache *c = __barena_cache();
+	struct barena *a;
+
+	if (!c->n) {
+		/* refill half of the cache from the pool */
+		pthread_mutex_lock(&barena_pool_lock);
+		while (c->n < BARENA_CACHE_SZ / 2 && barena_pool) {
+			a = barena_pool;
+			barena_pool = a->next;
+			barena_pool_n--;
+			c->a[c->n++] = a;
+		}
+		pthread_mutex_unlock(&barena_pool_lock);
+	}
+	if (c->n)
+		return c->a[--c->n];
+	a = malloc(sizeof(*a));
+	if (!a)
+		return NULL;
+	a->chunks = NULL;
+	__barena_reset(a);
+	return a;
+}
+
+void barena_put(barena_t a)
+{
+	struct barena_cache *c = __barena_cache();
+	__barena_reset(a);
+	if (c->n == BARENA_CACHE_SZ)
+		__barena_cache_drain(c, BARENA_CACHE_SZ / 2);
+	c->a[c->n++] = a;
+}
+
+void *__barena_alloc_chunk(barena_t a, size_t sz)
+{
+	struct barena_chunk *c;
+	size_t csz = sz < BARENA_SZ ? BARENA_SZ : sz;
+	c = malloc(sizeof(*c) + csz);
+	if (!c)
+		return NULL;
+	c->next = a->chunks;
+	a->chunks = c;
+	a->cur = c->data + sz;
+	a->end = c->data + csz;
+	return c->data;
+}
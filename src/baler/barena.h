@@ -0,0 +1,239 @@
+/* -*- c-basic-offset: 8 -*-
+ * Copyright (c) 2026 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2026 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * \file barena.h
+ * \brief Pooled bump-pointer arenas for short-lived objects.
+ *
+ * \defgroup barena Baler Arena
+ * \{
+ * A ::barena is a bump-pointer allocator for a group of objects that are
+ * released all at once, e.g. an input queue entry with its tokens, from the
+ * parser to the input worker. barena_alloc() is just a pointer increment in
+ * the common case, and barena_put() releases all of the objects of the arena
+ * by returning the arena to the pool.
+ *
+ * The free arenas are kept in a small per-thread cache in front of a global
+ * pool, so that a thread that only gets arenas (e.g. an input plugin) and a
+ * thread that only puts them back (e.g. an input worker) exchange them in
+ * bulk, taking the pool lock once every ::BARENA_CACHE_SZ / 2 arenas.
+ *
+ * An arena may be allocated from in one thread and put back by another, but
+ * it must not be used by two threads at the same time.
+ */
+#ifndef __BARENA_H
+#define __BARENA_H
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include "btypes.h"
+
+/**
+ * The size of the memory embedded in each arena. Larger allocations go to
+ * additional chunks that are freed when the arena is put back.
+ */
+#define BARENA_SZ 8192
+
+/**
+ * The number of free arenas cached by each thread.
+ */
+#define BARENA_CACHE_SZ 32
+
+/**
+ * The maximum number of free arenas in the global pool. The arenas put back
+ * beyond this are freed.
+ */
+#define BARENA_POOL_MAX 4096
+
+struct barena_chunk {
+	struct barena_chunk *next;
+	char data[0];
+};
+
+typedef struct barena {
+	struct barena *next; /**< Pool link */
+	char *cur; /**< The next free byte */
+	char *end; /**< The end of the current chunk */
+	struct barena_chunk *chunks; /**< Additional chunks */
+	char data[BARENA_SZ] __attribute__((aligned(16)));
+} *barena_t;
+
+/**
+ * Get an empty arena from the pool.
+ * \retval NULL If there is not enough memory, \c errno is also set.
+ */
+barena_t barena_get();
+
+/**
+ * Release all the objects of the arena \c a, and return it to the pool.
+ */
+void barena_put(barena_t a);
+
+/* Slow path of barena_alloc() */
+void *__barena_alloc_chunk(barena_t a, size_t sz);
+
+/**
+ * Allocate \c sz bytes from the arena \c a.
+ *
+ * The memory is aligned to 8 bytes, and is valid until \c a is put back.
+ *
+ * \retval NULL If there is not enough memory, \c errno is also set.
+ */
+static inline
+void *barena_alloc(barena_t a, size_t sz)
+{
+	char *p = a->cur;
+	sz = (sz + 7) & ~(size_t)7;
+	if (sz > a->end - p)
+		return __barena_alloc_chunk(a, sz);
+	a->cur = p + sz;
+	return p;
+}
+
+/**
+ * Same as barena_alloc(), but the memory is zeroed.
+ */
+static inline
+void *barena_zalloc(barena_t a, size_t sz)
+{
+	void *p = barena_alloc(a, sz);
+	if (p)
+		memset(p, 0, sz);
+	return p;
+}
+
+/**
+ * Allocate a copy of the string \c cstr in the arena \c a, similar to
+ * bstr_alloc_init_cstr().
+ */
+static inline
+struct bstr *barena_bstr_alloc_init_cstr(barena_t a, const char *cstr)
+{
+	size_t len = strlen(cstr);
+	struct bstr *bs = barena_alloc(a, sizeof(*bs) + len + 1);
+	if (!bs)
+		return NULL;
+	bs->blen = len;
+	memcpy(bs->cstr, cstr, len + 1);
+	return bs;
+}
+
+/**
+ * Allocate a token in the arena \c a, similar to btkn_alloc().
+ *
+ * \note The token must not be freed with btkn_free(); it is released with
+ *       the arena.
+ */
+static inline
+btkn_t barena_btkn_alloc(barena_t a, btkn_id_t tkn_id, btkn_type_mask_t mask,
+			 const char *str, size_t len)
+{
+	btkn_t t = barena_alloc(a, sizeof(*t) + sizeof(struct bstr) + len + 1);
+	if (!t)
+		return NULL;
+	t->tkn_id = tkn_id;
+	t->tkn_type_mask = mask;
+	t->tkn_count = 0;
+	t->tkn_str = (struct bstr *)(t+1);
+	t->tkn_str->blen = len;
+	memcpy(t->tkn_str->cstr, str, len);
+	t->tkn_str->cstr[len] = '\0';
+	return t;
+}
+
+/**
+ * Allocate a slice token in the arena \c a: the token references the \c len
+ * bytes at \c text (e.g. the input line, copied once into the arena) instead
+ * of a copy of them. \c text must live as long as the token.
+ *
+ * The token has no \c tkn_str; see btkn_text() and btkn_len(), and
+ * barena_btkn_materialize() where a ::bstr is needed.
+ */
+static inline
+btkn_t barena_btkn_slice(barena_t a, btkn_type_mask_t mask, const char *text,
+			 size_t len)
+{
+	btkn_t t = barena_alloc(a, sizeof(*t));
+	if (!t)
+		return NULL;
+	t->tkn_id = 0;
+	t->tkn_type_mask = mask;
+	t->tkn_count = 0;
+	t->tkn_str = NULL;
+	t->tkn_text = text;
+	t->tkn_len = len;
+	return t;
+}
+
+/**
+ * Give the slice token \c t a null-terminated \c tkn_str, allocated in the
+ * arena \c a. Does nothing if \c t already has one.
+ *
+ * \retval 0 on success.
+ * \retval ENOMEM if the arena is out of memory.
+ */
+static inline
+int barena_btkn_materialize(barena_t a, btkn_t t)
+{
+	struct bstr *s;
+	if (t->tkn_str)
+		return 0;
+	s = barena_alloc(a, sizeof(*s) + t->tkn_len + 1);
+	if (!s)
+		return ENOMEM;
+	s->blen = t->tkn_len;
+	memcpy(s->cstr, t->tkn_text, t->tkn_len);
+	s->cstr[t->tkn_len] = '\0';
+	t->tkn_str = s;
+	return 0;
+}
+
+#endif
+/**\}*/
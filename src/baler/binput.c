@@ -48,14 +48,219 @@
  * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
+#include <stdlib.h>
 #include "binput.h"
 #include "binput_private.h"
+#include "bmqueue.h"
 
 struct bwq *binq;
+struct bstats_lat binp_parse_lat;
+
+/*
+ * The overflow spill of binq, see binq_spill_open().
+ */
+static bmqueue_t spill_q;
+static uint64_t spill_hwm; /* 0 if the spill is disabled */
+static uint64_t spill_count; /* the number of spilled entries */
+
+/*
+ * A spilled input entry. The data contains the hostname followed by the
+ * tokens, each as (type mask, length, text).
+ */
+struct binq_spill_elm {
+	struct bmqueue_elm base;
+	struct timeval tv;
+	uint32_t tkn_count;
+	int32_t host_len; /* -1 if the entry has no hostname */
+	char data[0];
+};
+
+static inline
+int __spill_put(char **p, char *end, const void *src, size_t sz)
+{
+	if (sz > end - *p)
+		return ENOSPC;
+	memcpy(*p, src, sz);
+	*p += sz;
+	return 0;
+}
+
+static inline
+int __spill_get(char **p, char *end, void *dst, size_t sz)
+{
+	if (sz > end - *p)
+		return EINVAL;
+	memcpy(dst, *p, sz);
+	*p += sz;
+	return 0;
+}
+
+/*
+ * Write \c e to the spill queue, and free \c e if success.
+ */
+static int __binq_spill(struct bwq_entry *e)
+{
+	union {
+		struct binq_spill_elm elm;
+		char buf[BINQ_SPILL_ELM_SZ];
+	} u;
+	struct binq_data *in = &e->data.in;
+	char *p = u.elm.data;
+	char *end = u.buf + sizeof(u.buf);
+	btkn_tailq_entry_t t;
+	uint32_t len;
+	int rc;
+
+	if (in->type != BINQ_DATA_MSG || in->format != BINQ_BTKN_QUEUE)
+		return EINVAL;
+	u.elm.tv = in->tv;
+	u.elm.tkn_count = in->tkn_count;
+	u.elm.host_len = -1;
+	if (in->hostname) {
+		u.elm.host_len = in->hostname->blen;
+		rc = __spill_put(&p, end, in->hostname->cstr,
+				 in->hostname->blen);
+		if (rc)
+			return rc;
+	}
+	TAILQ_FOREACH(t, &in->tkn_q, link) {
+		len = btkn_len(t->tkn);
+		rc = __spill_put(&p, end, &t->tkn->tkn_type_mask,
+				 sizeof(t->tkn->tkn_type_mask));
+		rc = rc ? rc : __spill_put(&p, end, &len, sizeof(len));
+		rc = rc ? rc : __spill_put(&p, end, btkn_text(t->tkn), len);
+		if (rc)
+			return rc;
+	}
+	rc = bmqueue_enqueue(spill_q, &u.elm.base);
+	if (rc)
+		return rc;
+	__atomic_add_fetch(&spill_count, 1, __ATOMIC_RELAXED);
+	binq_entry_free(e);
+	return 0;
+}
+
+/*
+ * Rebuild an input entry (in an arena) from the spilled element.
+ */
+static struct bwq_entry *__binq_unspill(struct binq_spill_elm *se)
+{
+	char *p = se->data;
+	char *end = (char *)se + BINQ_SPILL_ELM_SZ;
+	struct bwq_entry *e;
+	struct binq_data *in;
+	btkn_tailq_entry_t t;
+	btkn_type_mask_t mask;
+	uint32_t i, len;
+	barena_t a;
+
+	a = barena_get();
+	if (!a)
+		return NULL;
+	e = barena_zalloc(a, sizeof(*e));
+	if (!e)
+		goto err;
+	e->arena = a;
+	in = &e->data.in;
+	in->type = BINQ_DATA_MSG;
+	in->format = BINQ_BTKN_QUEUE;
+	in->tv = se->tv;
+	TAILQ_INIT(&in->tkn_q);
+	if (se->host_len >= 0) {
+		if (se->host_len > end - p)
+			goto err;
+		in->hostname = barena_alloc(a, sizeof(struct bstr) +
+					    se->host_len + 1);
+		if (!in->hostname)
+			goto err;
+		in->hostname->blen = se->host_len;
+		memcpy(in->hostname->cstr, p, se->host_len);
+		in->hostname->cstr[se->host_len] = '\0';
+		p += se->host_len;
+	}
+	for (i = 0; i < se->tkn_count; i++) {
+		if (__spill_get(&p, end, &mask, sizeof(mask)) ||
+		    __spill_get(&p, end, &len, sizeof(len)) ||
+		    len > end - p)
+			goto err;
+		t = barena_alloc(a, sizeof(*t));
+		if (!t)
+			goto err;
+		t->tkn = barena_btkn_alloc(a, 0, mask, p, len);
+		if (!t->tkn)
+			goto err;
+		p += len;
+		TAILQ_INSERT_TAIL(&in->tkn_q, t, link);
+		in->tkn_count++;
+	}
+	return e;
+ err:
+	barena_put(a);
+	return NULL;
+}
 
 int binq_post(struct bwq_entry *e)
 {
+	e->nq_ts = bstats_ts();
+	/* Spill rather than block if binq is under pressure */
+	if (spill_hwm && bwq_depth(binq) >= spill_hwm &&
+	    0 == __binq_spill(e))
+		return 0;
 	bwq_nq(binq, e);
 	return 0;
 }
 
+int binq_spill_open(const char *path, uint64_t hwm)
+{
+	if (!hwm)
+		return EINVAL;
+	/* bmqueue takes the segment length from the environment */
+	setenv("BMQUEUE_SEG_ALLOC_LEN", BINQ_SPILL_SEG_LEN, 0);
+	errno = 0;
+	spill_q = bmqueue_open(path, BINQ_SPILL_ELM_SZ, 1);
+	if (!spill_q) /* an element size mismatch doesn't set errno */
+		return errno ? errno : EINVAL;
+	spill_count = bmqueue_count(spill_q);
+	spill_hwm = hwm;
+	return 0;
+}
+
+void binq_spill_close()
+{
+	if (!spill_q)
+		return;
+	spill_hwm = 0;
+	bmqueue_close(spill_q);
+	spill_q = NULL;
+}
+
+uint64_t binq_spill_pending()
+{
+	return __atomic_load_n(&spill_count, __ATOMIC_RELAXED);
+}
+
+uint64_t binq_spill_hwm()
+{
+	return spill_hwm;
+}
+
+int binq_spill_dq_batch(struct bwq_entry **ents, int max)
+{
+	bmqueue_elm_t elm;
+	int n = 0;
+	while (n < max) {
+		elm = bmqueue_dequeue_nonblock(spill_q);
+		if (!elm)
+			break;
+		__atomic_sub_fetch(&spill_count, 1, __ATOMIC_RELAXED);
+		ents[n] = __binq_unspill((void*)elm);
+		bmqueue_elm_put(elm);
+		if (!ents[n]) {
+			berr("Cannot restore a spilled input entry");
+			continue;
+		}
+		n++;
+	}
+	return n;
+}
+
@@ -87,5 +87,16 @@
  */
 int binq_post(struct bwq_entry *e); /* binq_post impl. is in balerd.c */
 
+/**
+ * Parse time statistics of the input plugins. An input plugin records the
+ * time of each \c parse() call here, e.g.
+ * \code
+ * uint64_t ts = bstats_ts();
+ * rc = parser->parse(parser, str, &ent);
+ * bstats_lat_since(&binp_parse_lat, ts);
+ * \endcode
+ */
+extern struct bstats_lat binp_parse_lat;
+
 #endif // __BINPUT_H
 /**\}*/
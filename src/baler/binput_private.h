@@ -64,5 +64,56 @@
  */
 extern struct bwq *binq;
 
+/**
+ * Size of a spilled input entry, see binq_spill_open().
+ */
+#define BINQ_SPILL_ELM_SZ 4096
+
+/**
+ * Default number of spilled entries per spill queue segment.
+ */
+#define BINQ_SPILL_SEG_LEN "16384"
+
+/**
+ * Enable the overflow spill of the input queue.
+ *
+ * Once enabled, binq_post() writes the input entries to the persistent
+ * ::bmqueue at \c path instead of blocking whenever ::binq holds \c hwm
+ * entries or more, so that the input plugins never stall on a slow store.
+ * The input workers take the spilled entries back with binq_spill_dq_batch()
+ * when the pressure drops. The spilled entries left in \c path from a
+ * previous run are also processed.
+ *
+ * Only parsed messages (::BINQ_BTKN_QUEUE) of up to ::BINQ_SPILL_ELM_SZ
+ * serialized bytes are spilled, the others are still queued to ::binq.
+ *
+ * \retval 0 If success.
+ * \retval errno If error.
+ */
+int binq_spill_open(const char *path, uint64_t hwm);
+
+/**
+ * Close the spill queue. The entries still in it are kept for the next run.
+ */
+void binq_spill_close();
+
+/**
+ * The number of spilled entries waiting to be processed.
+ */
+uint64_t binq_spill_pending();
+
+/**
+ * The spill threshold given to binq_spill_open(), 0 if the spill is disabled.
+ */
+uint64_t binq_spill_hwm();
+
+/**
+ * Take up to \c max spilled entries without blocking. The entries are
+ * released with binq_entry_free() like the ones from ::binq.
+ *
+ * \return The number of entries taken.
+ */
+int binq_spill_dq_batch(struct bwq_entry **ents, int max);
+
 #endif
 /** \} */
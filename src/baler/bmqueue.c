@@ -330,6 +330,18 @@ bmqueue_elm_t bmqueue_dequeue_nonblock(bmqueue_t q)
 	return elm;
 }
 
+uint64_t bmqueue_count(bmqueue_t q)
+{
+	bmqueue_seg_t seg;
+	uint64_t count = 0;
+	pthread_mutex_lock(&q->mutex);
+	TAILQ_FOREACH(seg, &q->active_list, entry) {
+		count += BMQUEUE_SEG_HDR(seg)->elm_count;
+	}
+	pthread_mutex_unlock(&q->mutex);
+	return count;
+}
+
 bmqueue_elm_t bmqueue_dequeue(bmqueue_t q)
 {
 	bmqueue_elm_t elm;
@@ -473,6 +485,6 @@ void bmqueue_close(bmqueue_t q)
 		bmqueue_seg_close(seg);
 	}
 	if (q->bmem)
-		bmem_close(q->bmem);
+		bmem_close_free(q->bmem);
 	free(q);
 }
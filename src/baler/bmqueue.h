@@ -177,4 +177,9 @@ bmqueue_elm_t bmqueue_dequeue(bmqueue_t q);
 
 bmqueue_elm_t bmqueue_dequeue_nonblock(bmqueue_t q);
 
+/**
+ * The number of elements in the queue.
+ */
+uint64_t bmqueue_count(bmqueue_t q);
+
 #endif
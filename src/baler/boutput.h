@@ -72,6 +72,15 @@
  */
 struct boutplugin;
 
+/**
+ * Output work partitioning of an output plugin.
+ */
+typedef enum boutq_part {
+	BOUTQ_PART_NONE, /**< All of the plugin work goes to one queue */
+	BOUTQ_PART_PTN_ID, /**< Partition the work by pattern ID */
+	BOUTQ_PART_COMP_ID, /**< Partition the work by component ID */
+} boutq_part_t;
+
 /**
  * Baler Output Plugin interface structure.
  */
@@ -93,6 +102,25 @@ struct boutplugin {
 	 */
 	int (*process_output)(struct boutplugin *this, struct boutq_data *odata);
 
+	/**
+	 * \brief Process a batch of outputs (optional).
+	 *
+	 * If the plugin provides this function, the output workers call it
+	 * with all the consecutive entries for the plugin they dequeued at
+	 * once, so that the plugin can submit them to the store as a batch
+	 * (e.g. bstore_msg_add_batch()). Otherwise, \c process_output() is
+	 * called for each entry. The same concurrency note of \c
+	 * process_output() applies.
+	 *
+	 * \return 0 if success
+	 * \return Error code if fail
+	 * \param this The plugin instance.
+	 * \param n The number of entries in \c odata.
+	 * \param odata The output data from Baler core.
+	 */
+	int (*process_output_batch)(struct boutplugin *this, int n,
+				    struct boutq_data **odata);
+
 	/**
 	 * \brief Internal output queue corresponding to the plugin.
 	 *
@@ -100,6 +128,27 @@ struct boutplugin {
 	 * access nor modify this field.
 	 */
 	struct bwq *_outq;
+
+	/**
+	 * \brief Internal output queues of the partitioned plugin.
+	 *
+	 * If \c _outq_part is not ::BOUTQ_PART_NONE, the output of the plugin
+	 * is distributed over \c _outq_n queues by the hash of the partition
+	 * key, so that the outputs with the same key are processed in order
+	 * by the same worker. These fields are internally-used by baler
+	 * daemon. Plugin should not access nor modify them.
+	 */
+	struct bwq **_outqs;
+	int _outq_n;
+	boutq_part_t _outq_part;
+
+	/**
+	 * \brief Internal statistics of the plugin: the time of each
+	 * \c process_output() (or \c process_output_batch()) call, and the
+	 * number of entries processed.
+	 */
+	struct bstats_lat _proc_lat;
+	uint64_t _proc_count;
 };
 
 /**
@@ -0,0 +1,314 @@
+/* -*- c-basic-offset: 8 -*-
+ * Copyright (c) 2026 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2026 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <arpa/inet.h>
+#include <assert.h>
+
+#include "binput.h"
+#include "bparse_pool.h"
+
+struct bparse_pool {
+	struct bwq q; /**< The raw line queue, must be the first member */
+	int n; /**< The number of running threads */
+	pthread_t *thr;
+	int nparsers; /**< The number of parsers, one per thread */
+	binp_parser_t *parsers; /**< A parser for each thread */
+};
+
+/*
+ * If there is no hostname token in the input, use the host that sent us the
+ * message.
+ */
+static void add_host(struct bwq_entry *ent, struct sockaddr_in *sin)
+{
+	char ip_str[128];
+	const char *host;
+	host = inet_ntop(sin->sin_family, &sin->sin_addr,
+			 ip_str, sizeof(ip_str));
+	/* binq_entry_free() releases an arena entry with its arena */
+	if (ent->arena)
+		ent->data.in.hostname =
+			barena_bstr_alloc_init_cstr(ent->arena, host);
+	else
+		ent->data.in.hostname = bstr_alloc_init_cstr(host);
+}
+
+static void __line_done(struct bparse_line *line, binp_result_t rc,
+			struct bwq_entry *ent)
+{
+	switch (rc) {
+	case BINP_OK:
+		if (!ent->data.in.hostname)
+			add_host(ent, &line->sin);
+		binq_post(ent);
+		break;
+	case BINP_MORE:
+		/* Need more input to complete message */
+		break;
+	default:
+		berr("Error %d processing log message '%s'\n", rc,
+		     line->str.cstr);
+		break;
+	}
+}
+
+void bparse_line_process(binp_parser_t parser, struct bparse_line *line)
+{
+	struct bwq_entry *ent;
+	uint64_t ts;
+	int rc;
+
+	ts = bstats_ts();
+	rc = parser->parse(parser, &line->str, &ent);
+	bstats_lat_since(&binp_parse_lat, ts);
+	__line_done(line, rc, ent);
+	bparse_line_free(line);
+}
+
+void bparse_lines_parse(binp_parser_t parser, struct bparse_line **lines,
+			int n)
+{
+	struct bstr *strs[BPARSE_BATCH_MAX];
+	struct bwq_entry *ents[BPARSE_BATCH_MAX];
+	binp_result_t rcs[BPARSE_BATCH_MAX];
+	uint64_t ts;
+	int i, k;
+
+	while (n > 0) {
+		k = n < BPARSE_BATCH_MAX ? n : BPARSE_BATCH_MAX;
+		for (i = 0; i < k; i++)
+			strs[i] = &lines[i]->str;
+		ts = bstats_ts();
+		binp_parse_batch(parser, strs, k, ents, rcs);
+		bstats_lat_since(&binp_parse_lat, ts);
+		for (i = 0; i < k; i++)
+			__line_done(lines[i], rcs[i], ents[i]);
+		lines += k;
+		n -= k;
+	}
+}
+
+void bparse_lines_process(binp_parser_t parser, struct bparse_line **lines,
+			  int n)
+{
+	int i;
+	bparse_lines_parse(parser, lines, n);
+	for (i = 0; i < n; i++)
+		bparse_line_free(lines[i]);
+}
+
+struct bparse_thr_arg {
+	bparse_pool_t pool;
+	int idx;
+};
+
+static void *bparse_pool_routine(void *arg)
+{
+	bparse_pool_t pool = ((struct bparse_thr_arg *)arg)->pool;
+	binp_parser_t parser;
+	struct bwq_entry *ents[BPARSE_BATCH_MAX];
+	int n;
+
+	parser = pool->parsers[((struct bparse_thr_arg *)arg)->idx];
+	free(arg);
+	/* Only allow cancellation while waiting for the lines */
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+	while (1) {
+		pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+		n = bwq_dq_batch(&pool->q, ents, BPARSE_BATCH_MAX);
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+		/* ent is the first member of the line */
+		bparse_lines_process(parser, (void *)ents, n);
+	}
+	return NULL;
+}
+
+binp_parser_t *bparse_parsers_new(int n, binp_parser_t first,
+				  binp_get_parser_fn_t get_parser, void *lib,
+				  struct bpair_str_head *args)
+{
+	binp_parser_t *parsers;
+	int i, rc;
+
+	parsers = calloc(n, sizeof(*parsers));
+	if (!parsers)
+		return NULL;
+	i = 0;
+	if (first)
+		parsers[i++] = first;
+	for (; i < n; i++) {
+		parsers[i] = get_parser(lib);
+		if (!parsers[i]) {
+			rc = ENOMEM;
+			goto err;
+		}
+		if (args && parsers[i]->config) {
+			rc = parsers[i]->config(parsers[i], args);
+			if (rc) {
+				parsers[i]->release(parsers[i]);
+				goto err;
+			}
+		}
+	}
+	return parsers;
+
+ err:
+	bparse_parsers_free(parsers, i, first);
+	errno = rc;
+	return NULL;
+}
+
+void bparse_parsers_free(binp_parser_t *parsers, int n, binp_parser_t first)
+{
+	int i;
+	for (i = 0; i < n; i++) {
+		if (parsers[i] != first)
+			parsers[i]->release(parsers[i]);
+	}
+	free(parsers);
+}
+
+bparse_pool_t bparse_pool_new(int n, binp_get_parser_fn_t get_parser,
+			      void *lib, struct bpair_str_head *args)
+{
+	bparse_pool_t pool;
+	int rc;
+
+	if (n < 1) {
+		errno = EINVAL;
+		return NULL;
+	}
+	/* bwq keeps head and tail on separate cache lines */
+	rc = posix_memalign((void **)&pool, 64, sizeof(*pool));
+	if (rc) {
+		errno = rc;
+		return NULL;
+	}
+	pool->n = 0;
+	pool->nparsers = n;
+	pool->parsers = NULL;
+	pool->thr = calloc(n, sizeof(*pool->thr));
+	if (!pool->thr) {
+		rc = ENOMEM;
+		goto err0;
+	}
+	rc = bwq_init(&pool->q, BPARSE_POOL_QDEPTH);
+	if (rc)
+		goto err0;
+	pool->parsers = bparse_parsers_new(n, NULL, get_parser, lib, args);
+	if (!pool->parsers) {
+		rc = errno;
+		goto err1;
+	}
+	return pool;
+
+ err1:
+	bwq_fini(&pool->q);
+ err0:
+	free(pool->thr);
+	free(pool);
+	errno = rc;
+	return NULL;
+}
+
+int bparse_pool_start(bparse_pool_t pool)
+{
+	struct bparse_thr_arg *arg;
+	int rc;
+
+	while (pool->n < pool->nparsers) {
+		arg = malloc(sizeof(*arg));
+		if (!arg) {
+			rc = ENOMEM;
+			goto err;
+		}
+		arg->pool = pool;
+		arg->idx = pool->n;
+		rc = pthread_create(&pool->thr[pool->n], NULL,
+				    bparse_pool_routine, arg);
+		if (rc) {
+			free(arg);
+			goto err;
+		}
+		pool->n++;
+	}
+	return 0;
+
+ err:
+	bparse_pool_stop(pool);
+	return rc;
+}
+
+void bparse_pool_stop(bparse_pool_t pool)
+{
+	int i;
+
+	for (i = 0; i < pool->n; i++) {
+		pthread_cancel(pool->thr[i]);
+		pthread_join(pool->thr[i], NULL);
+	}
+	pool->n = 0;
+}
+
+void bparse_pool_post(bparse_pool_t pool, struct bparse_line *line)
+{
+	bwq_nq(&pool->q, &line->ent);
+}
+
+void bparse_pool_free(bparse_pool_t pool)
+{
+	struct bwq_entry *ent;
+
+	bparse_pool_stop(pool);
+	while ((ent = bwq_try_dq(&pool->q)))
+		bparse_line_free((void *)ent);
+	bparse_parsers_free(pool->parsers, pool->nparsers, NULL);
+	bwq_fini(&pool->q);
+	free(pool->thr);
+	free(pool);
+}
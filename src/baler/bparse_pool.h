@@ -0,0 +1,200 @@
+/* -*- c-basic-offset: 8 -*-
+ * Copyright (c) 2026 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2026 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * \file bparse_pool.h
+ * \brief A pool of parser threads for the input plugins.
+ *
+ * \defgroup bparse_pool Baler Parse Pool
+ * \{
+ * An input plugin normally parses each message on its I/O thread, so a slow
+ * parse stalls all of the sources served by that thread. With a
+ * ::bparse_pool, the I/O threads only frame the raw lines (::bparse_line) and
+ * post them to the pool. Each of the pool threads has its own parser instance
+ * (the parsers must be reentrant), parses the lines and posts the entries to
+ * ::binq.
+ *
+ * bparse_line_process() does the same work inline, for the plugins that run
+ * without a pool.
+ */
+#ifndef __BPARSE_POOL_H
+#define __BPARSE_POOL_H
+
+#include <netinet/in.h>
+
+#include "bplugin.h"
+#include "bwqueue.h"
+
+/**
+ * The depth of the raw line queue of a ::bparse_pool.
+ */
+#define BPARSE_POOL_QDEPTH 4096
+
+/**
+ * The maximum number of lines given to the parser at once (see
+ * ::binp_parser::parse_batch).
+ */
+#define BPARSE_BATCH_MAX 64
+
+/**
+ * A raw input line.
+ */
+struct bparse_line {
+	struct bwq_entry ent; /**< For the pool queue */
+	struct sockaddr_in sin; /**< Source, for the hostname fallback */
+	struct bstr str; /**< The line, must be the last member */
+};
+
+typedef struct bparse_pool *bparse_pool_t;
+
+/**
+ * Allocate a line of \c len bytes. \c str.blen is set to \c len.
+ *
+ * \retval line The line.
+ * \retval NULL If there is not enough memory.
+ */
+static inline
+struct bparse_line *bparse_line_alloc(size_t len)
+{
+	struct bparse_line *line = malloc(sizeof(*line) + len + 1);
+	if (!line)
+		return NULL;
+	line->str.blen = len;
+	return line;
+}
+
+static inline
+void bparse_line_free(struct bparse_line *line)
+{
+	free(line);
+}
+
+/**
+ * Parse \c line with \c parser, post the entry to ::binq and free \c line.
+ *
+ * If the parser does not find a hostname in the line, the source address of
+ * the line is used.
+ */
+void bparse_line_process(binp_parser_t parser, struct bparse_line *line);
+
+/**
+ * bparse_line_process() for the \c n lines \c lines[], handed to the parser
+ * in batches (see ::binp_parser::parse_batch).
+ */
+void bparse_lines_process(binp_parser_t parser, struct bparse_line **lines,
+			  int n);
+
+/**
+ * bparse_lines_process(), but the lines are not freed: the caller keeps them
+ * (e.g. a receive ring). The entries do not refer to the lines.
+ */
+void bparse_lines_parse(binp_parser_t parser, struct bparse_line **lines,
+			int n);
+
+/**
+ * Create the parsers of \c n threads, as a parser instance is not shared
+ * between the threads. The first one is \c first if it is not \c NULL (e.g.
+ * the parser that the plugin already configured). The others come from
+ * \c get_parser(\c lib) and are configured with \c args (see
+ * ::binp_parser::config) if \c args is not \c NULL.
+ *
+ * \retval parsers The array of \c n parsers, see bparse_parsers_free().
+ * \retval NULL If there is an error, \c errno is also set.
+ */
+binp_parser_t *bparse_parsers_new(int n, binp_parser_t first,
+				  binp_get_parser_fn_t get_parser, void *lib,
+				  struct bpair_str_head *args);
+
+/**
+ * Release the \c n parsers from bparse_parsers_new(), except \c first, and
+ * free the array.
+ */
+void bparse_parsers_free(binp_parser_t *parsers, int n, binp_parser_t first);
+
+/**
+ * Create a parse pool of \c n threads. Each thread gets its own parser from
+ * \c get_parser(\c lib), configured with \c args (see ::binp_parser::config)
+ * if \c args is not \c NULL. The threads are not created until
+ * bparse_pool_start(), so that a plugin can create the pool in its config()
+ * and the threads in its start(), after balerd has applied the plugin's CPU
+ * affinity.
+ *
+ * \retval pool The pool.
+ * \retval NULL If there is an error, \c errno is also set.
+ */
+bparse_pool_t bparse_pool_new(int n, binp_get_parser_fn_t get_parser,
+			      void *lib, struct bpair_str_head *args);
+
+/**
+ * Start the pool threads. The threads inherit the CPU affinity of the caller.
+ *
+ * \retval 0 If success.
+ * \retval errno If error; no pool thread is left running.
+ */
+int bparse_pool_start(bparse_pool_t pool);
+
+/**
+ * Stop the pool threads. The lines that are still queued stay in the queue
+ * until the pool is started again or freed.
+ */
+void bparse_pool_stop(bparse_pool_t pool);
+
+/**
+ * Post \c line to \c pool. This blocks if the pool queue is full. The pool
+ * owns \c line afterward.
+ */
+void bparse_pool_post(bparse_pool_t pool, struct bparse_line *line);
+
+/**
+ * Stop the pool threads (if they are running) and free \c pool. The lines that are not yet parsed
+ * are dropped.
+ */
+void bparse_pool_free(bparse_pool_t pool);
+
+#endif
+/**\}*/
@@ -154,9 +154,40 @@ struct binp_parser {
 	const char *(*get_version)(binp_parser_t);
 	binp_result_t (*parse)(binp_parser_t, struct bstr *, struct bwq_entry **);
 	void (*release)(binp_parser_t);
+	/**
+	 * Optional. Configure the parser with the options of the input
+	 * plugin that uses it (the options unknown to the parser are
+	 * ignored). Returns 0 on success, or an errno.
+	 */
+	int (*config)(binp_parser_t, struct bpair_str_head *);
+	/**
+	 * Optional. Parse the \c n lines \c lines[] as ::binp_parser::parse
+	 * does, one after the other: \c ents[i] and \c rcs[i] are the entry
+	 * and the result for \c lines[i]. This lets the parser do its per-call
+	 * setup once per batch. Use binp_parse_batch(), which falls back to
+	 * ::binp_parser::parse for the parsers without it.
+	 */
+	void (*parse_batch)(binp_parser_t, struct bstr **lines, int n,
+			    struct bwq_entry **ents, binp_result_t *rcs);
 };
 typedef binp_parser_t (*binp_get_parser_fn_t)(void *);
 
+/**
+ * Parse the \c n lines \c lines[] with \c p (see ::binp_parser::parse_batch).
+ */
+static inline
+void binp_parse_batch(binp_parser_t p, struct bstr **lines, int n,
+		      struct bwq_entry **ents, binp_result_t *rcs)
+{
+	int i;
+	if (p->parse_batch) {
+		p->parse_batch(p, lines, n, ents, rcs);
+		return;
+	}
+	for (i = 0; i < n; i++)
+		rcs[i] = p->parse(p, lines[i], &ents[i]);
+}
+
 /**
  * Generic, convenient free function for ::bplugin.
  * All it does is only freeing the resources pointed by members of ::bplugin and
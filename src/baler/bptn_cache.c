@@ -0,0 +1,296 @@
+/* -*- c-basic-offset: 8 -*-
+ * Copyright (c) 2026 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2026 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * \file bptn_cache.c
+ * \brief Pattern table implementation.
+ */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "bptn_cache.h"
+#include "butils.h"
+#include "fnv_hash.h"
+
+#define BPTN_CACHE_SEED 0xBA1E
+
+/* A detached dirty record, see bptn_cache_flush() */
+struct bptn_cache_rec {
+	bptn_cache_entry_t ent;
+	struct timeval first_seen;
+	struct timeval last_seen;
+	uint64_t count;
+};
+
+bptn_cache_t bptn_cache_new(bstore_t bs, size_t hash_size)
+{
+	bptn_cache_t c;
+	struct bptn_cache_stripe *s;
+	int i;
+
+	if (!bs->plugin->ptn_stat_update) {
+		errno = ENOSYS;
+		return NULL;
+	}
+	c = calloc(1, sizeof(*c));
+	if (!c)
+		goto err_0;
+	c->bs = bs;
+	hash_size = (hash_size / BPTN_CACHE_STRIPES) | 1;
+	for (i = 0; i < BPTN_CACHE_STRIPES; i++) {
+		s = &c->stripe[i];
+		pthread_mutex_init(&s->mutex, NULL);
+		TAILQ_INIT(&s->dirty_list);
+		s->hash_size = hash_size;
+		s->hash_table = calloc(hash_size, sizeof(s->hash_table[0]));
+		if (!s->hash_table)
+			goto err_1;
+	}
+	return c;
+
+ err_1:
+	bptn_cache_free(c);
+ err_0:
+	errno = ENOMEM;
+	return NULL;
+}
+
+void bptn_cache_free(bptn_cache_t c)
+{
+	struct bptn_cache_stripe *s;
+	bptn_cache_entry_t ent;
+	int i, j;
+
+	for (i = 0; i < BPTN_CACHE_STRIPES; i++) {
+		s = &c->stripe[i];
+		if (!s->hash_table)
+			continue;
+		for (j = 0; j < s->hash_size; j++) {
+			while ((ent = LIST_FIRST(&s->hash_table[j]))) {
+				LIST_REMOVE(ent, hash_link);
+				free(ent);
+			}
+		}
+		free(s->hash_table);
+		pthread_mutex_destroy(&s->mutex);
+	}
+	free(c);
+}
+
+static inline
+struct bptn_cache_stripe *__stripe(bptn_cache_t c, uint32_t hash)
+{
+	return &c->stripe[hash % BPTN_CACHE_STRIPES];
+}
+
+static inline
+struct bptn_cache_bucket *__bucket(struct bptn_cache_stripe *s, uint32_t hash)
+{
+	return &s->hash_table[(hash / BPTN_CACHE_STRIPES) % s->hash_size];
+}
+
+static bptn_cache_entry_t __entry_find(struct bptn_cache_stripe *s,
+				       uint32_t hash, bstr_t ptn)
+{
+	bptn_cache_entry_t ent;
+	LIST_FOREACH(ent, __bucket(s, hash), hash_link) {
+		if (ent->hash == hash && ent->ptn.blen == ptn->blen &&
+				0 == memcmp(ent->ptn.cstr, ptn->cstr, ptn->blen))
+			return ent;
+	}
+	return NULL;
+}
+
+/* Merge the statistics into the entry, stripe lock must be held */
+static void __entry_merge(struct bptn_cache_stripe *s, bptn_cache_entry_t ent,
+			  const struct timeval *first_seen,
+			  const struct timeval *last_seen, uint64_t count)
+{
+	if (!ent->count) {
+		ent->first_seen = *first_seen;
+		ent->last_seen = *last_seen;
+	} else {
+		if (timercmp(first_seen, &ent->first_seen, <))
+			ent->first_seen = *first_seen;
+		if (timercmp(last_seen, &ent->last_seen, >))
+			ent->last_seen = *last_seen;
+	}
+	ent->count += count;
+	if (!ent->dirty) {
+		ent->dirty = 1;
+		TAILQ_INSERT_TAIL(&s->dirty_list, ent, dirty_link);
+	}
+}
+
+bptn_id_t bptn_cache_ptn_add(bptn_cache_t c, struct timeval *tv, bstr_t ptn)
+{
+	struct bptn_cache_stripe *s;
+	bptn_cache_entry_t ent;
+	bptn_id_t ptn_id;
+	uint32_t hash;
+
+	hash = fnv_hash_a1_32(ptn->cstr, ptn->blen, BPTN_CACHE_SEED);
+	s = __stripe(c, hash);
+	pthread_mutex_lock(&s->mutex);
+	ent = __entry_find(s, hash, ptn);
+	if (ent) {
+		s->hit++;
+		__entry_merge(s, ent, tv, tv, 1);
+		ptn_id = ent->ptn_id;
+		goto out;
+	}
+
+	/* New to the table, the store assigns the ID (and counts this
+	 * occurrence). The stripe lock is held so that the other workers
+	 * don't insert the same pattern twice. */
+	s->miss++;
+	ent = malloc(sizeof(*ent) + ptn->blen);
+	if (!ent) {
+		errno = ENOMEM;
+		ptn_id = 0;
+		goto out;
+	}
+	/* copy the key first, bstore_ptn_add() modifies ptn */
+	ent->ptn.blen = ptn->blen;
+	memcpy(ent->ptn.cstr, ptn->cstr, ptn->blen);
+	ptn_id = bstore_ptn_add(c->bs, tv, ptn);
+	if (!ptn_id) {
+		free(ent);
+		goto out;
+	}
+	ent->hash = hash;
+	ent->dirty = 0;
+	ent->count = 0;
+	ent->ptn_id = ptn_id;
+	LIST_INSERT_HEAD(__bucket(s, hash), ent, hash_link);
+	s->count++;
+ out:
+	pthread_mutex_unlock(&s->mutex);
+	return ptn_id;
+}
+
+static int __stripe_flush(bptn_cache_t c, struct bptn_cache_stripe *s)
+{
+	struct bptn_cache_rec *recs;
+	bptn_cache_entry_t ent;
+	int i, n, rc, ret = 0;
+
+	pthread_mutex_lock(&s->mutex);
+	n = 0;
+	TAILQ_FOREACH(ent, &s->dirty_list, dirty_link) {
+		n++;
+	}
+	if (!n) {
+		pthread_mutex_unlock(&s->mutex);
+		return 0;
+	}
+	recs = malloc(n * sizeof(*recs));
+	if (!recs) {
+		pthread_mutex_unlock(&s->mutex);
+		return ENOMEM;
+	}
+	i = 0;
+	while ((ent = TAILQ_FIRST(&s->dirty_list))) {
+		TAILQ_REMOVE(&s->dirty_list, ent, dirty_link);
+		recs[i].ent = ent;
+		recs[i].first_seen = ent->first_seen;
+		recs[i].last_seen = ent->last_seen;
+		recs[i].count = ent->count;
+		ent->count = 0;
+		ent->dirty = 0;
+		i++;
+	}
+	pthread_mutex_unlock(&s->mutex);
+
+	for (i = 0; i < n; i++) {
+		rc = bstore_ptn_stat_update(c->bs, recs[i].ent->ptn_id,
+					    &recs[i].first_seen,
+					    &recs[i].last_seen,
+					    recs[i].count);
+		if (!rc)
+			continue;
+		ret = rc;
+		/* put it back for the next flush */
+		pthread_mutex_lock(&s->mutex);
+		__entry_merge(s, recs[i].ent, &recs[i].first_seen,
+			      &recs[i].last_seen, recs[i].count);
+		pthread_mutex_unlock(&s->mutex);
+	}
+	free(recs);
+	return ret;
+}
+
+int bptn_cache_flush(bptn_cache_t c)
+{
+	int i, rc, ret = 0;
+	for (i = 0; i < BPTN_CACHE_STRIPES; i++) {
+		rc = __stripe_flush(c, &c->stripe[i]);
+		if (rc)
+			ret = rc;
+	}
+	return ret;
+}
+
+void bptn_cache_stat(bptn_cache_t c, uint64_t *hit, uint64_t *miss,
+		     size_t *count)
+{
+	struct bptn_cache_stripe *s;
+	int i;
+
+	*hit = *miss = *count = 0;
+	for (i = 0; i < BPTN_CACHE_STRIPES; i++) {
+		s = &c->stripe[i];
+		pthread_mutex_lock(&s->mutex);
+		*hit += s->hit;
+		*miss += s->miss;
+		*count += s->count;
+		pthread_mutex_unlock(&s->mutex);
+	}
+}
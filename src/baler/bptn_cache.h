@@ -0,0 +1,158 @@
+/* -*- c-basic-offset: 8 -*-
+ * Copyright (c) 2026 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2026 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * \file bptn_cache.h
+ * \brief An in-memory pattern table in front of bstore_ptn_add().
+ *
+ * \defgroup bptn_cache Pattern Table
+ * \{
+ * A ::bptn_cache keeps every pattern seen by the daemon (encoded pattern ->
+ * ptn_id) resident in memory. A new pattern still goes to the store right
+ * away so that it gets its ID synchronously. For the known patterns, only the
+ * in-memory record (count, first_seen, last_seen) is updated, and the records
+ * are written back to the store in batches by bptn_cache_flush() using
+ * bstore_ptn_stat_update().
+ *
+ * The table is shared by all input workers. It is split into stripes, each
+ * with its own lock, to keep the workers from contending on a single lock.
+ */
+#ifndef __BPTN_CACHE_H
+#define __BPTN_CACHE_H
+
+#include <pthread.h>
+#include <sys/queue.h>
+
+#include "btypes.h"
+#include "bstore.h"
+
+#define BPTN_CACHE_STRIPES 16
+
+typedef struct bptn_cache_entry {
+	LIST_ENTRY(bptn_cache_entry) hash_link; /* hash bucket link */
+	TAILQ_ENTRY(bptn_cache_entry) dirty_link; /* dirty list link */
+	uint32_t hash; /* cached hash value of the pattern */
+	int dirty; /* 1 if the entry is in the dirty list */
+	bptn_id_t ptn_id;
+	/* statistics not yet written to the store */
+	struct timeval first_seen;
+	struct timeval last_seen;
+	uint64_t count;
+	struct bstr ptn; /* must be the last member */
+} *bptn_cache_entry_t;
+
+LIST_HEAD(bptn_cache_bucket, bptn_cache_entry);
+TAILQ_HEAD(bptn_cache_dirty_list, bptn_cache_entry);
+
+struct bptn_cache_stripe {
+	pthread_mutex_t mutex;
+	size_t hash_size;
+	struct bptn_cache_bucket *hash_table;
+	struct bptn_cache_dirty_list dirty_list;
+	size_t count;
+	uint64_t hit;
+	uint64_t miss;
+};
+
+typedef struct bptn_cache {
+	bstore_t bs; /* the backing store */
+	struct bptn_cache_stripe stripe[BPTN_CACHE_STRIPES];
+} *bptn_cache_t;
+
+/**
+ * Create a pattern table in front of the store \c bs.
+ *
+ * \param bs The store handle. The store plugin must support
+ *           \c ptn_stat_update().
+ * \param hash_size The total number of hash buckets.
+ *
+ * \retval cache The pattern table handle, if success.
+ * \retval NULL  If failed, \c errno is also set. \c ENOSYS means that the
+ *               store does not support \c ptn_stat_update().
+ */
+bptn_cache_t bptn_cache_new(bstore_t bs, size_t hash_size);
+
+/**
+ * Free the pattern table.
+ *
+ * \note Pending statistics are NOT written to the store. Call
+ *       bptn_cache_flush() before freeing the table to keep them.
+ */
+void bptn_cache_free(bptn_cache_t c);
+
+/**
+ * Cached version of bstore_ptn_add().
+ *
+ * \note Like bstore_ptn_add(), the content of \c ptn may be modified.
+ *
+ * \retval ptn_id The pattern ID, if success.
+ * \retval 0      If failed, \c errno is also set.
+ */
+bptn_id_t bptn_cache_ptn_add(bptn_cache_t c, struct timeval *tv, bstr_t ptn);
+
+/**
+ * Write the pending pattern statistics back to the store.
+ *
+ * The dirty records are detached from the table under the stripe lock and
+ * written to the store without holding it, so the input workers are not
+ * blocked by the store during the flush.
+ *
+ * \retval 0     If success.
+ * \retval errno If some of the records could not be written. Those records
+ *               are merged back into the table for the next flush.
+ */
+int bptn_cache_flush(bptn_cache_t c);
+
+/**
+ * Get the total hit and miss counts of the table.
+ */
+void bptn_cache_stat(bptn_cache_t c, uint64_t *hit, uint64_t *miss,
+		     size_t *count);
+
+/**\}*/
+#endif
@@ -0,0 +1,92 @@
+/* -*- c-basic-offset: 8 -*-
+ * Copyright (c) 2026 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2026 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "bstats.h"
+
+int bstats_enabled = 0;
+
+void bstats_lat_merge(struct bstats_lat *dst, const struct bstats_lat *src)
+{
+	int i;
+	uint64_t max = __atomic_load_n(&src->max_ns, __ATOMIC_RELAXED);
+	dst->count += __atomic_load_n(&src->count, __ATOMIC_RELAXED);
+	dst->sum_ns += __atomic_load_n(&src->sum_ns, __ATOMIC_RELAXED);
+	if (max > dst->max_ns)
+		dst->max_ns = max;
+	for (i = 0; i < BSTATS_LAT_BUCKETS; i++)
+		dst->hist[i] += __atomic_load_n(&src->hist[i],
+						__ATOMIC_RELAXED);
+}
+
+uint64_t bstats_lat_pct(const struct bstats_lat *l, double pct)
+{
+	uint64_t n = 0, total = 0;
+	int i;
+	for (i = 0; i < BSTATS_LAT_BUCKETS; i++)
+		total += l->hist[i];
+	if (!total)
+		return 0;
+	for (i = 0; i < BSTATS_LAT_BUCKETS - 1; i++) {
+		n += l->hist[i];
+		if (n * 100.0 >= total * pct)
+			break;
+	}
+	if (i == BSTATS_LAT_BUCKETS - 1)
+		return l->max_ns;
+	return (2UL << i) - 1;
+}
+
+void bstats_lat_print(FILE *f, const char *name, const struct bstats_lat *l)
+{
+	fprintf(f, "%s.count %lu\n", name, l->count);
+	fprintf(f, "%s.mean_us %.3f\n", name,
+		l->count ? l->sum_ns / 1000.0 / l->count : 0.0);
+	fprintf(f, "%s.p50_us %.3f\n", name, bstats_lat_pct(l, 50) / 1000.0);
+	fprintf(f, "%s.p99_us %.3f\n", name, bstats_lat_pct(l, 99) / 1000.0);
+	fprintf(f, "%s.max_us %.3f\n", name, l->max_ns / 1000.0);
+}
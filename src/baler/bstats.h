@@ -0,0 +1,151 @@
+/* -*- c-basic-offset: 8 -*-
+ * Copyright (c) 2026 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2026 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * \file bstats.h
+ * \brief Counters and latency histograms for the balerd stages.
+ *
+ * \defgroup bstats Baler Statistics
+ * \{
+ * A ::bstats_lat records a latency distribution in power-of-2 nanosecond
+ * buckets, along with the count, the sum and the maximum. The updates are
+ * relaxed atomic operations, so a ::bstats_lat can be shared by threads, and
+ * it can be read by the stats writer while it is being updated.
+ *
+ * The statistics are collected only if ::bstats_enabled is set (balerd sets
+ * it when the stats file is configured), so that the timestamps are not taken
+ * for nothing.
+ */
+#ifndef __BSTATS_H
+#define __BSTATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * The number of histogram buckets. Bucket \c i counts the latencies in
+ * [2^i, 2^(i+1)) ns, and the last bucket also counts everything above.
+ */
+#define BSTATS_LAT_BUCKETS 36
+
+struct bstats_lat {
+	uint64_t count; /**< Number of samples */
+	uint64_t sum_ns; /**< Sum of the samples */
+	uint64_t max_ns; /**< Maximum sample */
+	uint64_t hist[BSTATS_LAT_BUCKETS]; /**< log2 histogram */
+};
+
+/**
+ * Non-zero if the statistics are collected.
+ */
+extern int bstats_enabled;
+
+/**
+ * Current time in nanoseconds from the monotonic clock, or 0 if the
+ * statistics are disabled.
+ */
+static inline
+uint64_t bstats_ts()
+{
+	struct timespec ts;
+	if (!bstats_enabled)
+		return 0;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+/**
+ * Record a sample of \c ns nanoseconds to \c l.
+ */
+static inline
+void bstats_lat_add(struct bstats_lat *l, uint64_t ns)
+{
+	int b = ns ? 63 - __builtin_clzl(ns) : 0;
+	uint64_t max;
+	if (b >= BSTATS_LAT_BUCKETS)
+		b = BSTATS_LAT_BUCKETS - 1;
+	__atomic_add_fetch(&l->count, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&l->sum_ns, ns, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&l->hist[b], 1, __ATOMIC_RELAXED);
+	max = __atomic_load_n(&l->max_ns, __ATOMIC_RELAXED);
+	while (ns > max && !__atomic_compare_exchange_n(&l->max_ns, &max, ns,
+				1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+/**
+ * Record the time elapsed since \c ts0 (from bstats_ts()) to \c l.
+ */
+static inline
+void bstats_lat_since(struct bstats_lat *l, uint64_t ts0)
+{
+	if (!bstats_enabled || !ts0)
+		return;
+	bstats_lat_add(l, bstats_ts() - ts0);
+}
+
+/**
+ * Add the samples of \c src to \c dst (\c dst is not shared).
+ */
+void bstats_lat_merge(struct bstats_lat *dst, const struct bstats_lat *src);
+
+/**
+ * Approximate \c pct percentile (0 - 100) of \c l in nanoseconds, that is the
+ * upper bound of the bucket containing it.
+ */
+uint64_t bstats_lat_pct(const struct bstats_lat *l, double pct);
+
+/**
+ * Print \c l to \c f as "<name>.<field> <value>" lines, with the
+ * latencies in microseconds.
+ */
+void bstats_lat_print(FILE *f, const char *name, const struct bstats_lat *l);
+
+#endif
+/**\}*/
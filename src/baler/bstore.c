@@ -134,8 +134,28 @@ void bstore_close(bstore_t bs)
 
 btkn_id_t bstore_tkn_add(bstore_t bs, btkn_t tkn)
 {
-	BLEN_ASSERT(tkn->tkn_str);
-	return bs->plugin->tkn_add(bs, tkn);
+	struct bstr *str;
+	btkn_id_t tkn_id;
+
+	if (tkn->tkn_str) {
+		BLEN_ASSERT(tkn->tkn_str);
+		return bs->plugin->tkn_add(bs, tkn);
+	}
+	/* A slice token (see barena_btkn_slice()): the store only sees a
+	 * copy of the text for the duration of the call. */
+	str = bstr_alloc(tkn->tkn_len);
+	if (!str) {
+		errno = ENOMEM;
+		return 0;
+	}
+	str->blen = tkn->tkn_len;
+	memcpy(str->cstr, tkn->tkn_text, tkn->tkn_len);
+	str->cstr[str->blen] = '\0';
+	tkn->tkn_str = str;
+	tkn_id = bs->plugin->tkn_add(bs, tkn);
+	tkn->tkn_str = NULL;
+	bstr_free(str);
+	return tkn_id;
 }
 
 int bstore_tkn_add_with_id(bstore_t bs, btkn_t tkn)
@@ -274,6 +294,16 @@ bptn_id_t bstore_ptn_add(bstore_t bs, struct timeval *tv, bstr_t ptn)
 	return bs->plugin->ptn_add(bs, tv, ptn);
 }
 
+int bstore_ptn_stat_update(bstore_t bs, bptn_id_t ptn_id,
+			   struct timeval *first_seen,
+			   struct timeval *last_seen, uint64_t count)
+{
+	if (!bs->plugin->ptn_stat_update)
+		return ENOSYS;
+	return bs->plugin->ptn_stat_update(bs, ptn_id, first_seen, last_seen,
+					   count);
+}
+
 bptn_t bstore_ptn_find(bstore_t bs, bptn_id_t ptn_id)
 {
 	return bs->plugin->ptn_find(bs, ptn_id);
@@ -289,6 +319,20 @@ int bstore_msg_add(bstore_t bs, struct timeval *tv, bmsg_t msg)
 	return bs->plugin->msg_add(bs, tv, msg);
 }
 
+int bstore_msg_add_batch(bstore_t bs, int n, struct timeval tv[],
+			 bmsg_t msgs[])
+{
+	int i, rc, ret = 0;
+	if (bs->plugin->msg_add_batch)
+		return bs->plugin->msg_add_batch(bs, n, tv, msgs);
+	for (i = 0; i < n; i++) {
+		rc = bs->plugin->msg_add(bs, &tv[i], msgs[i]);
+		if (rc)
+			ret = rc;
+	}
+	return ret;
+}
+
 bstore_iter_pos_t bstore_msg_iter_pos_get(bmsg_iter_t iter)
 {
 	return bstore_iter_pos_get(iter);
@@ -519,6 +563,38 @@ int bstore_ptn_tkn_add(bstore_t bs, bptn_id_t ptn_id, uint64_t tkn_pos, btkn_id_
 	return bs->plugin->ptn_tkn_add(bs, ptn_id, tkn_pos, tkn_id);
 }
 
+int bstore_hist_update_batch(bstore_t bs, int n,
+			     struct bstore_hist_update_s ups[])
+{
+	int i, rc, ret = 0;
+	bstore_hist_update_t up;
+	if (bs->plugin->hist_update_batch)
+		return bs->plugin->hist_update_batch(bs, n, ups);
+	for (i = 0; i < n; i++) {
+		up = &ups[i];
+		switch (up->type) {
+		case BSTORE_HIST_UPDATE_TKN:
+			rc = bs->plugin->tkn_hist_update(bs, up->secs,
+						up->bin_width, up->tkn_id);
+			break;
+		case BSTORE_HIST_UPDATE_PTN:
+			rc = bs->plugin->ptn_hist_update(bs, up->ptn_id,
+						up->comp_id, up->secs,
+						up->bin_width);
+			break;
+		case BSTORE_HIST_UPDATE_PTN_TKN:
+			rc = bs->plugin->ptn_tkn_add(bs, up->ptn_id,
+						up->tkn_pos, up->tkn_id);
+			break;
+		default:
+			rc = EINVAL;
+		}
+		if (rc)
+			ret = rc;
+	}
+	return ret;
+}
+
 btkn_t bstore_ptn_tkn_find(bstore_t bs, bptn_id_t ptn_id,
 			   uint64_t tkn_pos, btkn_id_t tkn_id)
 {
@@ -68,6 +68,31 @@ struct bstore_iter_filter_s {
 
 typedef struct bstore_iter_filter_s *bstore_iter_filter_t;
 
+/**
+ * Types of the histogram updates in ::bstore_hist_update_s.
+ */
+typedef enum bstore_hist_update_type_e {
+	BSTORE_HIST_UPDATE_TKN,     /**< like \c tkn_hist_update() */
+	BSTORE_HIST_UPDATE_PTN,     /**< like \c ptn_hist_update() */
+	BSTORE_HIST_UPDATE_PTN_TKN, /**< like \c ptn_tkn_add() */
+} bstore_hist_update_type_t;
+
+/**
+ * A histogram update record for \c hist_update_batch(). Only the fields
+ * used by the \c type are relevant.
+ */
+struct bstore_hist_update_s {
+	bstore_hist_update_type_t type;
+	time_t secs;       /**< TKN, PTN: the (clamped) time of the bin */
+	time_t bin_width;  /**< TKN, PTN: the bin width */
+	bptn_id_t ptn_id;  /**< PTN, PTN_TKN */
+	bcomp_id_t comp_id;/**< PTN */
+	btkn_id_t tkn_id;  /**< TKN, PTN_TKN */
+	uint64_t tkn_pos;  /**< PTN_TKN */
+};
+
+typedef struct bstore_hist_update_s *bstore_hist_update_t;
+
 /**
  * Return !0 if the current iterator object should be returned
  *
@@ -85,7 +110,7 @@ typedef struct bstore_iter_filter_s *bstore_iter_filter_t;
 typedef int (*bmsg_cmp_fn_t)(bptn_id_t ptn_id, time_t ts,
 			     bcomp_id_t comp_id, void *ctxt);
 
-#define BSTORE_INTERFACE_VERSION_U32 0x03010000
+#define BSTORE_INTERFACE_VERSION_U32 0x03030000
 #define BSTORE_INTERFACE_VERSION_INITIALIZER { .u32 = BSTORE_INTERFACE_VERSION_U32 }
 
 /**
@@ -134,6 +159,11 @@ typedef struct bstore_plugin_s {
 	 * If the token is not present in the store, add it. In either
 	 * case, return it's tkn_id
 	 *
+	 * If the token is already in the store, its count is increased by
+	 * \c tkn->tkn_count (or by 1 if \c tkn->tkn_count is 0). This lets
+	 * the callers that cache token IDs (see \ref btkn_cache) write the
+	 * accumulated counts back in one call.
+	 *
 	 * \param bs The bstore handle
 	 * \param tkn The token to be inserted
 	 *
@@ -894,6 +924,62 @@ typedef struct bstore_plugin_s {
 	 */
 	int (*msg_iter_update)(bmsg_iter_t i, bmsg_t new_msg);
 
+	/**
+	 * Merge the pattern statistics accumulated by the caller into the
+	 * pattern \c ptn_id.
+	 *
+	 * The pattern first_seen becomes \c min(first_seen, \c first_seen),
+	 * last_seen becomes \c max(last_seen, \c last_seen), and \c count is
+	 * added to the pattern count. This allows the callers to keep the
+	 * pattern statistics in memory and write them back in batches
+	 * instead of calling \c ptn_add() for every message.
+	 *
+	 * This is optional. The plugin may leave it \c NULL.
+	 *
+	 * \retval 0      If success.
+	 * \retval ENOENT If \c ptn_id is not in the store.
+	 * \retval ENOSYS If the plugin does not support it.
+	 * \retval errno  If other errors.
+	 */
+	int (*ptn_stat_update)(bstore_t bs, bptn_id_t ptn_id,
+			       struct timeval *first_seen,
+			       struct timeval *last_seen, uint64_t count);
+
+	/**
+	 * Add \c n messages at once, \c msgs[i] with the time \c tv[i].
+	 *
+	 * This is the batch version of \c msg_add(). The plugin may use it to
+	 * amortize the locking and the index traversal over the batch. All
+	 * messages are attempted even if some of them failed.
+	 *
+	 * This is optional. If the plugin leaves it \c NULL,
+	 * bstore_msg_add_batch() calls \c msg_add() for each message.
+	 *
+	 * \retval 0     If all messages are added.
+	 * \retval errno The error of the last failed message.
+	 */
+	int (*msg_add_batch)(bstore_t bs, int n, struct timeval tv[],
+			     bmsg_t msgs[]);
+
+	/**
+	 * Apply \c n histogram updates (see ::bstore_hist_update_s) at once.
+	 *
+	 * This is the batch version of \c tkn_hist_update(), \c
+	 * ptn_hist_update() and \c ptn_tkn_add(). The plugin may reorder the
+	 * updates and combine the updates of the same key, as the result
+	 * (the counts) does not depend on the order. The caller may also pass
+	 * the same record multiple times. All updates are attempted even if
+	 * some of them failed.
+	 *
+	 * This is optional. If the plugin leaves it \c NULL,
+	 * bstore_hist_update_batch() calls the single-update functions.
+	 *
+	 * \retval 0     If all updates are applied.
+	 * \retval errno The error of the last failed update.
+	 */
+	int (*hist_update_batch)(bstore_t bs, int n,
+				 struct bstore_hist_update_s ups[]);
+
 } *bstore_plugin_t;
 
 /**
@@ -953,6 +1039,13 @@ int bstore_msg_iter_filter_set(bmsg_iter_t iter, bstore_iter_filter_t filter);
 int bstore_msg_iter_update(bmsg_iter_t i, bmsg_t new_msg);
 
 bptn_id_t bstore_ptn_add(bstore_t bs, struct timeval *tv, bstr_t ptn);
+int bstore_ptn_stat_update(bstore_t bs, bptn_id_t ptn_id,
+			   struct timeval *first_seen,
+			   struct timeval *last_seen, uint64_t count);
+int bstore_msg_add_batch(bstore_t bs, int n, struct timeval tv[],
+			 bmsg_t msgs[]);
+int bstore_hist_update_batch(bstore_t bs, int n,
+			     struct bstore_hist_update_s ups[]);
 bptn_t bstore_ptn_find(bstore_t bs, bptn_id_t ptn_id);
 int bstore_ptn_find_by_ptnstr(bstore_t bs, bptn_t ptn);
 bptn_iter_t bstore_ptn_iter_new(bstore_t bs);
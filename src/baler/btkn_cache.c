@@ -0,0 +1,217 @@
+/* -*- c-basic-offset: 8 -*-
+ * Copyright (c) 2026 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2026 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * \file btkn_cache.c
+ * \brief Token ID cache implementation.
+ */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "btkn_cache.h"
+#include "fnv_hash.h"
+
+#define BTKN_CACHE_SEED 0x5EED
+
+btkn_cache_t btkn_cache_new(bstore_t bs, size_t max_entries)
+{
+	btkn_cache_t c;
+
+	if (!max_entries) {
+		errno = EINVAL;
+		return NULL;
+	}
+	c = calloc(1, sizeof(*c));
+	if (!c)
+		goto err_0;
+	c->bs = bs;
+	c->max_entries = max_entries;
+	/* keep the average chain length below 1 */
+	c->hash_size = max_entries | 1;
+	c->hash_table = calloc(c->hash_size, sizeof(c->hash_table[0]));
+	if (!c->hash_table)
+		goto err_1;
+	TAILQ_INIT(&c->lru);
+	return c;
+
+ err_1:
+	free(c);
+ err_0:
+	errno = ENOMEM;
+	return NULL;
+}
+
+void btkn_cache_free(btkn_cache_t c)
+{
+	btkn_cache_entry_t ent;
+	while ((ent = TAILQ_FIRST(&c->lru))) {
+		TAILQ_REMOVE(&c->lru, ent, lru_link);
+		free(ent);
+	}
+	free(c->hash_table);
+	free(c);
+}
+
+static btkn_cache_entry_t __entry_find(btkn_cache_t c, uint32_t hash,
+				       const char *text, size_t len)
+{
+	btkn_cache_entry_t ent;
+	LIST_FOREACH(ent, &c->hash_table[hash % c->hash_size], hash_link) {
+		if (ent->hash == hash && ent->text.blen == len &&
+				0 == memcmp(ent->text.cstr, text, len))
+			return ent;
+	}
+	return NULL;
+}
+
+/*
+ * Write the pending count of the entry to the store, and refresh the entry
+ * with what the store has.
+ */
+static int __entry_flush(btkn_cache_t c, btkn_cache_entry_t ent)
+{
+	struct btkn tkn = {
+		.tkn_type_mask = ent->tkn_type_mask,
+		.tkn_count = ent->tkn_count,
+		.tkn_str = &ent->text,
+	};
+	btkn_id_t tkn_id;
+
+	if (!ent->tkn_count)
+		return 0;
+	tkn_id = bstore_tkn_add(c->bs, &tkn);
+	if (!tkn_id)
+		return errno ? errno : EIO;
+	ent->tkn_id = tkn_id;
+	ent->tkn_type_mask = tkn.tkn_type_mask;
+	ent->tkn_count = 0;
+	c->flush++;
+	return 0;
+}
+
+static int __entry_evict(btkn_cache_t c)
+{
+	btkn_cache_entry_t ent = TAILQ_LAST(&c->lru, btkn_cache_lru);
+	int rc = __entry_flush(c, ent);
+	if (rc) /* Don't lose the counts; let the next flush retry */
+		return rc;
+	TAILQ_REMOVE(&c->lru, ent, lru_link);
+	LIST_REMOVE(ent, hash_link);
+	free(ent);
+	c->count--;
+	c->evict++;
+	return 0;
+}
+
+btkn_id_t btkn_cache_tkn_add(btkn_cache_t c, btkn_t tkn)
+{
+	btkn_cache_entry_t ent;
+	btkn_id_t tkn_id;
+	uint32_t hash;
+	uint64_t count = tkn->tkn_count ? tkn->tkn_count : 1;
+
+	hash = fnv_hash_a1_32(btkn_text(tkn), btkn_len(tkn), BTKN_CACHE_SEED);
+	ent = __entry_find(c, hash, btkn_text(tkn), btkn_len(tkn));
+	if (ent && (tkn->tkn_type_mask & ~ent->tkn_type_mask) == 0) {
+		/* hit */
+		c->hit++;
+		ent->tkn_count += count;
+		tkn->tkn_id = ent->tkn_id;
+		tkn->tkn_type_mask = ent->tkn_type_mask;
+		if (ent != TAILQ_FIRST(&c->lru)) {
+			TAILQ_REMOVE(&c->lru, ent, lru_link);
+			TAILQ_INSERT_HEAD(&c->lru, ent, lru_link);
+		}
+		return ent->tkn_id;
+	}
+
+	/* miss, or the token carries types unknown to the cache */
+	c->miss++;
+	tkn_id = bstore_tkn_add(c->bs, tkn);
+	if (!tkn_id)
+		return 0;
+
+	if (ent) {
+		ent->tkn_id = tkn_id;
+		ent->tkn_type_mask = tkn->tkn_type_mask;
+		TAILQ_REMOVE(&c->lru, ent, lru_link);
+		TAILQ_INSERT_HEAD(&c->lru, ent, lru_link);
+		return tkn_id;
+	}
+
+	if (c->count >= c->max_entries && __entry_evict(c))
+		return tkn_id; /* the token is in the store, just not cached */
+
+	ent = malloc(sizeof(*ent) + btkn_len(tkn) + 1);
+	if (!ent)
+		return tkn_id; /* the token is in the store, just not cached */
+	ent->hash = hash;
+	ent->tkn_id = tkn_id;
+	ent->tkn_type_mask = tkn->tkn_type_mask;
+	ent->tkn_count = 0;
+	ent->text.blen = btkn_len(tkn);
+	memcpy(ent->text.cstr, btkn_text(tkn), ent->text.blen);
+	ent->text.cstr[ent->text.blen] = '\0';
+	LIST_INSERT_HEAD(&c->hash_table[hash % c->hash_size], ent, hash_link);
+	TAILQ_INSERT_HEAD(&c->lru, ent, lru_link);
+	c->count++;
+	return tkn_id;
+}
+
+int btkn_cache_flush(btkn_cache_t c)
+{
+	btkn_cache_entry_t ent;
+	int rc, ret = 0;
+	TAILQ_FOREACH(ent, &c->lru, lru_link) {
+		rc = __entry_flush(c, ent);
+		if (rc)
+			ret = rc;
+	}
+	return ret;
+}
@@ -0,0 +1,151 @@
+/* -*- c-basic-offset: 8 -*-
+ * Copyright (c) 2026 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2026 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * \file btkn_cache.h
+ * \brief A bounded token-ID cache in front of bstore_tkn_add().
+ *
+ * \defgroup btkn_cache Token ID Cache
+ * \{
+ * A ::btkn_cache maps token text to (tkn_id, tkn_type_mask) so that the
+ * tokens that appear over and over again (e.g. "error", " ", "node") do not
+ * have to go through the store on every message. The occurrence counts of the
+ * cached tokens are accumulated in the cache and written back to the store by
+ * btkn_cache_flush(), or when the entry is evicted.
+ *
+ * A lookup hits only if the types of the given token are a subset of the
+ * cached types. Otherwise, the token goes to the store so that the store can
+ * merge the new types, and the cache entry is refreshed with the result.
+ *
+ * \note A ::btkn_cache is not thread-safe. It is meant to be owned by a single
+ *       worker thread (e.g. one per balerd input worker).
+ */
+#ifndef __BTKN_CACHE_H
+#define __BTKN_CACHE_H
+
+#include <sys/queue.h>
+
+#include "btypes.h"
+#include "bstore.h"
+
+typedef struct btkn_cache_entry {
+	LIST_ENTRY(btkn_cache_entry) hash_link; /* hash bucket link */
+	TAILQ_ENTRY(btkn_cache_entry) lru_link; /* LRU list link */
+	uint32_t hash; /* cached hash value of the text */
+	btkn_id_t tkn_id;
+	btkn_type_mask_t tkn_type_mask;
+	uint64_t tkn_count; /* occurrences not yet written to the store */
+	struct bstr text; /* must be the last member */
+} *btkn_cache_entry_t;
+
+LIST_HEAD(btkn_cache_bucket, btkn_cache_entry);
+TAILQ_HEAD(btkn_cache_lru, btkn_cache_entry);
+
+typedef struct btkn_cache {
+	bstore_t bs; /* the backing store */
+	size_t max_entries; /* maximum number of cached tokens */
+	size_t count; /* current number of cached tokens */
+	size_t hash_size; /* number of hash buckets */
+	struct btkn_cache_bucket *hash_table;
+	struct btkn_cache_lru lru; /* most recently used first */
+
+	/* statistics */
+	uint64_t hit;
+	uint64_t miss;
+	uint64_t evict;
+	uint64_t flush;
+} *btkn_cache_t;
+
+/**
+ * Create a token cache in front of the store \c bs.
+ *
+ * \param bs The store handle.
+ * \param max_entries The maximum number of tokens held by the cache.
+ *
+ * \retval cache The cache handle, if success.
+ * \retval NULL  If failed, \c errno is also set.
+ */
+btkn_cache_t btkn_cache_new(bstore_t bs, size_t max_entries);
+
+/**
+ * Free the cache.
+ *
+ * \note Pending token counts are NOT written to the store. Call
+ *       btkn_cache_flush() before freeing the cache to keep them.
+ */
+void btkn_cache_free(btkn_cache_t c);
+
+/**
+ * Cached version of bstore_tkn_add().
+ *
+ * On success, \c tkn->tkn_id and \c tkn->tkn_type_mask are updated the same
+ * way bstore_tkn_add() updates them. On a cache hit, \c tkn->tkn_count (or 1
+ * if it is 0) is accumulated in the cache rather than written to the store.
+ *
+ * \param c The cache handle.
+ * \param tkn The token.
+ *
+ * \retval tkn_id The ID of the token, if success.
+ * \retval 0      If failed, \c errno is also set.
+ */
+btkn_id_t btkn_cache_tkn_add(btkn_cache_t c, btkn_t tkn);
+
+/**
+ * Write the accumulated token counts back to the store.
+ *
+ * The type masks of the flushed entries are also refreshed from the store,
+ * so that the types learned by other writers eventually show up in the cache.
+ *
+ * \retval 0     If success.
+ * \retval errno If some of the entries could not be flushed. The remaining
+ *               counts are kept in the cache for the next flush.
+ */
+int btkn_cache_flush(btkn_cache_t c);
+
+/**\}*/
+#endif
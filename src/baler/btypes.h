@@ -202,6 +202,14 @@ typedef struct btkn {
 	btkn_type_mask_t tkn_type_mask;
 	uint64_t tkn_count;
 	struct bstr *tkn_str;
+	/*
+	 * The text of a slice token (see barena_btkn_slice()), which has no
+	 * tkn_str: tkn_len bytes of the input line at tkn_text, not
+	 * null-terminated. Use btkn_text() and btkn_len() for the text of a
+	 * token from a parser.
+	 */
+	const char *tkn_text;
+	uint32_t tkn_len;
 	void *call_0;
 	void *call_1;
 	LIST_ENTRY(btkn) entry;
@@ -383,6 +391,22 @@ static btkn_type_t btkn_first_type(btkn_t tkn) {
 	return ffsl(tkn->tkn_type_mask);
 }
 
+/**
+ * The text of the token, which is not null-terminated for a slice token.
+ */
+static inline const char *btkn_text(btkn_t tkn)
+{
+	return tkn->tkn_str ? tkn->tkn_str->cstr : tkn->tkn_text;
+}
+
+/**
+ * The length of the text of the token.
+ */
+static inline uint32_t btkn_len(btkn_t tkn)
+{
+	return tkn->tkn_str ? tkn->tkn_str->blen : tkn->tkn_len;
+}
+
 LIST_HEAD(btkn_list_head, btkn);
 static btkn_t
 btkn_alloc(btkn_id_t tkn_id, btkn_type_mask_t mask, const char *str, size_t len) {
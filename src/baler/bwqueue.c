@@ -48,26 +48,137 @@
  * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
+#include <limits.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <time.h>
 #include "bwqueue.h"
 
-void bwq_init(struct bwq *q, size_t qsize)
+/*
+ * The sleeping threads wake up periodically to act on pthread_cancel(), as the
+ * futex syscall is not a cancellation point.
+ */
+static const struct timespec bwq_wait_timeout = { .tv_nsec = 100000000 };
+
+static inline void __bwq_pause(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#else
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+#endif
+}
+
+static void __bwq_sleep(uint32_t *event, uint32_t val)
+{
+	syscall(SYS_futex, event, FUTEX_WAIT_PRIVATE, val, &bwq_wait_timeout,
+		NULL, 0);
+	pthread_testcancel();
+}
+
+void __bwq_wake(uint32_t *event, int n)
+{
+	syscall(SYS_futex, event, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+}
+
+/*
+ * Spin, then sleep. The event is read and the waiter is registered before
+ * the last retry, so a wakeup between the retry and the sleep is not lost:
+ * either the retry succeeds, or the event has changed and FUTEX_WAIT returns
+ * immediately.
+ */
+void __bwq_nq_wait(struct bwq *q, struct bwq_entry *ent)
 {
-	TAILQ_INIT(&q->head);
-	pthread_mutex_init(&q->qmutex, NULL);
-	sem_init(&q->nq_sem, 0, qsize);
-	sem_init(&q->dq_sem, 0, 0);
+	uint32_t ev;
+	int i;
+	for (i = 0; i < BWQ_SPIN_COUNT; i++) {
+		if (0 == bwq_try_nq(q, ent))
+			return;
+		__bwq_pause();
+	}
+	for (;;) {
+		ev = __atomic_load_n(&q->nq_event, __ATOMIC_SEQ_CST);
+		__atomic_add_fetch(&q->nq_waiters, 1, __ATOMIC_SEQ_CST);
+		if (0 == bwq_try_nq(q, ent)) {
+			__atomic_sub_fetch(&q->nq_waiters, 1, __ATOMIC_SEQ_CST);
+			return;
+		}
+		__bwq_sleep(&q->nq_event, ev);
+		__atomic_sub_fetch(&q->nq_waiters, 1, __ATOMIC_SEQ_CST);
+	}
+}
+
+struct bwq_entry *__bwq_dq_wait(struct bwq *q)
+{
+	struct bwq_entry *ent;
+	uint32_t ev;
+	int i;
+	for (i = 0; i < BWQ_SPIN_COUNT; i++) {
+		ent = bwq_try_dq(q);
+		if (ent)
+			return ent;
+		__bwq_pause();
+	}
+	for (;;) {
+		ev = __atomic_load_n(&q->dq_event, __ATOMIC_SEQ_CST);
+		__atomic_add_fetch(&q->dq_waiters, 1, __ATOMIC_SEQ_CST);
+		ent = bwq_try_dq(q);
+		if (ent) {
+			__atomic_sub_fetch(&q->dq_waiters, 1, __ATOMIC_SEQ_CST);
+			return ent;
+		}
+		__bwq_sleep(&q->dq_event, ev);
+		__atomic_sub_fetch(&q->dq_waiters, 1, __ATOMIC_SEQ_CST);
+	}
+}
+
+int bwq_init(struct bwq *q, size_t qsize)
+{
+	size_t sz = 1;
+	uint64_t i;
+	while (sz < qsize)
+		sz <<= 1;
+	q->slots = calloc(sz, sizeof(*q->slots));
+	if (!q->slots)
+		return ENOMEM;
+	for (i = 0; i < sz; i++)
+		q->slots[i].seq = i;
+	q->mask = sz - 1;
+	q->nq_event = q->dq_event = 0;
+	q->nq_waiters = q->dq_waiters = 0;
+	q->head = q->tail = 0;
+	return 0;
 }
 
 struct bwq* bwq_alloc()
 {
-	struct bwq *q = (struct bwq*) malloc(sizeof(*q));
+	struct bwq *q;
+	/* head and tail are aligned to the cache line */
+	if (posix_memalign((void**)&q, 64, sizeof(*q)))
+		return NULL;
 	return q;
 }
 
 struct bwq* bwq_alloci(size_t qsize)
 {
 	struct bwq *q = bwq_alloc();
-	if (q)
-		bwq_init(q, qsize);
+	if (q && bwq_init(q, qsize)) {
+		free(q);
+		q = NULL;
+	}
 	return q;
 }
+
+void bwq_fini(struct bwq *q)
+{
+	free(q->slots);
+	q->slots = NULL;
+	q->mask = 0;
+}
+
+void bwq_free(struct bwq *q)
+{
+	bwq_fini(q);
+	free(q);
+}
@@ -64,9 +64,12 @@
 #include "bcommon.h"
 #include "btypes.h"
 #include "butils.h"
+#include "barena.h"
+#include "bstats.h"
 #include <sys/queue.h>
 #include <pthread.h>
-#include <semaphore.h>
+#include <errno.h>
+#include <stddef.h>
 
 /**
  * Baler Input Queue entry data.
@@ -87,6 +90,55 @@ typedef struct binq_data {
 	struct btkn_tailq_head tkn_q;
 } *binq_data_t;
 
+/**
+ * Reference-counted ::bmsg.
+ *
+ * A parsed message is allocated once and shared by the output queue entries
+ * of all output plugins. The message must not be modified once it is queued.
+ */
+struct boutq_msg {
+	int ref; /**< Reference count. */
+	struct bmsg msg; /**< The message, must be the last member. */
+};
+
+#define BOUTQ_MSG(msg_p) \
+	((struct boutq_msg *)((char *)(msg_p) - offsetof(struct boutq_msg, msg)))
+
+/**
+ * Allocate a shared message with \c argc arguments and one reference.
+ */
+static inline
+bmsg_t boutq_msg_alloc(uint32_t argc)
+{
+	struct boutq_msg *m = malloc(sizeof(*m) + argc * sizeof(btkn_id_t));
+	if (!m)
+		return NULL;
+	m->ref = 1;
+	return &m->msg;
+}
+
+/**
+ * Take a reference on the shared message \c msg.
+ */
+static inline
+void boutq_msg_get(bmsg_t msg)
+{
+	struct boutq_msg *m = BOUTQ_MSG(msg);
+	__atomic_add_fetch(&m->ref, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * Drop a reference on the shared message \c msg, freeing it with the last
+ * reference.
+ */
+static inline
+void boutq_msg_put(bmsg_t msg)
+{
+	struct boutq_msg *m = BOUTQ_MSG(msg);
+	if (0 == __atomic_sub_fetch(&m->ref, 1, __ATOMIC_ACQ_REL))
+		free(m);
+}
+
 /**
  * Baler Output Queue entry data.
  *
@@ -97,7 +149,12 @@ struct boutq_data {
 	struct boutplugin *plugin;
 	uint32_t comp_id; /**< Component ID (extracted from hostname). */
 	struct timeval tv; /**< Time value. */
-	struct bmsg *msg; /**< Parsed message, which also includes pattern in it. */
+	/**
+	 * Parsed message, which also includes pattern in it. The message is
+	 * a ::boutq_msg shared with the other output plugins, so it is
+	 * read-only.
+	 */
+	struct bmsg *msg;
 };
 
 /**
@@ -116,6 +173,12 @@ typedef struct bwq_entry {
 		struct boutq_data out;
 	} data;
 	void *ctxt;
+	/**
+	 * The arena that holds the entry and all of its data (see ::barena),
+	 * or NULL if they are allocated individually with malloc().
+	 */
+	struct barena *arena;
+	uint64_t nq_ts; /**< Enqueue time (bstats_ts()), for the statistics */
 	TAILQ_ENTRY(bwq_entry) link; /**< Link to next/prev entry. */
 } *bwq_entry_t;
 
@@ -126,6 +189,11 @@ typedef struct bwq_entry {
 static
 void binq_entry_free(struct bwq_entry *ent)
 {
+	if (ent->arena) {
+		/* the entry itself is in the arena too */
+		barena_put(ent->arena);
+		return;
+	}
 	bstr_list_free_entries(&ent->data.in.tokens);
 	btkn_tailq_free_entries(&ent->data.in.tkn_q);
 	if (ent->data.in.hostname)
@@ -140,60 +208,243 @@ void binq_entry_free(struct bwq_entry *ent)
 static
 void boutq_entry_free(struct bwq_entry *ent)
 {
-	bmsg_free(ent->data.out.msg);
+	boutq_msg_put(ent->data.out.msg);
 	free(ent);
 }
 
 /**
- * Baler Work Queue. A thread-safe queue data structure.
+ * A slot of the ::bwq ring.
+ *
+ * \c seq tells the state of the slot for the position \c pos that maps to the
+ * slot: \c seq == \c pos means the slot is free for the producer of \c pos,
+ * and \c seq == \c pos + 1 means the slot holds the entry for the consumer of
+ * \c pos.
+ */
+struct bwq_slot {
+	uint64_t seq;
+	struct bwq_entry *ent;
+};
+
+/**
+ * Baler Work Queue. A thread-safe bounded queue.
+ *
+ * The queue is a bounded multi-producer/multi-consumer ring of preallocated
+ * slots (see ::bwq_slot). The producers and the consumers claim positions with
+ * a compare-and-swap on \c tail and \c head respectively, so there is no lock
+ * on the enqueue/dequeue path. A thread that finds the queue full (or empty)
+ * spins for a while, then sleeps on a futex until a consumer (or a producer)
+ * makes progress.
  */
 struct bwq {
-	struct bwq_head head; /**< Queue head */
-	pthread_mutex_t qmutex; /**< Queue mutex */
-	sem_t nq_sem; /**< Semaphore for enqueueing */
-	sem_t dq_sem; /**< Semaphore for dequeueing */
+	struct bwq_slot *slots; /**< The ring (the size is a power of 2) */
+	uint64_t mask; /**< Ring size - 1 */
+	uint32_t nq_event; /**< Futex word, bumped when slots are freed */
+	uint32_t dq_event; /**< Futex word, bumped when entries are added */
+	uint32_t nq_waiters; /**< Number of producers sleeping on nq_event */
+	uint32_t dq_waiters; /**< Number of consumers sleeping on dq_event */
+	/* head and tail are on their own cache lines */
+	uint64_t tail __attribute__((aligned(64))); /**< Next enqueue position */
+	uint64_t head __attribute__((aligned(64))); /**< Next dequeue position */
 };
 
+/**
+ * Number of retries before a blocked producer/consumer goes to sleep.
+ */
+#define BWQ_SPIN_COUNT 128
+
+/* Slow paths and futex helpers, see bwqueue.c */
+void __bwq_nq_wait(struct bwq *q, struct bwq_entry *ent);
+struct bwq_entry *__bwq_dq_wait(struct bwq *q);
+void __bwq_wake(uint32_t *event, int n);
+
+static inline
+void __bwq_signal(uint32_t *event, uint32_t *waiters, int n)
+{
+	__atomic_add_fetch(event, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(waiters, __ATOMIC_SEQ_CST))
+		__bwq_wake(event, n);
+}
+
+/**
+ * Non-blocking enqueue.
+ * \retval 0 If success.
+ * \retval EAGAIN If the queue is full.
+ */
+static inline
+int bwq_try_nq(struct bwq *q, struct bwq_entry *ent)
+{
+	struct bwq_slot *slot;
+	uint64_t pos, seq;
+	int64_t dif;
+
+	pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+	for (;;) {
+		slot = &q->slots[pos & q->mask];
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		dif = (int64_t)(seq - pos);
+		if (dif == 0) {
+			if (__atomic_compare_exchange_n(&q->tail, &pos, pos + 1,
+					1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+			/* pos is reloaded by the failed CAS */
+		} else if (dif < 0) {
+			return EAGAIN;
+		} else {
+			pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+		}
+	}
+	slot->ent = ent;
+	__atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+	__bwq_signal(&q->dq_event, &q->dq_waiters, 1);
+	return 0;
+}
+
+/**
+ * Non-blocking dequeue of up to \a max entries.
+ *
+ * The entries are claimed with a single compare-and-swap on the head.
+ * \a max must be at least 1.
+ *
+ * \return The number of entries dequeued, 0 if the queue is empty.
+ */
+static inline
+int bwq_try_dq_batch(struct bwq *q, struct bwq_entry **ents, int max)
+{
+	struct bwq_slot *slot;
+	uint64_t pos, seq;
+	int64_t dif;
+	int i, n;
+
+	pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+	for (;;) {
+		slot = &q->slots[pos & q->mask];
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		dif = (int64_t)(seq - (pos + 1));
+		if (dif < 0)
+			return 0; /* empty */
+		if (dif > 0) {
+			/* another consumer took pos */
+			pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+			continue;
+		}
+		/* count the consecutive ready slots */
+		for (n = 1; n < max; n++) {
+			slot = &q->slots[(pos + n) & q->mask];
+			seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+			if (seq != pos + n + 1)
+				break;
+		}
+		if (__atomic_compare_exchange_n(&q->head, &pos, pos + n,
+				1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			break;
+	}
+	for (i = 0; i < n; i++) {
+		slot = &q->slots[(pos + i) & q->mask];
+		ents[i] = slot->ent;
+		__atomic_store_n(&slot->seq, pos + i + q->mask + 1,
+				 __ATOMIC_RELEASE);
+	}
+	__bwq_signal(&q->nq_event, &q->nq_waiters, n);
+	return n;
+}
+
+/**
+ * Non-blocking dequeue.
+ * \return NULL if \a q is empty.
+ * \return A pointer to ::bwq_entry if \a q is not empty.
+ */
+static inline
+struct bwq_entry *bwq_try_dq(struct bwq *q)
+{
+	struct bwq_entry *ent;
+	if (bwq_try_dq_batch(q, &ent, 1))
+		return ent;
+	return NULL;
+}
+
+/**
+ * The approximate number of entries in \c q.
+ */
+static inline
+uint64_t bwq_depth(struct bwq *q)
+{
+	uint64_t head = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+	uint64_t tail = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+	return tail > head ? tail - head : 0;
+}
+
+/**
+ * The capacity of \c q.
+ */
+static inline
+uint64_t bwq_size(struct bwq *q)
+{
+	return q->mask + 1;
+}
+
 /**
  * Thread-safe enqueue function for ::bwq structure.
+ *
+ * The call blocks if the queue is full.
+ *
  * \param q The queue.
  * \param ent A queue entry to be inserted into \a q.
  */
 static inline
 void bwq_nq(struct bwq *q, struct bwq_entry *ent)
 {
-	sem_wait(&q->nq_sem);
-	pthread_mutex_lock(&q->qmutex);
-	TAILQ_INSERT_TAIL(&q->head, ent, link);
-	pthread_mutex_unlock(&q->qmutex);
-	sem_post(&q->dq_sem);
+	if (0 == bwq_try_nq(q, ent))
+		return;
+	__bwq_nq_wait(q, ent);
 }
 
 /**
  * Dequeue the given \a q.
  * \note The first entry is removed from the queue (as the name suggests).
- * \return NULL if \a q is empty.
- * \return A pointer to ::bwq_entry if \a q is not empty.
+ *       The call blocks if the queue is empty.
+ * \return A pointer to ::bwq_entry.
  */
 static inline
 struct bwq_entry* bwq_dq(struct bwq *q)
 {
-	struct bwq_entry *ent;
-	sem_wait(&q->dq_sem);
-	pthread_mutex_lock(&q->qmutex);
-	ent = TAILQ_FIRST(&q->head);
-	TAILQ_REMOVE(&q->head, ent, link);
-	pthread_mutex_unlock(&q->qmutex);
-	sem_post(&q->nq_sem);
-	return ent;
+	struct bwq_entry *ent = bwq_try_dq(q);
+	if (ent)
+		return ent;
+	return __bwq_dq_wait(q);
+}
+
+/**
+ * Dequeue up to \a max entries from \a q at once.
+ *
+ * The call blocks until at least one entry is available, then takes the
+ * entries that are already in the queue without waiting for more.
+ *
+ * \param q The queue.
+ * \param[out] ents The array receiving the entries.
+ * \param max The maximum number of entries to dequeue (the size of \a ents).
+ *
+ * \return The number of entries dequeued (at least 1).
+ */
+static inline
+int bwq_dq_batch(struct bwq *q, struct bwq_entry **ents, int max)
+{
+	int n = bwq_try_dq_batch(q, ents, max);
+	if (n)
+		return n;
+	ents[0] = __bwq_dq_wait(q);
+	if (max == 1)
+		return 1;
+	return 1 + bwq_try_dq_batch(q, ents + 1, max - 1);
 }
 
 /**
  * Initialization of ::bwq.
  * \param q The ::bwq to be initialized.
- * \param qsize The queue size.
+ * \param qsize The queue size. It is rounded up to a power of 2.
+ * \retval 0 If success.
+ * \retval ENOMEM If the ring cannot be allocated.
  */
-void bwq_init(struct bwq *q, size_t qsize);
+int bwq_init(struct bwq *q, size_t qsize);
 
 /**
  * Convenient allocation function WITHOUT structure initialization.
@@ -212,5 +463,18 @@ struct bwq* bwq_alloc(void);
  */
 struct bwq* bwq_alloci(size_t qsize);
 
+/**
+ * Release the ring of \c q initialized by bwq_init(). The entries still in
+ * the queue are not freed, and no thread may be using \c q.
+ * \param q The ::bwq.
+ */
+void bwq_fini(struct bwq *q);
+
+/**
+ * bwq_fini() and free a ::bwq allocated by bwq_alloci().
+ * \param q The ::bwq.
+ */
+void bwq_free(struct bwq *q);
+
 #endif /* __BWQUEUE_H */
 /**\}*/
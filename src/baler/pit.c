@@ -114,16 +114,17 @@ int main(int argc, char **argv)
 				else
 					type_str = NULL;
 				if (type_str)
-					printf("    %-8s : '%s'\n",
+					printf("    %-8s : '%.*s'\n",
 					       type_str,
-					       e->tkn->tkn_str->cstr);
+					       (int)btkn_len(e->tkn),
+					       btkn_text(e->tkn));
 				else
-					printf("    %-8lu : '%s'\n", t,
-					       e->tkn->tkn_str->cstr);
+					printf("    %-8lu : '%.*s'\n", t,
+					       (int)btkn_len(e->tkn),
+					       btkn_text(e->tkn));
 			}
 		}
-		btkn_tailq_free_entries(&(wqe->data.in.tkn_q));
-		free(wqe);
+		binq_entry_free(wqe);
 	}
 	free(buffer);
 	parser->release(parser);
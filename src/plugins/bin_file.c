@@ -0,0 +1,1032 @@
+/* -*- c-basic-offset: 8 -*-
+ * Copyright (c) 2026 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2026 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * \file bin_file.c
+ * \brief Baler input plugin for bulk import of log files.
+ */
+
+/**
+ * \page bin_file Baler Input Plugin for Log Files
+ *
+ * \section synopsis SYNOPSIS
+ * <tt>
+ * <b>plugin name=bin_file</b> <b>path=</b>FILE[,FILE...] <b>parser=</b>PARSER
+ *     [<b>threads=</b>NUMBER] [<b>chunk_size=</b>BYTES]
+ *     [<b>max_msg_len=</b>LEN] [<b>sort=</b>0|1] [<b>sort_window=</b>NUMBER]
+ *     [<b>progress=</b>SEC] [<b>hostname=</b>NAME]
+ * </tt>
+ *
+ * \section description DESCRIPTION
+ * \b bin_file is a baler input plugin for the bulk import of historical log
+ * files. Each file is processed once, in the given order. A file is split
+ * into chunks of about \c chunk_size bytes, aligned on the line boundaries,
+ * and the chunks are parsed in parallel by \c threads threads, each with its
+ * own \c PARSER instance. The parsed messages are passed to baler daemon
+ * accordingly.
+ *
+ * Regular files are read through mmap(), and the chunks are parsed in place.
+ * gzip files (detected by their magic number) are decompressed with zlib if
+ * the plugin is built with it. Other files (e.g. FIFOs) are read as a stream.
+ *
+ * The progress of the import (bytes read, messages and messages/second) is
+ * logged at INFO level while the files are processed, and once more when all
+ * of the files are done.
+ *
+ * \section options OPTIONS
+ *
+ * \par path=FILE[,FILE...]
+ * The comma-separated list of files to import.
+ *
+ * \par parser=PARSER
+ * Specify the parser plugin to process the files. The following is the
+ * currently available parsers:
+ *   - \b syslog -- for parsing syslog files
+ *   - \b craylog -- for parsing syslog files from cray machine
+ *
+ * \par threads=NUMBER (default: 1)
+ * The number of parse threads.
+ *
+ * \par chunk_size=BYTES (default: 4194304)
+ * The approximate size of the chunk of a file given to a parse thread at
+ * once.
+ *
+ * \par max_msg_len=LEN (default: 0)
+ * Specify the maximum byte length of a message. 0 for unlimited.
+ *
+ * \par sort=0|1 (default: 0)
+ * Sort the messages by time, \c sort_window messages of a chunk at a time,
+ * before passing them to baler daemon, so that the store inserts its
+ * time-ordered indices mostly in order. This is useful for the files that are
+ * not in time order, e.g. the concatenation of the logs of several hosts.
+ *
+ * \par sort_window=NUMBER (default: 1024)
+ * The number of messages that a parse thread holds to sort them with
+ * \b sort=1. Each held message keeps its own memory arena (at least 8 KiB),
+ * so the sort costs about 8 KiB x \c sort_window per parse thread (8 MiB by
+ * default). The messages are only sorted within a window.
+ *
+ * \par progress=SEC (default: 10)
+ * The interval of the progress reports, 0 to only report at the end.
+ *
+ * \par hostname=NAME (default: localhost)
+ * The hostname of the messages in which the parser finds no hostname.
+ *
+ * \par OTHER OPTIONS
+ * All options are also passed to the parsers, e.g. <b>lexer=fast</b> for
+ * \b syslog_parser.
+ */
+
+/**
+ * \defgroup bin_file_dev Log file input plugin
+ * \{
+ */
+#include "baler/binput.h"
+#include "baler/butils.h"
+#include "baler/bparse_pool.h"
+#include <limits.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include <unistd.h>
+#include <assert.h>
+
+#define FILE_DEFAULT_CHUNK_SIZE (4 * 1024 * 1024)
+#define FILE_DEFAULT_PROGRESS 10
+#define FILE_DEFAULT_SORT_WINDOW 1024
+
+/**
+ * The size of the line buffer of a parse thread (it grows for the lines that
+ * do not fit).
+ */
+#define FILE_SCRATCH_SIZE (64 * 1024)
+
+typedef enum {
+	PSTATUS_STOPPED=0,
+	PSTATUS_RUNNING
+} plugin_status_t;
+
+/**
+ * A newline-aligned chunk of a file.
+ */
+struct file_chunk {
+	struct bwq_entry ent; /**< For the chunk queue, must be the first member */
+	const char *buf;
+	size_t len;
+	/** The chunk buffer is malloc()ed (stream), not in a mapped file */
+	int own;
+};
+
+/**
+ * A parse thread.
+ */
+struct file_worker {
+	struct bplugin *plugin; /**< Plugin instance. */
+	pthread_t thread;
+	binp_parser_t parser;
+	/** The lines of the current batch, packed as ::bstr */
+	char *scratch;
+	size_t scratch_sz;
+	/** The parsed entries to be sorted, for sort=1 */
+	struct bwq_entry **ents;
+	size_t ents_n;
+};
+
+/**
+ * This structure stores context of this input plugin.
+ */
+struct plugin_ctxt {
+	ssize_t max_msg_len;
+	binp_parser_t parser;
+	binp_get_parser_fn_t get_parser;
+	void *parser_lib;
+	char **paths; /**< The files to import, NULL terminated */
+	char *hostname; /**< The hostname fallback */
+	size_t chunk_size;
+	int sort;
+	size_t sort_window; /**< The entries sorted at once (sort=1) */
+	int progress; /**< Progress report interval (seconds) */
+	int threads; /**< The number of parse threads */
+	struct file_worker *workers;
+	binp_parser_t *parsers; /**< Of the workers, parsers[0] is parser */
+	struct bwq q; /**< The chunk queue */
+	pthread_t reader; /**< The thread reading the files */
+	/* The file being read, released by plugin_stop() */
+	int fd;
+	void *map;
+	size_t map_len;
+#ifdef HAVE_ZLIB
+	gzFile gz;
+#endif
+	/* The chunks posted to the queue and not yet parsed */
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int pending;
+	/* Progress */
+	uint64_t total_bytes; /**< The sizes of all of the files */
+	uint64_t bytes; /**< The bytes of the files already read */
+	uint64_t cur; /**< The offset in the file being read */
+	uint64_t msgs; /**< The messages passed to baler daemon */
+	struct timespec start_ts, report_ts;
+	int status;
+};
+
+static double ts_diff(struct timespec *a, struct timespec *b)
+{
+	return (b->tv_sec - a->tv_sec) + (b->tv_nsec - a->tv_nsec) / 1e9;
+}
+
+/**
+ * Log the progress of the import, if it is time to (or if \c done).
+ */
+static void file_report(struct plugin_ctxt *ctxt, int done)
+{
+	struct timespec now;
+	uint64_t msgs, bytes;
+	double dt;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (!done && (!ctxt->progress ||
+		      ts_diff(&ctxt->report_ts, &now) < ctxt->progress))
+		return;
+	ctxt->report_ts = now;
+	msgs = __atomic_load_n(&ctxt->msgs, __ATOMIC_RELAXED);
+	bytes = ctxt->bytes + ctxt->cur;
+	dt = ts_diff(&ctxt->start_ts, &now);
+	if (dt <= 0)
+		dt = 1e-9;
+	binfo("bin_file: %s %lu/%lu bytes (%.1f%%), %lu messages, "
+	      "%.0f messages/s, %.1f MB/s", done ? "done," : "read",
+	      bytes, ctxt->total_bytes,
+	      ctxt->total_bytes ? 100.0 * bytes / ctxt->total_bytes : 100.0,
+	      msgs, msgs / dt, bytes / dt / 1e6);
+}
+
+static int ent_tv_cmp(const void *a, const void *b)
+{
+	const struct timeval *ta = &(*(struct bwq_entry **)a)->data.in.tv;
+	const struct timeval *tb = &(*(struct bwq_entry **)b)->data.in.tv;
+	if (ta->tv_sec != tb->tv_sec)
+		return ta->tv_sec < tb->tv_sec ? -1 : 1;
+	if (ta->tv_usec != tb->tv_usec)
+		return ta->tv_usec < tb->tv_usec ? -1 : 1;
+	return 0;
+}
+
+/**
+ * Sort the entries held by \c w and post them to ::binq.
+ */
+static void file_ents_flush(struct file_worker *w)
+{
+	size_t i;
+
+	if (!w->ents_n)
+		return;
+	qsort(w->ents, w->ents_n, sizeof(*w->ents), ent_tv_cmp);
+	for (i = 0; i < w->ents_n; i++)
+		binq_post(w->ents[i]);
+	w->ents_n = 0;
+}
+
+/**
+ * Post a parsed entry to ::binq, or hold it to be sorted (sort=1).
+ */
+static void file_ent_done(struct file_worker *w, struct bwq_entry *ent)
+{
+	struct plugin_ctxt *ctxt = w->plugin->context;
+
+	if (!ent->data.in.hostname) {
+		/* binq_entry_free() releases an arena entry with its arena */
+		if (ent->arena)
+			ent->data.in.hostname = barena_bstr_alloc_init_cstr(
+						ent->arena, ctxt->hostname);
+		else
+			ent->data.in.hostname =
+				bstr_alloc_init_cstr(ctxt->hostname);
+	}
+	__atomic_add_fetch(&ctxt->msgs, 1, __ATOMIC_RELAXED);
+	if (!ctxt->sort) {
+		binq_post(ent);
+		return;
+	}
+	/* the window bounds the arenas held by the thread */
+	w->ents[w->ents_n++] = ent;
+	if (w->ents_n == ctxt->sort_window)
+		file_ents_flush(w);
+}
+
+/**
+ * Parse the \c n lines packed in the scratch buffer of \c w.
+ */
+static void file_batch_parse(struct file_worker *w, struct bstr **strs, int n)
+{
+	struct bwq_entry *ents[BPARSE_BATCH_MAX];
+	binp_result_t rcs[BPARSE_BATCH_MAX];
+	uint64_t ts;
+	int i;
+
+	ts = bstats_ts();
+	binp_parse_batch(w->parser, strs, n, ents, rcs);
+	bstats_lat_since(&binp_parse_lat, ts);
+	for (i = 0; i < n; i++) {
+		switch (rcs[i]) {
+		case BINP_OK:
+			file_ent_done(w, ents[i]);
+			break;
+		case BINP_MORE:
+			break;
+		default:
+			berr("Error %d processing log message '%s'\n", rcs[i],
+			     strs[i]->cstr);
+			break;
+		}
+	}
+}
+
+/**
+ * Frame the lines of \c c and parse them in batches. The lines are copied
+ * into the scratch buffer of \c w, as the parsers take a ::bstr.
+ */
+static void file_chunk_parse(struct file_worker *w, struct file_chunk *c)
+{
+	struct plugin_ctxt *ctxt = w->plugin->context;
+	struct bstr *strs[BPARSE_BATCH_MAX];
+	const char *p = c->buf, *end = c->buf + c->len, *eol;
+	size_t len, sz, off = 0;
+	struct bstr *str;
+	char *buf;
+	int n = 0;
+
+	while (p < end) {
+		eol = memchr(p, '\n', end - p);
+		if (!eol)
+			eol = end;
+		len = eol - p;
+		if (ctxt->max_msg_len > 0 && len > ctxt->max_msg_len)
+			len = ctxt->max_msg_len;
+		if (!len)
+			goto next;
+		sz = (sizeof(*str) + len + 1 + 7) & ~7UL;
+		if (n == BPARSE_BATCH_MAX || off + sz > w->scratch_sz) {
+			if (n)
+				file_batch_parse(w, strs, n);
+			n = 0;
+			off = 0;
+		}
+		if (sz > w->scratch_sz) {
+			buf = realloc(w->scratch, sz);
+			if (!buf) {
+				berror("realloc");
+				goto next;
+			}
+			w->scratch = buf;
+			w->scratch_sz = sz;
+		}
+		str = (void *)(w->scratch + off);
+		str->blen = len;
+		memcpy(str->cstr, p, len);
+		str->cstr[len] = '\0';
+		strs[n++] = str;
+		off += sz;
+	next:
+		p = eol + 1;
+	}
+	if (n)
+		file_batch_parse(w, strs, n);
+	file_ents_flush(w);
+}
+
+static void file_chunk_free(void *arg)
+{
+	struct file_chunk *c = arg;
+	if (c->own)
+		free((void *)c->buf);
+	free(c);
+}
+
+static void *file_worker_proc(void *arg)
+{
+	struct file_worker *w = arg;
+	struct plugin_ctxt *ctxt = w->plugin->context;
+	struct file_chunk *c;
+
+	/* Only allow cancellation while waiting for the chunks */
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+	while (1) {
+		pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+		c = (void *)bwq_dq(&ctxt->q);
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+		file_chunk_parse(w, c);
+		file_chunk_free(c);
+		pthread_mutex_lock(&ctxt->mutex);
+		if (0 == --ctxt->pending)
+			pthread_cond_broadcast(&ctxt->cond);
+		pthread_mutex_unlock(&ctxt->mutex);
+	}
+	return NULL;
+}
+
+/**
+ * Post the chunk \c buf of \c len bytes to the parse threads. This blocks if
+ * the chunk queue is full.
+ * \retval 0 on success.
+ * \retval ENOMEM if the chunk cannot be allocated (\c buf is not freed).
+ */
+static int file_chunk_post(struct plugin_ctxt *ctxt, const char *buf,
+			   size_t len, int own)
+{
+	struct file_chunk *c = malloc(sizeof(*c));
+	if (!c)
+		return ENOMEM;
+	c->buf = buf;
+	c->len = len;
+	c->own = own;
+	pthread_mutex_lock(&ctxt->mutex);
+	ctxt->pending++;
+	pthread_mutex_unlock(&ctxt->mutex);
+	pthread_cleanup_push(file_chunk_free, c);
+	pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+	bwq_nq(&ctxt->q, &c->ent);
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+	pthread_cleanup_pop(0);
+	return 0;
+}
+
+static void mutex_unlock(void *arg)
+{
+	pthread_mutex_unlock(arg);
+}
+
+/**
+ * Wait for the parse threads to finish the chunks posted so far.
+ */
+static void file_chunks_wait(struct plugin_ctxt *ctxt)
+{
+	pthread_mutex_lock(&ctxt->mutex);
+	pthread_cleanup_push(mutex_unlock, &ctxt->mutex);
+	pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+	while (ctxt->pending)
+		pthread_cond_wait(&ctxt->cond, &ctxt->mutex);
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+	pthread_cleanup_pop(1);
+}
+
+/**
+ * Import the mapped file \c ctxt->map: the chunks are parsed in place.
+ */
+static int file_map_read(struct plugin_ctxt *ctxt)
+{
+	const char *map = ctxt->map, *eol;
+	size_t size = ctxt->map_len, off = 0, end;
+	int rc = 0;
+
+	/* The advice values are not flags, each one needs its own call */
+	madvise(ctxt->map, size, MADV_SEQUENTIAL);
+	madvise(ctxt->map, size, MADV_WILLNEED);
+	while (off < size) {
+		end = off + ctxt->chunk_size;
+		if (end < size) {
+			eol = memchr(map + end, '\n', size - end);
+			end = eol ? eol - map + 1 : size;
+		} else {
+			end = size;
+		}
+		rc = file_chunk_post(ctxt, map + off, end - off, 0);
+		if (rc)
+			break;
+		off = end;
+		ctxt->cur = off;
+		file_report(ctxt, 0);
+	}
+	/* The chunks refer to the map */
+	file_chunks_wait(ctxt);
+	return rc;
+}
+
+/**
+ * Read up to \c len bytes of the file stream of \c ctxt.
+ */
+static ssize_t file_stream_read(struct plugin_ctxt *ctxt, char *buf,
+				size_t len)
+{
+#ifdef HAVE_ZLIB
+	if (ctxt->gz) {
+		int n = gzread(ctxt->gz, buf, len > INT_MAX ? INT_MAX : len);
+		if (n < 0) {
+			int err;
+			berr("bin_file: gzread: %s\n", gzerror(ctxt->gz, &err));
+			errno = EIO;
+		}
+		return n;
+	}
+#endif
+	return read(ctxt->fd, buf, len);
+}
+
+/**
+ * The offset in the file (compressed) of the stream of \c ctxt, for the
+ * progress report.
+ */
+static uint64_t file_stream_offset(struct plugin_ctxt *ctxt, uint64_t off)
+{
+#ifdef HAVE_ZLIB
+	if (ctxt->gz)
+		return gzoffset(ctxt->gz);
+#endif
+	return off;
+}
+
+/**
+ * Import the file stream of \c ctxt. Each chunk is a malloc()ed buffer ending
+ * on a line boundary; the partial line at the end of the data read is carried
+ * over to the next chunk.
+ */
+static int file_stream_read_all(struct plugin_ctxt *ctxt)
+{
+	char *buf = NULL, *nbuf;
+	const char *eol;
+	size_t sz = 0, len = 0, cut;
+	uint64_t off = 0;
+	ssize_t n;
+	int rc = 0;
+
+	while (1) {
+		if (!buf) {
+			sz = ctxt->chunk_size + len;
+			buf = malloc(sz);
+			if (!buf)
+				return ENOMEM;
+		} else if (len == sz) {
+			/* a line longer than the buffer */
+			nbuf = realloc(buf, 2 * sz);
+			if (!nbuf) {
+				rc = ENOMEM;
+				goto out;
+			}
+			buf = nbuf;
+			sz *= 2;
+		}
+		n = file_stream_read(ctxt, buf + len, sz - len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			rc = errno;
+			goto out;
+		}
+		if (n == 0)
+			break;
+		len += n;
+		off += n;
+		if (len < sz)
+			continue;
+		eol = memrchr(buf, '\n', len);
+		if (!eol)
+			continue;
+		cut = eol - buf + 1;
+		/* carry the partial line over to the next chunk */
+		nbuf = malloc(ctxt->chunk_size + len - cut);
+		if (!nbuf) {
+			rc = ENOMEM;
+			goto out;
+		}
+		memcpy(nbuf, buf + cut, len - cut);
+		rc = file_chunk_post(ctxt, buf, cut, 1);
+		if (rc) {
+			free(nbuf);
+			goto out;
+		}
+		buf = nbuf;
+		len -= cut;
+		sz = ctxt->chunk_size + len;
+		ctxt->cur = file_stream_offset(ctxt, off);
+		file_report(ctxt, 0);
+	}
+	ctxt->cur = file_stream_offset(ctxt, off);
+	if (len) {
+		rc = file_chunk_post(ctxt, buf, len, 1);
+		if (!rc)
+			buf = NULL;
+	}
+ out:
+	free(buf);
+	return rc;
+}
+
+/**
+ * Close the file being read by \c ctxt.
+ */
+static void file_close(struct plugin_ctxt *ctxt)
+{
+	if (ctxt->map) {
+		munmap(ctxt->map, ctxt->map_len);
+		ctxt->map = NULL;
+	}
+#ifdef HAVE_ZLIB
+	if (ctxt->gz) {
+		gzclose(ctxt->gz); /* also closes fd */
+		ctxt->gz = NULL;
+		ctxt->fd = -1;
+	}
+#endif
+	if (ctxt->fd >= 0) {
+		close(ctxt->fd);
+		ctxt->fd = -1;
+	}
+}
+
+/**
+ * Import the file \c path.
+ * \retval 0 on success.
+ * \retval errno on error.
+ */
+static int file_import(struct plugin_ctxt *ctxt, const char *path)
+{
+	unsigned char magic[2];
+	struct stat st = {0};
+	int rc;
+
+	ctxt->fd = open(path, O_RDONLY);
+	if (ctxt->fd < 0)
+		return errno;
+	rc = fstat(ctxt->fd, &st);
+	if (rc) {
+		rc = errno;
+		goto out;
+	}
+	if (S_ISREG(st.st_mode) && pread(ctxt->fd, magic, 2, 0) == 2 &&
+	    magic[0] == 0x1f && magic[1] == 0x8b) {
+#ifdef HAVE_ZLIB
+		ctxt->gz = gzdopen(ctxt->fd, "r");
+		if (!ctxt->gz) {
+			rc = ENOMEM;
+			goto out;
+		}
+		gzbuffer(ctxt->gz, 1024 * 1024);
+		rc = file_stream_read_all(ctxt);
+#else
+		berr("bin_file: %s: gzip input needs zlib\n", path);
+		rc = ENOTSUP;
+#endif
+		goto out;
+	}
+	if (S_ISREG(st.st_mode) && st.st_size) {
+		ctxt->map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+				 ctxt->fd, 0);
+		if (ctxt->map != MAP_FAILED) {
+			ctxt->map_len = st.st_size;
+			rc = file_map_read(ctxt);
+			goto out;
+		}
+		ctxt->map = NULL;
+	}
+	rc = file_stream_read_all(ctxt);
+ out:
+	/* The stream chunks are owned by the parse threads */
+	file_close(ctxt);
+	ctxt->bytes += S_ISREG(st.st_mode) ? st.st_size : ctxt->cur;
+	ctxt->cur = 0;
+	return rc;
+}
+
+static void *file_reader_proc(void *arg)
+{
+	struct plugin_ctxt *ctxt = arg;
+	char **path;
+	int rc;
+
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &ctxt->start_ts);
+	ctxt->report_ts = ctxt->start_ts;
+	for (path = ctxt->paths; *path; path++) {
+		binfo("bin_file: importing %s", *path);
+		rc = file_import(ctxt, *path);
+		if (rc) {
+			errno = rc;
+			berr("bin_file: %s: %m\n", *path);
+		}
+	}
+	file_chunks_wait(ctxt);
+	file_report(ctxt, 1);
+	return NULL;
+}
+
+/**
+ * Split the comma-separated \c s into the NULL-terminated ::plugin_ctxt::paths
+ * and sum up the sizes of the files.
+ */
+static int file_paths_set(struct plugin_ctxt *ctxt, const char *s)
+{
+	char *str, *tok, *save;
+	struct stat st;
+	int n = 1;
+	const char *c;
+
+	for (c = s; *c; c++)
+		if (*c == ',')
+			n++;
+	ctxt->paths = calloc(n + 1, sizeof(*ctxt->paths));
+	str = strdup(s);
+	if (!ctxt->paths || !str) {
+		free(str);
+		return ENOMEM;
+	}
+	n = 0;
+	for (tok = strtok_r(str, ",", &save); tok;
+	     tok = strtok_r(NULL, ",", &save)) {
+		ctxt->paths[n] = strdup(tok);
+		if (!ctxt->paths[n]) {
+			free(str);
+			return ENOMEM;
+		}
+		if (0 == stat(tok, &st) && S_ISREG(st.st_mode))
+			ctxt->total_bytes += st.st_size;
+		n++;
+	}
+	free(str);
+	return 0;
+}
+
+/**
+ * Create the parse threads contexts of \c this, each with its own parser.
+ */
+static
+int file_workers_new(struct bplugin *this, struct bpair_str_head *arg_head)
+{
+	struct plugin_ctxt *ctxt = this->context;
+	struct file_worker *w;
+	int i;
+
+	ctxt->workers = calloc(ctxt->threads, sizeof(*ctxt->workers));
+	if (!ctxt->workers)
+		return ENOMEM;
+	ctxt->parsers = bparse_parsers_new(ctxt->threads, ctxt->parser,
+					   ctxt->get_parser, ctxt->parser_lib,
+					   arg_head);
+	if (!ctxt->parsers)
+		return errno;
+	for (i = 0; i < ctxt->threads; i++) {
+		w = &ctxt->workers[i];
+		w->plugin = this;
+		w->parser = ctxt->parsers[i];
+	}
+	return 0;
+}
+
+/**
+ * This is called from the main daemon (through ::bplugin::config) to configure
+ * the plugin before the main daemon calls ::plugin_start()
+ * (through ::bplugin::start).
+ * \param this The plugin.
+ * \param arg_head The head of the list of arguments.
+ * \return 0 on success.
+ * \return errno on error.
+ */
+static
+int plugin_config(struct bplugin *this, struct bpair_str_head *arg_head)
+{
+	binp_get_parser_fn_t get_parser;
+	void *lib;
+	char libname[PATH_MAX];
+	struct bpair_str *bpstr;
+	struct plugin_ctxt *ctxt = this->context;
+	int rc;
+
+	bpstr = bpair_str_search(arg_head, "path", NULL);
+	if (!bpstr) {
+		berr("bin_file: path is required\n");
+		return EINVAL;
+	}
+	rc = file_paths_set(ctxt, bpstr->s1);
+	if (rc)
+		return rc;
+
+	bpstr = bpair_str_search(arg_head, "max_msg_len", NULL);
+	if (bpstr)
+		ctxt->max_msg_len = atoi(bpstr->s1);
+
+	bpstr = bpair_str_search(arg_head, "chunk_size", NULL);
+	if (bpstr) {
+		ctxt->chunk_size = strtoul(bpstr->s1, NULL, 0);
+		if (!ctxt->chunk_size) {
+			berr("bin_file: invalid chunk_size=%s\n", bpstr->s1);
+			return EINVAL;
+		}
+	}
+
+	bpstr = bpair_str_search(arg_head, "sort", NULL);
+	if (bpstr)
+		ctxt->sort = atoi(bpstr->s1);
+
+	bpstr = bpair_str_search(arg_head, "sort_window", NULL);
+	if (bpstr) {
+		ctxt->sort_window = strtoul(bpstr->s1, NULL, 0);
+		if (!ctxt->sort_window) {
+			berr("bin_file: invalid sort_window=%s\n", bpstr->s1);
+			return EINVAL;
+		}
+	}
+
+	bpstr = bpair_str_search(arg_head, "progress", NULL);
+	if (bpstr)
+		ctxt->progress = atoi(bpstr->s1);
+
+	bpstr = bpair_str_search(arg_head, "hostname", NULL);
+	ctxt->hostname = strdup(bpstr ? bpstr->s1 : "localhost");
+	if (!ctxt->hostname)
+		return ENOMEM;
+
+	bpstr = bpair_str_search(arg_head, "threads", NULL);
+	if (bpstr) {
+		ctxt->threads = atoi(bpstr->s1);
+		if (ctxt->threads < 1) {
+			berr("bin_file: invalid threads=%s\n", bpstr->s1);
+			return EINVAL;
+		}
+	}
+
+	bpstr = bpair_str_search(arg_head, "parser", NULL);
+	if (!bpstr) {
+		berr("bin_file: parser is required\n");
+		return EINVAL;
+	}
+	sprintf(libname, "lib%s.so", bpstr->s1);
+	lib = dlopen(libname, RTLD_NOW);
+	if (!lib) {
+		char *msg = dlerror();
+		if (msg)
+			berr("dlopen: '%s'\n", msg);
+		return ENOENT;
+	}
+	get_parser = dlsym(lib, "binp_get_parser");
+	if (!get_parser) {
+		berr("The library '%s' does not implement a Baler parser.\n",
+		     libname);
+		return EINVAL;
+	}
+	ctxt->parser = get_parser(lib);
+	if (!ctxt->parser) {
+		berr("Insufficient resources available to load '%s'.\n",
+		     libname);
+		return ENOMEM;
+	}
+	ctxt->get_parser = get_parser;
+	ctxt->parser_lib = lib;
+
+	if (ctxt->parser->config) {
+		rc = ctxt->parser->config(ctxt->parser, arg_head);
+		if (rc)
+			return rc;
+	}
+	return file_workers_new(this, arg_head);
+}
+
+/**
+ * This will be called from the main baler daemon to start the plugin
+ * (through ::bplugin::start).
+ * \param this The plugin instance.
+ * \return 0 on success.
+ * \return errno on error.
+ */
+static
+int plugin_start(struct bplugin *this)
+{
+	struct plugin_ctxt *ctxt = this->context;
+	struct file_worker *w;
+	int i, rc;
+	if (!ctxt->workers)
+		return EINVAL; /* not configured */
+	for (i = 0; i < ctxt->threads; i++) {
+		w = &ctxt->workers[i];
+		w->scratch = malloc(FILE_SCRATCH_SIZE);
+		if (!w->scratch)
+			return ENOMEM;
+		w->scratch_sz = FILE_SCRATCH_SIZE;
+		if (ctxt->sort && !w->ents) {
+			w->ents = malloc(ctxt->sort_window * sizeof(*w->ents));
+			if (!w->ents)
+				return ENOMEM;
+		}
+	}
+	/* Two chunks per thread in the queue */
+	rc = bwq_init(&ctxt->q, 2 * ctxt->threads);
+	if (rc)
+		return rc;
+	for (i = 0; i < ctxt->threads; i++) {
+		w = &ctxt->workers[i];
+		rc = pthread_create(&w->thread, NULL, file_worker_proc, w);
+		if (rc)
+			goto err;
+	}
+	rc = pthread_create(&ctxt->reader, NULL, file_reader_proc, ctxt);
+	if (rc)
+		goto err;
+	ctxt->status = PSTATUS_RUNNING;
+	return 0;
+
+ err:
+	while (i--) {
+		pthread_cancel(ctxt->workers[i].thread);
+		pthread_join(ctxt->workers[i].thread, NULL);
+	}
+	bwq_fini(&ctxt->q);
+	return rc;
+}
+
+/**
+ * Calling this will stop the execution of \a this plugin. The import stops
+ * where it is.
+ * \param this The plugin to be stopped.
+ * \return 0 on success.
+ * \return errno on error.
+ */
+static
+int plugin_stop(struct bplugin *this)
+{
+	struct plugin_ctxt *ctxt = this->context;
+	struct bwq_entry *ent;
+	int i;
+	if (ctxt->status != PSTATUS_RUNNING)
+		return 0;
+	pthread_cancel(ctxt->reader);
+	pthread_join(ctxt->reader, NULL);
+	for (i = 0; i < ctxt->threads; i++) {
+		pthread_cancel(ctxt->workers[i].thread);
+		pthread_join(ctxt->workers[i].thread, NULL);
+	}
+	while ((ent = bwq_try_dq(&ctxt->q)))
+		file_chunk_free(ent);
+	file_close(ctxt);
+	bwq_fini(&ctxt->q);
+	ctxt->status = PSTATUS_STOPPED;
+	return 0;
+}
+
+/**
+ * Free the plugin instance.
+ * \param this The plugin to be freed.
+ * \return 0 on success.
+ * \note Now only returns 0, but the errors will be logged.
+ */
+static
+int plugin_free(struct bplugin *this)
+{
+	struct plugin_ctxt *ctxt = (typeof(ctxt)) this->context;
+	char **path;
+	int i, rc = 0;
+	if (ctxt && ctxt->status == PSTATUS_RUNNING) {
+		rc = plugin_stop(this);
+		if (rc) {
+			errno  = rc;
+			berror("plugin_stop");
+		}
+	}
+	if (ctxt && ctxt->parsers)
+		bparse_parsers_free(ctxt->parsers, ctxt->threads, ctxt->parser);
+	if (ctxt && ctxt->workers) {
+		for (i = 0; i < ctxt->threads; i++) {
+			free(ctxt->workers[i].scratch);
+			free(ctxt->workers[i].ents);
+		}
+		free(ctxt->workers);
+	}
+	if (ctxt && ctxt->paths) {
+		for (path = ctxt->paths; *path; path++)
+			free(*path);
+		free(ctxt->paths);
+	}
+	if (ctxt) {
+		free(ctxt->hostname);
+		pthread_mutex_destroy(&ctxt->mutex);
+		pthread_cond_destroy(&ctxt->cond);
+	}
+	bplugin_free(this);
+	return 0;
+}
+
+struct bplugin* create_plugin_instance()
+{
+	struct plugin_ctxt *ctxt;
+	struct bplugin *p = calloc(1, sizeof(*p));
+	/* bwq keeps head and tail on separate cache lines */
+	if (posix_memalign((void **)&ctxt, 64, sizeof(*ctxt)))
+		ctxt = NULL;
+	if (!p || !ctxt)
+		goto err;
+	memset(ctxt, 0, sizeof(*ctxt));
+	p->name = strdup("bin_file");
+	p->version = strdup("0.1a");
+	p->config = plugin_config;
+	p->start = plugin_start;
+	p->stop = plugin_stop;
+	p->free = plugin_free;
+	ctxt->status = PSTATUS_STOPPED;
+	ctxt->chunk_size = FILE_DEFAULT_CHUNK_SIZE;
+	ctxt->progress = FILE_DEFAULT_PROGRESS;
+	ctxt->sort_window = FILE_DEFAULT_SORT_WINDOW;
+	ctxt->threads = 1;
+	ctxt->fd = -1;
+	pthread_mutex_init(&ctxt->mutex, NULL);
+	pthread_cond_init(&ctxt->cond, NULL);
+	p->context = ctxt;
+	return p;
+ err:
+	if (p) free(p);
+	if (ctxt) free(ctxt);
+	return NULL;
+}
+
+/**\}*/
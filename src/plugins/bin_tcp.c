@@ -62,6 +62,7 @@
  * \section synopsis SYNOPSIS
  * <tt>
  * <b>plugin name=bin_tcp</b> <b>port=</b>PORT <b>parser=</b>PARSER <b>max_msg_len=</b>LEN
+ *     [<b>parse_threads=</b>NUMBER] [<b>threads=</b>NUMBER]
  * </tt>
  *
  * \section description DESCRIPTION
@@ -84,6 +85,21 @@
  *
  * \par max_msg_len=LEN (default: 0)
  * Specify the maximum byte length of a message. 0 for unlimited.
+ *
+ * \par parse_threads=NUMBER (default: 0)
+ * Parse the messages on a pool of \c NUMBER threads, each with its own
+ * parser instance, instead of on the socket I/O thread. The socket I/O thread then only
+ * frames the messages. 0 parses the messages on the socket I/O thread.
+ *
+ * \par threads=NUMBER (default: 1)
+ * Handle the connections on \c NUMBER socket I/O threads. Each thread has its
+ * own event loop and its own listening socket on \c PORT (SO_REUSEPORT), and
+ * the kernel spreads the incoming connections over the threads. Without a
+ * parse thread pool, each thread also has its own parser instance.
+ *
+ * \par OTHER OPTIONS
+ * All options are also passed to the parser (and to each parser of the parse
+ * thread pool), e.g. <b>lexer=fast</b> for \b syslog_parser.
  */
 
 /**
@@ -92,6 +108,7 @@
  */
 #include "baler/binput.h"
 #include "baler/butils.h"
+#include "baler/bparse_pool.h"
 #include <limits.h>
 #include <dlfcn.h>
 #include <pthread.h>
@@ -115,50 +132,67 @@
 
 #define PLUGIN_DEFAULT_PORT 54321u
 
-static struct event_base *io_evbase;
-
 typedef enum {
 	PSTATUS_STOPPED=0,
 	PSTATUS_RUNNING
 } plugin_status_t;
 
+struct conn_ctxt;
+
+/**
+ * An event base with its thread and its listening socket. Each reactor
+ * accepts the connections that the kernel gives to its socket
+ * (SO_REUSEPORT), and handles their I/O.
+ */
+struct tcp_reactor {
+	struct bplugin *plugin; /**< Plugin instance. */
+	pthread_t thread;
+	struct event_base *evbase;
+	struct evconnlistener *listener;
+	binp_parser_t parser; /**< Parser of the I/O thread (no parse pool) */
+	/** The connections of the reactor, only used by its thread */
+	LIST_HEAD(, conn_ctxt) conn_list;
+};
+
 /**
  * This structure stores context of this input plugin.
  */
 struct plugin_ctxt {
-	pthread_t io_thread; /**< Thread handling socket IO. */
-	pthread_t conn_req_thread; /**< Thread handling conn req. */
 	uint16_t port; /**< Port number to listen to. */
 	size_t max_msg_len;
 	binp_parser_t parser;
+	binp_get_parser_fn_t get_parser;
+	void *parser_lib;
+	int parse_threads; /**< Parse pool size, 0 to parse on the I/O thread */
+	bparse_pool_t pool;
+	int threads; /**< The number of reactors */
+	struct tcp_reactor *reactors;
+	binp_parser_t *parsers; /**< Of the reactors, parsers[0] is parser */
 	int status; /**< Status of the plugin. */
 };
 
 /**
  * Context for a bufferevent socket connection.
- * Now only contain plugin, but might have more stuffs
- * later ...
  */
 struct conn_ctxt {
 	struct bplugin *plugin; /**< Plugin instance. */
+	struct tcp_reactor *reactor; /**< The reactor of the connection. */
+	struct bufferevent *bev;
 	int truncate; /* truncate flag */
+	size_t scanned; /* bytes at the head of the input without '\n' */
 	struct sockaddr_in sin;
 	LIST_ENTRY(conn_ctxt) link;
 };
 
-LIST_HEAD(, conn_ctxt) conn_ctxt_list = LIST_HEAD_INITIALIZER();
-pthread_mutex_t conn_ctxt_list_mutex = PTHREAD_MUTEX_INITIALIZER;
-
 static
-struct conn_ctxt *conn_ctxt_alloc(struct bplugin *bplugin,
+struct conn_ctxt *conn_ctxt_alloc(struct tcp_reactor *r,
 				  struct sockaddr_in *sin)
 {
 	struct conn_ctxt *ctxt = calloc(1, sizeof(*ctxt));
 	if (ctxt) {
-		pthread_mutex_lock(&conn_ctxt_list_mutex);
-		LIST_INSERT_HEAD(&conn_ctxt_list, ctxt, link);
-		pthread_mutex_unlock(&conn_ctxt_list_mutex);
-		ctxt->plugin = bplugin;
+		LIST_INSERT_HEAD(&r->conn_list, ctxt, link);
+		ctxt->plugin = r->plugin;
+		ctxt->reactor = r;
 		ctxt->sin = *sin;
 	}
 	return ctxt;
@@ -171,27 +205,80 @@ struct conn_ctxt *conn_ctxt_alloc(struct bplugin *bplugin,
 static
 void conn_ctxt_free(struct conn_ctxt *ctxt)
 {
-	pthread_mutex_lock(&conn_ctxt_list_mutex);
 	LIST_REMOVE(ctxt, link);
-	pthread_mutex_unlock(&conn_ctxt_list_mutex);
 	free(ctxt);
 }
 
-/*
- * If there is no hostname token in the input, use the host that sent us the message
+/**
+ * The number of input buffer chunks framed at once (evbuffer_peek()).
  */
-void add_host(struct bwq_entry *ent, struct sockaddr_storage *ss, ssize_t name_len)
+#define READ_NVEC 16
+
+/**
+ * Copy the \c len bytes at offset \c off of the chunks \c v to \c dst. Only
+ * the messages straddling chunks take more than one memcpy().
+ */
+static
+void chunks_copy(struct evbuffer_iovec *v, size_t off, char *dst, size_t len)
 {
-	char ip_str[128];
-	struct sockaddr_in *sin = (struct sockaddr_in *)ss;
-	assert(name_len == sizeof(*sin));
-	ent->data.in.hostname =
-		bstr_alloc_init_cstr(inet_ntop(sin->sin_family, &sin->sin_addr,
-					       ip_str, sizeof(ip_str)));
+	size_t k;
+	while (off >= v->iov_len) {
+		off -= v->iov_len;
+		v++;
+	}
+	while (len) {
+		k = v->iov_len - off;
+		if (k > len)
+			k = len;
+		memcpy(dst, (char *)v->iov_base + off, k);
+		dst += k;
+		len -= k;
+		off = 0;
+		v++;
+	}
+}
+
+/**
+ * Hand the message of \c len bytes at offset \c off of the chunks \c v over
+ * to the parse pool, or add it to \c lines (\c *n of them) for the parser of
+ * the reactor.
+ */
+static
+void line_add(struct conn_ctxt *cctxt, struct evbuffer_iovec *v, size_t off,
+	      size_t len, struct bparse_line **lines, int *n)
+{
+	struct plugin_ctxt *pctxt = cctxt->plugin->context;
+	struct bparse_line *line;
+
+	/* the parsers expect the terminating '\0' in the message (blen) */
+	line = bparse_line_alloc(len + 1);
+	if (!line) {
+		berror("bparse_line_alloc");
+		return;
+	}
+	chunks_copy(v, off, line->str.cstr, len);
+	line->str.cstr[len] = '\0';
+	line->sin = cctxt->sin;
+	if (pctxt->pool) {
+		bparse_pool_post(pctxt->pool, line);
+		return;
+	}
+	/* Parse the complete lines of the buffer together */
+	lines[(*n)++] = line;
+	if (*n == BPARSE_BATCH_MAX) {
+		bparse_lines_process(cctxt->reactor->parser, lines, *n);
+		*n = 0;
+	}
 }
 
 /**
  * Read callback for bufferevent.
+ *
+ * The messages are framed in place in the chunks of the input buffer
+ * (evbuffer_peek()), and the chunks are drained once all of their messages
+ * are handed over. The bytes after the last '\n' stay in the buffer for the
+ * next call, which only scans the new ones.
+ *
  * \note 1 \a bev per connection.
  * \param bev The bufferevent object.
  * \param arg Pointer to ::conn_ctxt.
@@ -201,83 +288,66 @@ void read_cb(struct bufferevent *bev, void *arg)
 {
 	struct conn_ctxt *cctxt = (struct conn_ctxt *)arg;
 	struct plugin_ctxt *pctxt = cctxt->plugin->context;
-	struct evbuffer_ptr evbptr;
 	struct evbuffer *input = bufferevent_get_input(bev);
-	struct bstr *str;
-	struct bwq_entry *ent;
-	int len, rc;
-	do {
-		/* Look for '\n' in the buffer as it is the end of each message. */
-		evbptr = evbuffer_search(input, "\n", 1, NULL);
-		if (evbptr.pos == -1) {
-			len = evbuffer_get_length(input);
-			if (cctxt->truncate) {
-				/* drop the truncated part */
-				rc = evbuffer_drain(input, len);
-				assert(rc == 0);
+	struct evbuffer_iovec v[READ_NVEC];
+	struct bparse_line *lines[BPARSE_BATCH_MAX];
+	size_t max = pctxt->max_msg_len;
+	size_t off, start, pos, end;
+	char *base, *nl;
+	int i, nv, more, n = 0;
+
+ again:
+	/* With a length, evbuffer_peek() returns the number of chunks needed */
+	nv = evbuffer_peek(input, evbuffer_get_length(input), NULL, v,
+			   READ_NVEC);
+	more = nv > READ_NVEC;
+	if (more)
+		nv = READ_NVEC;
+	/* [start, pos) is the current message, scanned for '\n' so far */
+	start = 0;
+	pos = cctxt->scanned;
+	for (i = 0, off = 0; i < nv; off += v[i].iov_len, i++) {
+		base = v[i].iov_base;
+		while (pos < off + v[i].iov_len) {
+			nl = memchr(base + (pos - off), '\n',
+				    off + v[i].iov_len - pos);
+			if (!nl) {
+				pos = off + v[i].iov_len;
 				break;
 			}
-			if (pctxt->max_msg_len && len > pctxt->max_msg_len) {
+			end = off + (nl - base);
+			if (cctxt->truncate) {
+				/* '\n' of the truncated message is found,
+				 * drop the truncated part */
+				cctxt->truncate = 0;
+			} else if (max && end - start > max) {
 				/* process the good part, and truncate */
-				evbptr.pos = pctxt->max_msg_len;
-				cctxt->truncate = 1;
-				goto process;
+				line_add(cctxt, v, start, max, lines, &n);
+			} else {
+				line_add(cctxt, v, start, end - start, lines,
+					 &n);
 			}
-			/* need more data in the buffer */
-			break;
+			start = pos = end + 1;
 		}
-
-		if (cctxt->truncate) {
-			/*
-			 * '\n' of the truncated message is found, drain the
-			 * truncated part, reset truncation state, and continue
-			 */
-			rc = evbuffer_drain(input, evbptr.pos+1);
-			assert(rc == 0);
-			cctxt->truncate = 0;
-			continue;
-		}
-		if (pctxt->max_msg_len && evbptr.pos > pctxt->max_msg_len) {
+		if (!cctxt->truncate && max && pos - start > max) {
 			/* process the good part, and truncate */
-			evbptr.pos = pctxt->max_msg_len;
+			line_add(cctxt, v, start, max, lines, &n);
 			cctxt->truncate = 1;
-			goto process;
-		}
-
-	process:
-		str = bstr_alloc(evbptr.pos+1);
-		if (!str) {
-			berror("bstr_alloc");
-			break;
 		}
-		str->blen = evbptr.pos+1;
-		len = evbuffer_remove(input, str->cstr, str->blen);
-		if (len != str->blen) {
-			berr("Expecting %d bytes, but only %d bytes were present.",
-			     str->blen, len);
-		}
-		/* Eliminate the '\n' and terminate the string */
-		str->cstr[str->blen-1] = 0;
-		rc = pctxt->parser->parse(pctxt->parser, str, &ent);
-		switch (rc) {
-		case BINP_OK:
-			if (!ent->data.in.hostname)
-				/* Parser didn't set the hostname, use
-				 * the address from the socket */
-				add_host(ent,
-					 (struct sockaddr_storage *)&cctxt->sin,
-					 sizeof(cctxt->sin));
-			binq_post(ent);
-			break;
-		case BINP_MORE:
-			/* Need more input to complete message */
-			break;
-		default:
-			berr("Error %d processing log message '%s'\n", rc, str->cstr);
-			break;
-		}
-		bstr_free(str);
-	} while (1);
+		if (cctxt->truncate)
+			start = pos; /* drop the truncated part */
+	}
+	if (start) {
+		evbuffer_drain(input, start);
+	} else if (more) {
+		/* A message straddles more than READ_NVEC chunks */
+		evbuffer_pullup(input, pos);
+	}
+	cctxt->scanned = pos - start;
+	if (more)
+		goto again;
+	if (n)
+		bparse_lines_process(cctxt->reactor->parser, lines, n);
 }
 
 /**
@@ -315,32 +385,33 @@ void event_cb(struct bufferevent *bev, short events, void *arg)
 /**
  * Connect callback. This function will be called when there is a connection
  * request coming in. This is a call back function for
- * evconnlistener_new_bind().
+ * evconnlistener_new(), called on the thread of the reactor.
  * \param listener Listener
  * \param sock Socket file descriptor
  * \param addr Socket address ( sockaddr_in )
  * \param len Length of \a addr
- * \param arg Pointer to plugin instance.
+ * \param arg Pointer to the ::tcp_reactor of the listener.
  */
 static
-void conn_cb(struct event_base *evbase, int sock,
+void conn_cb(struct evconnlistener *listener, evutil_socket_t sock,
 		struct sockaddr *addr, int len, void *arg)
 {
+	struct tcp_reactor *r = arg;
 	struct bufferevent *bev = NULL;
 	struct conn_ctxt *cctxt = NULL;
 
-	evutil_make_socket_nonblocking(sock);
-	bev = bufferevent_socket_new(evbase, sock, BEV_OPT_CLOSE_ON_FREE);
+	bev = bufferevent_socket_new(r->evbase, sock, BEV_OPT_CLOSE_ON_FREE);
 	if (!bev) {
 		berr("conn_cb(): bufferevent_socket_new() error, errno: %d",
 			errno);
 		goto cleanup;
 	}
-	cctxt = conn_ctxt_alloc(arg, (void*)addr);
+	cctxt = conn_ctxt_alloc(r, (void*)addr);
 	if (!cctxt) {
 		berr("conn_cb(): malloc() error, errno: %d", errno);
+		goto cleanup;
 	}
-	cctxt->plugin = arg;
+	cctxt->bev = bev;
 	cctxt->truncate = 0;
 	bufferevent_setcb(bev, read_cb, NULL, event_cb, cctxt);
 	bufferevent_enable(bev, EV_READ);
@@ -363,111 +434,115 @@ void conn_cb(struct event_base *evbase, int sock,
 cleanup:
 	if (bev)
 		bufferevent_free(bev); /* this will also close sock */
-	if (cctxt)
-		conn_ctxt_free(cctxt);
-	if (!bev)
+	else
 		close(sock);
 	return;
 }
 
 /**
- * This is a pthread routine function for listening for connections from
- *  over TCP. pthread_create() function in ::plugin_start() will call
- * this function.
- * \param arg A pointer to the ::bplugin of this thread.
- * \retval (abuse)0 if there is no error.
- * \retval (abuse)errno if there are some error.
- * \note This is a thread routine.
+ * Open the listening socket of a reactor. With more than one reactor, all of
+ * the sockets are bound to the same port with SO_REUSEPORT, and the kernel
+ * spreads the incoming connections over them.
+ * \retval sd The socket.
+ * \retval -1 on error, \c errno is also set.
  */
 static
-void* _tcp_listen(void *arg)
+int _tcp_listen_sock(struct plugin_ctxt *ctxt)
 {
-	int64_t rc = 0;
-	struct bplugin *p = arg;
-	struct plugin_ctxt *ctxt = p->context;
 	struct sockaddr_in addr = {
 		.sin_family = AF_INET,
 		.sin_addr = { .s_addr = INADDR_ANY },
 		.sin_port = htons(ctxt->port)
 	};
-	struct sockaddr_in peer_addr;
-	socklen_t peer_addr_len = sizeof(peer_addr);
-	int peer_sd;
+	int on = 1;
+	int rc;
 	int sd = socket(AF_INET, SOCK_STREAM, 0);
-	if (sd < 0) {
-		rc = errno;
-		goto out;
+	if (sd < 0)
+		return -1;
+	if (ctxt->threads > 1) {
+		rc = setsockopt(sd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+		if (rc)
+			goto err;
 	}
 	rc = bind(sd, (void*)&addr, sizeof(addr));
-	if (rc) {
-		rc = errno;
-		goto out;
-	}
-
-	rc = listen(sd, 8192);
-	if (rc) {
-		rc = errno;
-		goto out;
-	}
-
-	while (0 <= (peer_sd = accept(sd, (void*)&peer_addr, &peer_addr_len))) {
-		conn_cb(io_evbase, peer_sd, (void*)&peer_addr, peer_addr_len, p);
-		peer_addr_len = sizeof(peer_addr); /* set for next accept() */
-	}
-
-	berr("_tcp_listen(): accept() error, errno: %d", errno);
+	if (rc)
+		goto err;
+	rc = evutil_make_socket_nonblocking(sd);
+	if (rc)
+		goto err;
+	return sd;
+err:
 	rc = errno;
-
-out:
-	return (void*)rc;
+	close(sd);
+	errno = rc;
+	return -1;
 }
 
-void _dummy_cb(int fd, short what, void *arg)
+/**
+ * The thread routine of a reactor: handle the connection requests and the
+ * socket I/O of the connections of the reactor until ::plugin_stop().
+ */
+static
+void* _tcp_io_ev_proc(void *arg)
 {
-	/* This should not be called */
-	assert(0);
+	struct tcp_reactor *r = arg;
+	int rc;
+	rc = event_base_dispatch(r->evbase);
+	if (rc)
+		berr("_tcp_io_ev_proc() thread exit, rc: %d", rc);
+	return NULL;
 }
 
+/**
+ * Free the event base of \c r, with its listener and its connections.
+ */
 static
-void* _tcp_io_ev_proc(void *arg)
+void tcp_reactor_close(struct tcp_reactor *r)
 {
-	int rc = 0;
-	struct event *dummy;
-	io_evbase = event_base_new();
-	struct bplugin *this = arg;
-	struct plugin_ctxt *ctxt = this->context;
-	if (!io_evbase) {
-		rc = ENOMEM;
-		goto err0;
+	struct conn_ctxt *cctxt;
+	if (r->listener) {
+		evconnlistener_free(r->listener);
+		r->listener = NULL;
 	}
-
-	/* dummy event to prevent the termination of event_base_dispatch() */
-	dummy = event_new(io_evbase, -1, EV_READ, _dummy_cb, io_evbase);
-	if (!dummy) {
-		rc = ENOMEM;
-		goto err1;
+	while ((cctxt = LIST_FIRST(&r->conn_list))) {
+		bufferevent_free(cctxt->bev);
+		conn_ctxt_free(cctxt);
 	}
-	rc = event_add(dummy, NULL);
-	if (rc) {
-		goto err1;
+	if (r->evbase) {
+		event_base_free(r->evbase);
+		r->evbase = NULL;
 	}
+}
 
-	/* Dedicated thread for socket accept() */
-	rc = pthread_create(&ctxt->conn_req_thread, NULL, _tcp_listen, this);
-	if (rc)
-		goto err2;
-
-	/* evbase will handle accepted socket IO */
-	event_base_dispatch(io_evbase);
-
-	/* clean up */
-err2:
-	event_free(dummy);
-err1:
-	event_base_free(io_evbase);
-err0:
-	berr("_tcp_ev_proc() thread exit, rc: %d", rc);
-	return NULL; /* return code abuse */
+/**
+ * Create the reactors of \c this, each with its own parser if the messages
+ * are parsed on the I/O threads.
+ */
+static
+int tcp_reactors_new(struct bplugin *this, struct bpair_str_head *arg_head)
+{
+	struct plugin_ctxt *ctxt = this->context;
+	struct tcp_reactor *r;
+	int i;
+
+	ctxt->reactors = calloc(ctxt->threads, sizeof(*ctxt->reactors));
+	if (!ctxt->reactors)
+		return ENOMEM;
+	if (!ctxt->pool) {
+		ctxt->parsers = bparse_parsers_new(ctxt->threads, ctxt->parser,
+						   ctxt->get_parser,
+						   ctxt->parser_lib, arg_head);
+		if (!ctxt->parsers)
+			return errno;
+	}
+	for (i = 0; i < ctxt->threads; i++) {
+		r = &ctxt->reactors[i];
+		r->plugin = this;
+		LIST_INIT(&r->conn_list);
+		if (ctxt->parsers)
+			r->parser = ctxt->parsers[i];
+	}
+	return 0;
 }
 
 /**
@@ -525,7 +600,40 @@ int plugin_config(struct bplugin *this, struct bpair_str_head *arg_head)
 			rc = ENOMEM;
 			goto out;
 		}
+		ctxt->get_parser = get_parser;
+		ctxt->parser_lib = lib;
+	}
+
+	if (ctxt->parser && ctxt->parser->config) {
+		rc = ctxt->parser->config(ctxt->parser, arg_head);
+		if (rc)
+			goto out;
+	}
+
+	bpstr = bpair_str_search(arg_head, "parse_threads", NULL);
+	if (bpstr)
+		ctxt->parse_threads = atoi(bpstr->s1);
+	if (ctxt->parse_threads > 0 && ctxt->get_parser && !ctxt->pool) {
+		ctxt->pool = bparse_pool_new(ctxt->parse_threads,
+					     ctxt->get_parser, ctxt->parser_lib,
+					     arg_head);
+		if (!ctxt->pool) {
+			rc = errno;
+			goto out;
+		}
 	}
+
+	bpstr = bpair_str_search(arg_head, "threads", NULL);
+	if (bpstr) {
+		ctxt->threads = atoi(bpstr->s1);
+		if (ctxt->threads < 1) {
+			berr("bin_tcp: invalid threads=%s\n", bpstr->s1);
+			rc = EINVAL;
+			goto out;
+		}
+	}
+	if (ctxt->get_parser && !ctxt->reactors)
+		rc = tcp_reactors_new(this, arg_head);
 out:
 	return rc;
 }
@@ -541,10 +649,57 @@ static
 int plugin_start(struct bplugin *this)
 {
 	struct plugin_ctxt *ctxt = this->context;
-	int rc = pthread_create(&ctxt->io_thread, NULL, _tcp_io_ev_proc, this);
-	if (rc)
-		return rc;
+	struct tcp_reactor *r;
+	int i, sd, rc;
+	if (!ctxt->reactors)
+		return EINVAL; /* no parser */
+	if (ctxt->pool) {
+		/* the parse threads get the cpus= affinity of start() */
+		rc = bparse_pool_start(ctxt->pool);
+		if (rc)
+			return rc;
+	}
+	for (i = 0; i < ctxt->threads; i++) {
+		r = &ctxt->reactors[i];
+		r->evbase = event_base_new();
+		if (!r->evbase) {
+			rc = ENOMEM;
+			goto err;
+		}
+		sd = _tcp_listen_sock(ctxt);
+		if (sd < 0) {
+			rc = errno;
+			goto err;
+		}
+		r->listener = evconnlistener_new(r->evbase, conn_cb, r,
+						 LEV_OPT_CLOSE_ON_FREE, 8192, sd);
+		if (!r->listener) {
+			rc = errno ? errno : ENOMEM;
+			close(sd);
+			goto err;
+		}
+	}
+	for (i = 0; i < ctxt->threads; i++) {
+		r = &ctxt->reactors[i];
+		rc = pthread_create(&r->thread, NULL, _tcp_io_ev_proc, r);
+		if (rc)
+			goto err_thr;
+	}
+	ctxt->status = PSTATUS_RUNNING;
 	return 0;
+
+err_thr:
+	while (i--) {
+		r = &ctxt->reactors[i];
+		event_base_loopbreak(r->evbase);
+		pthread_join(r->thread, NULL);
+	}
+err:
+	for (i = 0; i < ctxt->threads; i++)
+		tcp_reactor_close(&ctxt->reactors[i]);
+	if (ctxt->pool)
+		bparse_pool_stop(ctxt->pool);
+	return rc;
 }
 
 /**
@@ -557,10 +712,19 @@ static
 int plugin_stop(struct bplugin *this)
 {
 	struct plugin_ctxt *ctxt = this->context;
-	pthread_cancel(ctxt->conn_req_thread);
-	pthread_cancel(ctxt->io_thread);
-	pthread_join(ctxt->conn_req_thread, NULL);
-	pthread_join(ctxt->io_thread, NULL);
+	struct tcp_reactor *r;
+	int i;
+	for (i = 0; ctxt->status == PSTATUS_RUNNING && i < ctxt->threads; i++) {
+		r = &ctxt->reactors[i];
+		event_base_loopbreak(r->evbase);
+		pthread_join(r->thread, NULL);
+		tcp_reactor_close(r);
+	}
+	ctxt->status = PSTATUS_STOPPED;
+	if (ctxt->pool) {
+		bparse_pool_free(ctxt->pool);
+		ctxt->pool = NULL;
+	}
 	return 0;
 }
 
@@ -584,6 +748,10 @@ int plugin_free(struct bplugin *this)
 			berror("plugin_stop");
 		}
 	}
+	if (ctxt && ctxt->parsers)
+		bparse_parsers_free(ctxt->parsers, ctxt->threads, ctxt->parser);
+	if (ctxt)
+		free(ctxt->reactors);
 	bplugin_free(this);
 	return 0;
 }
@@ -630,6 +798,7 @@ struct bplugin* create_plugin_instance()
 	ctxt->status = PSTATUS_STOPPED;
 	ctxt->port = PLUGIN_DEFAULT_PORT;
 	ctxt->max_msg_len = 0;
+	ctxt->threads = 1;
 	p->context = ctxt;
 	return p;
 }
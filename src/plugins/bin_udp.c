@@ -59,6 +59,8 @@
  * \section synopsis SYNOPSIS
  * <tt>
  * <b>plugin name=bin_udp</b> <b>port=</b>PORT <b>parser=</b>PARSER <b>max_msg_len=</b>LEN
+ *     [<b>parse_threads=</b>NUMBER] [<b>threads=</b>NUMBER]
+ *     [<b>rcvbuf=</b>BYTES]
  * </tt>
  *
  * \section description DESCRIPTION
@@ -81,6 +83,28 @@
  *
  * \par max_msg_len=LEN (default: 0)
  * Specify the maximum byte length of a message. 0 for unlimited.
+ *
+ * \par parse_threads=NUMBER (default: 0)
+ * Parse the messages on a pool of \c NUMBER threads, each with its own
+ * parser instance, instead of on the socket I/O thread. The socket I/O thread then only
+ * frames the messages. 0 parses the messages on the socket I/O thread.
+ *
+ * \par threads=NUMBER (default: 1)
+ * Receive the datagrams on \c NUMBER threads. Each thread has its own socket
+ * bound to \c PORT (SO_REUSEPORT), and the kernel spreads the datagrams over
+ * the sockets. Without a parse thread pool, each thread also has its own
+ * parser instance. The threads receive up to 64 datagrams per system call
+ * (recvmmsg()).
+ *
+ * \par rcvbuf=BYTES (default: 0)
+ * Set the receive buffer size (SO_RCVBUF) of the sockets. A large buffer
+ * absorbs the bursts that otherwise overflow the socket (RcvbufErrors in
+ * /proc/net/snmp). Without CAP_NET_ADMIN, the size is capped by
+ * net.core.rmem_max. 0 keeps the system default.
+ *
+ * \par OTHER OPTIONS
+ * All options are also passed to the parser (and to each parser of the parse
+ * thread pool), e.g. <b>lexer=fast</b> for \b syslog_parser.
  */
 
 /**
@@ -89,12 +113,12 @@
  */
 #include "baler/binput.h"
 #include "baler/butils.h"
+#include "baler/bparse_pool.h"
 #include <limits.h>
 #include <dlfcn.h>
 #include <pthread.h>
 #include <stdint.h>
 #include <fcntl.h>
-#include <sys/epoll.h>
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -108,106 +132,211 @@
 
 #define PLUGIN_DEFAULT_PORT 514u
 
-static struct event_base *io_evbase;
+/**
+ * The number of datagrams received at once (recvmmsg()).
+ */
+#define UDP_RECV_BATCH 64
 
 typedef enum {
 	PSTATUS_STOPPED=0,
 	PSTATUS_RUNNING
 } plugin_status_t;
 
+/**
+ * A receive thread, with its socket.
+ */
+struct udp_rcv {
+	struct bplugin *plugin; /**< Plugin instance. */
+	pthread_t thread;
+	int fd;
+	binp_parser_t parser; /**< Parser of the thread (no parse pool) */
+	/** The receive ring: a line for each datagram of a recvmmsg() */
+	struct bparse_line *ring[UDP_RECV_BATCH];
+};
+
 /**
  * This structure stores context of this input plugin.
  */
 struct plugin_ctxt {
-	pthread_t io_thread;
-	int io_fd;
 	ssize_t max_msg_len;
 	uint16_t port;
 	binp_parser_t parser;
+	binp_get_parser_fn_t get_parser;
+	void *parser_lib;
+	int parse_threads; /**< Parse pool size, 0 to parse on the I/O thread */
+	bparse_pool_t pool;
+	int threads; /**< The number of receive threads */
+	int rcvbuf; /**< SO_RCVBUF of the sockets, 0 for the system default */
+	struct udp_rcv *rcvs;
+	binp_parser_t *parsers; /**< Of the threads, parsers[0] is parser */
 	int status;
 };
 
-/*
- * If there is no hostname token in the input, use the host that sent us the message
+/**
+ * Open the socket of a receive thread. With more than one thread, all of the
+ * sockets are bound to the same port with SO_REUSEPORT, and the kernel
+ * spreads the datagrams over them.
+ * \retval fd The socket.
+ * \retval -1 on error, \c errno is also set.
  */
-void add_host(struct bwq_entry *ent, struct sockaddr_storage *ss, ssize_t name_len)
+static int udp_sock(struct plugin_ctxt *ctxt)
 {
-	char ip_str[128];
-	struct sockaddr_in *sin = (struct sockaddr_in *)ss;
-	assert(name_len == sizeof(*sin));
-	ent->data.in.hostname =
-		bstr_alloc_init_cstr(inet_ntop(sin->sin_family, &sin->sin_addr,
-					       ip_str, sizeof(ip_str)));
+	struct sockaddr_in sin = {
+		.sin_family = AF_INET,
+		.sin_addr = { .s_addr = INADDR_ANY },
+		.sin_port = htons(ctxt->port)
+	};
+	int on = 1;
+	int fd, rc, sz;
+	socklen_t len = sizeof(sz);
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0)
+		return -1;
+	if (ctxt->threads > 1) {
+		rc = setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+		if (rc)
+			goto err;
+	}
+	if (ctxt->rcvbuf) {
+		/* SO_RCVBUFFORCE goes past rmem_max, with CAP_NET_ADMIN */
+		rc = setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &ctxt->rcvbuf,
+				sizeof(ctxt->rcvbuf));
+		if (rc)
+			rc = setsockopt(fd, SOL_SOCKET, SO_RCVBUF,
+					&ctxt->rcvbuf, sizeof(ctxt->rcvbuf));
+		if (rc)
+			goto err;
+		/* The kernel doubles the value for its bookkeeping */
+		rc = getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &sz, &len);
+		if (!rc && sz < ctxt->rcvbuf)
+			bwarn("bin_udp: SO_RCVBUF is %d, less than rcvbuf=%d "
+			      "(see net.core.rmem_max)", sz / 2, ctxt->rcvbuf);
+	}
+	rc = bind(fd, (struct sockaddr *)&sin, sizeof(sin));
+	if (rc)
+		goto err;
+	return fd;
+ err:
+	rc = errno;
+	close(fd);
+	errno = rc;
+	return -1;
 }
 
-#define EVQ_DEPTH	16
 static void* io_proc(void *arg)
 {
-	struct bplugin *this = arg;
-	struct plugin_ctxt *ctxt = this->context;
-	int fd_count, i, rc;
-	struct sockaddr_in sin;
-	struct sockaddr_storage msg_sin;
-	struct epoll_event io_events[EVQ_DEPTH];
+	struct udp_rcv *r = arg;
+	struct plugin_ctxt *ctxt = r->plugin->context;
+	struct mmsghdr msgs[UDP_RECV_BATCH];
+	struct iovec iovs[UDP_RECV_BATCH];
+	struct bparse_line *lines[UDP_RECV_BATCH];
+	struct bparse_line *line;
 	ssize_t msg_len;
-	struct msghdr msg;
-	struct iovec iov;
-	unsigned char *msg_buf;
-	bstr_t str;
-	struct bwq_entry *ent;
-
-	ctxt->io_fd = socket(AF_INET, SOCK_DGRAM, 0);
-	if (ctxt->io_fd < 0)
-		goto err;
+	int i, k, n;
 
-	sin.sin_addr.s_addr = 0;
-	sin.sin_port = htons(ctxt->port);
-	rc = bind(ctxt->io_fd, (struct sockaddr *)&sin, sizeof(sin));
-	if (rc)
-		goto err;
-
-	msg_buf = malloc(ctxt->max_msg_len);
-	if (!msg_buf)
-		goto err;
-	iov.iov_base = msg_buf;
+	for (i = 0; i < UDP_RECV_BATCH; i++) {
+		iovs[i].iov_base = r->ring[i]->str.cstr;
+		iovs[i].iov_len = ctxt->max_msg_len;
+	}
+	/* Only allow cancellation while waiting for the datagrams */
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
 	while (1) {
-		msg_sin.ss_family = AF_UNIX;
-		msg.msg_name = &msg_sin;
-		msg.msg_namelen = sizeof(msg_sin);
-		iov.iov_len = ctxt->max_msg_len;
-		msg.msg_iov = &iov;
-		msg.msg_iovlen = 1;
-		msg.msg_control = NULL;
-		msg.msg_controllen = 0;
-		msg.msg_flags = 0;
-		msg_len = recvmsg(ctxt->io_fd, &msg, 0);
-		str = bstr_alloc(msg_len+1);
-		str->blen = msg_len;
-		memcpy(str->cstr, msg_buf, msg_len);
-		str->cstr[msg_len-1] = '\0';
-		rc = ctxt->parser->parse(ctxt->parser, str, &ent);
-		switch (rc) {
-		case BINP_OK:
-			if (!ent->data.in.hostname)
-				/* Parser didn't set the hostname, use
-				 * the address from the socket */
-				add_host(ent, &msg_sin, msg.msg_namelen);
-			binq_post(ent);
-			break;
-		case BINP_MORE:
-			/* Need more input to complete message */
-			break;
-		default:
-			berr("Error %d processing log message '%s'\n", rc, str->cstr);
-			break;
+		for (i = 0; i < UDP_RECV_BATCH; i++) {
+			memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+			msgs[i].msg_hdr.msg_name = &r->ring[i]->sin;
+			msgs[i].msg_hdr.msg_namelen = sizeof(r->ring[i]->sin);
+			msgs[i].msg_hdr.msg_iov = &iovs[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+		pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+		n = recvmmsg(r->fd, msgs, UDP_RECV_BATCH, MSG_WAITFORONE,
+			     NULL);
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+		if (n <= 0) {
+			if (n < 0 && errno != EINTR) {
+				berror("recvmmsg");
+				break;
+			}
+			continue;
 		}
-		bstr_free(str);
+		k = 0;
+		for (i = 0; i < n; i++) {
+			line = r->ring[i];
+			msg_len = msgs[i].msg_len;
+			if (msg_len <= 0)
+				continue;
+			line->str.blen = msg_len;
+			line->str.cstr[msg_len-1] = '\0';
+			if (!ctxt->pool) {
+				/* Parsed in place, in the ring */
+				lines[k++] = line;
+				continue;
+			}
+			/* The pool owns its lines: copy the datagram */
+			line = bparse_line_alloc(msg_len);
+			if (!line) {
+				berror("bparse_line_alloc");
+				continue;
+			}
+			memcpy(line->str.cstr, r->ring[i]->str.cstr, msg_len);
+			line->sin = r->ring[i]->sin;
+			bparse_pool_post(ctxt->pool, line);
+		}
+		if (k)
+			bparse_lines_parse(r->parser, lines, k);
+	}
+	berr("io_proc() thread exit");
+	return NULL;
+}
+
+/**
+ * Create the receive threads contexts of \c this, each with its own parser if
+ * the messages are parsed on the receive threads.
+ */
+static
+int udp_rcvs_new(struct bplugin *this, struct bpair_str_head *arg_head)
+{
+	struct plugin_ctxt *ctxt = this->context;
+	struct udp_rcv *r;
+	int i;
+
+	ctxt->rcvs = calloc(ctxt->threads, sizeof(*ctxt->rcvs));
+	if (!ctxt->rcvs)
+		return ENOMEM;
+	if (!ctxt->pool) {
+		ctxt->parsers = bparse_parsers_new(ctxt->threads, ctxt->parser,
+						   ctxt->get_parser,
+						   ctxt->parser_lib, arg_head);
+		if (!ctxt->parsers)
+			return errno;
+	}
+	for (i = 0; i < ctxt->threads; i++) {
+		r = &ctxt->rcvs[i];
+		r->plugin = this;
+		r->fd = -1;
+		if (ctxt->parsers)
+			r->parser = ctxt->parsers[i];
+	}
+	return 0;
+}
+
+/**
+ * Close the socket of \c r and free its ring.
+ */
+static
+void udp_rcv_close(struct udp_rcv *r)
+{
+	int i;
+	if (r->fd >= 0) {
+		close(r->fd);
+		r->fd = -1;
+	}
+	for (i = 0; i < UDP_RECV_BATCH; i++) {
+		if (r->ring[i])
+			bparse_line_free(r->ring[i]);
+		r->ring[i] = NULL;
 	}
- err:
-	if (ctxt->io_fd >= 0)
-		close(ctxt->io_fd);
-	berr("io_proc() thread exit, rc: %d", rc);
-	return NULL; /* return code abuse */
 }
 
 /**
@@ -260,7 +389,40 @@ int plugin_config(struct bplugin *this, struct bpair_str_head *arg_head)
 			     libname);
 			rc = ENOMEM;
 		}
+		ctxt->get_parser = get_parser;
+		ctxt->parser_lib = lib;
+	}
+
+	if (ctxt->parser && ctxt->parser->config) {
+		rc = ctxt->parser->config(ctxt->parser, arg_head);
+		if (rc)
+			return rc;
+	}
+
+	bpstr = bpair_str_search(arg_head, "parse_threads", NULL);
+	if (bpstr)
+		ctxt->parse_threads = atoi(bpstr->s1);
+	if (ctxt->parse_threads > 0 && ctxt->get_parser && !ctxt->pool) {
+		ctxt->pool = bparse_pool_new(ctxt->parse_threads,
+					     ctxt->get_parser, ctxt->parser_lib,
+					     arg_head);
+		if (!ctxt->pool)
+			return errno;
+	}
+
+	bpstr = bpair_str_search(arg_head, "threads", NULL);
+	if (bpstr) {
+		ctxt->threads = atoi(bpstr->s1);
+		if (ctxt->threads < 1) {
+			berr("bin_udp: invalid threads=%s\n", bpstr->s1);
+			return EINVAL;
+		}
 	}
+	bpstr = bpair_str_search(arg_head, "rcvbuf", NULL);
+	if (bpstr)
+		ctxt->rcvbuf = atoi(bpstr->s1);
+	if (ctxt->get_parser && !ctxt->rcvs)
+		rc = udp_rcvs_new(this, arg_head);
 	return rc;
 }
 
@@ -275,10 +437,51 @@ static
 int plugin_start(struct bplugin *this)
 {
 	struct plugin_ctxt *ctxt = this->context;
-	int rc = pthread_create(&ctxt->io_thread, NULL, io_proc, this);
-	if (rc)
-		return rc;
+	struct udp_rcv *r;
+	int i, j, rc;
+	if (!ctxt->rcvs)
+		return EINVAL; /* no parser */
+	if (ctxt->pool) {
+		/* the parse threads get the cpus= affinity of start() */
+		rc = bparse_pool_start(ctxt->pool);
+		if (rc)
+			return rc;
+	}
+	for (i = 0; i < ctxt->threads; i++) {
+		r = &ctxt->rcvs[i];
+		for (j = 0; j < UDP_RECV_BATCH; j++) {
+			r->ring[j] = bparse_line_alloc(ctxt->max_msg_len);
+			if (!r->ring[j]) {
+				rc = ENOMEM;
+				goto err;
+			}
+		}
+		r->fd = udp_sock(ctxt);
+		if (r->fd < 0) {
+			rc = errno;
+			goto err;
+		}
+	}
+	for (i = 0; i < ctxt->threads; i++) {
+		r = &ctxt->rcvs[i];
+		rc = pthread_create(&r->thread, NULL, io_proc, r);
+		if (rc)
+			goto err_thr;
+	}
+	ctxt->status = PSTATUS_RUNNING;
 	return 0;
+
+ err_thr:
+	while (i--) {
+		pthread_cancel(ctxt->rcvs[i].thread);
+		pthread_join(ctxt->rcvs[i].thread, NULL);
+	}
+ err:
+	for (i = 0; i < ctxt->threads; i++)
+		udp_rcv_close(&ctxt->rcvs[i]);
+	if (ctxt->pool)
+		bparse_pool_stop(ctxt->pool);
+	return rc;
 }
 
 /**
@@ -291,7 +494,19 @@ static
 int plugin_stop(struct bplugin *this)
 {
 	struct plugin_ctxt *ctxt = this->context;
-	pthread_cancel(ctxt->io_thread);
+	struct udp_rcv *r;
+	int i;
+	for (i = 0; ctxt->status == PSTATUS_RUNNING && i < ctxt->threads; i++) {
+		r = &ctxt->rcvs[i];
+		pthread_cancel(r->thread);
+		pthread_join(r->thread, NULL);
+		udp_rcv_close(r);
+	}
+	ctxt->status = PSTATUS_STOPPED;
+	if (ctxt->pool) {
+		bparse_pool_free(ctxt->pool);
+		ctxt->pool = NULL;
+	}
 	return 0;
 }
 
@@ -314,9 +529,11 @@ int plugin_free(struct bplugin *this)
 			errno  = rc;
 			berror("plugin_stop");
 		}
-		if (ctxt->io_fd >= 0)
-			close(ctxt->io_fd);
 	}
+	if (ctxt && ctxt->parsers)
+		bparse_parsers_free(ctxt->parsers, ctxt->threads, ctxt->parser);
+	if (ctxt)
+		free(ctxt->rcvs);
 	bplugin_free(this);
 	return 0;
 }
@@ -336,8 +553,8 @@ struct bplugin* create_plugin_instance()
 	p->free = plugin_free;
 	ctxt->status = PSTATUS_STOPPED;
 	ctxt->port = PLUGIN_DEFAULT_PORT;
-	ctxt->io_fd = -1;
 	ctxt->max_msg_len = UDP_MAX_MSG_LEN;
+	ctxt->threads = 1;
 	p->context = ctxt;
 	return p;
  err:
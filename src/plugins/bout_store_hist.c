@@ -140,6 +140,88 @@ static int plugin_process_output(struct boutplugin *this, struct boutq_data *oda
 	return rc;
 }
 
+#define HIST_BINS (sizeof(hist_bins) / sizeof(hist_bins[0]))
+
+/*
+ * Collect the histogram updates of the whole batch and submit them at once,
+ * so that the store can combine the updates of the same key (e.g. the same
+ * token in the same minute).
+ */
+static int plugin_process_output_batch(struct boutplugin *this, int n,
+				       struct boutq_data **odata)
+{
+	struct bout_store_hist_plugin *mp = (typeof(mp))this;
+	struct bstore_hist_update_s *ups, *up;
+	struct timeval *tv;
+	bmsg_t msg;
+	size_t max = 0;
+	int i, rc, pos, bin;
+
+	if (!mp->bs)
+		return EINVAL;
+
+	for (i = 0; i < n; i++)
+		max += HIST_BINS * (1 + odata[i]->msg->argc) +
+			odata[i]->msg->argc;
+	ups = malloc(max * sizeof(*ups));
+	if (!ups)
+		return ENOMEM;
+	up = ups;
+	for (i = 0; i < n; i++) {
+		msg = odata[i]->msg;
+		tv = &odata[i]->tv;
+		for (bin = 0; bin < HIST_BINS; bin++) {
+			time_t secs = clamp_time_to_bin(tv->tv_sec,
+							hist_bins[bin]);
+			/* Pattern History */
+			if (mp->ptn_hist) {
+				up->type = BSTORE_HIST_UPDATE_PTN;
+				up->secs = secs;
+				up->bin_width = hist_bins[bin];
+				up->ptn_id = msg->ptn_id;
+				up->comp_id = msg->comp_id;
+				up->tkn_id = 0;
+				up->tkn_pos = 0;
+				up++;
+			}
+			if (!mp->tkn_hist)
+				continue;
+			/* Global Token History */
+			for (pos = 0; pos < msg->argc; pos++) {
+				up->type = BSTORE_HIST_UPDATE_TKN;
+				up->secs = secs;
+				up->bin_width = hist_bins[bin];
+				up->ptn_id = 0;
+				up->comp_id = 0;
+				up->tkn_id = msg->argv[pos] >> 8;
+				up->tkn_pos = 0;
+				up++;
+			}
+		}
+		/* Per-Pattern Token History */
+		if (!mp->ptn_tkn_hist)
+			continue;
+		for (pos = 0; pos < msg->argc; pos++) {
+			if (!btkn_id_is_wildcard(msg->argv[pos] & BTKN_TYPE_ID_MASK))
+				continue;
+			up->type = BSTORE_HIST_UPDATE_PTN_TKN;
+			up->secs = 0;
+			up->bin_width = 0;
+			up->ptn_id = msg->ptn_id;
+			up->comp_id = 0;
+			up->tkn_id = msg->argv[pos] >> 8;
+			up->tkn_pos = pos;
+			up++;
+		}
+	}
+	/* The per-message path ignores the histogram update errors */
+	rc = bstore_hist_update_batch(mp->bs, up - ups, ups);
+	if (rc)
+		bwarn("bout_store_hist: hist_update_batch error: %d", rc);
+	free(ups);
+	return 0;
+}
+
 /* bout_store_hist_plugin:boutplugin:bplugin */
 struct bplugin *create_plugin_instance()
 {
@@ -155,6 +237,7 @@ struct bplugin *create_plugin_instance()
 	p->base.base.free = plugin_free;
 	pthread_mutex_init(&p->lock, NULL);
 	p->base.process_output = plugin_process_output;
+	p->base.process_output_batch = plugin_process_output_batch;
 	return (void*)p;
 }
 
@@ -64,6 +64,32 @@ static int plugin_process_output(struct boutplugin *this, struct boutq_data *oda
 	return bstore_msg_add(mp->bs, &odata->tv, odata->msg);
 }
 
+static int plugin_process_output_batch(struct boutplugin *this, int n,
+				       struct boutq_data **odata)
+{
+	struct bout_store_msg_plugin *mp = (typeof(mp))this;
+	struct timeval *tv;
+	bmsg_t *msgs;
+	int i, rc;
+	if (!mp->bs)
+		return EINVAL;
+	tv = malloc(n * sizeof(*tv));
+	msgs = malloc(n * sizeof(*msgs));
+	if (!tv || !msgs) {
+		rc = ENOMEM;
+		goto out;
+	}
+	for (i = 0; i < n; i++) {
+		tv[i] = odata[i]->tv;
+		msgs[i] = odata[i]->msg;
+	}
+	rc = bstore_msg_add_batch(mp->bs, n, tv, msgs);
+ out:
+	free(tv);
+	free(msgs);
+	return rc;
+}
+
 /* bout_store_msg_plugin:boutplugin:bplugin */
 struct bplugin *create_plugin_instance()
 {
@@ -79,6 +105,7 @@ struct bplugin *create_plugin_instance()
 	p->base.base.free = plugin_free;
 	pthread_mutex_init(&p->lock, NULL);
 	p->base.process_output = plugin_process_output;
+	p->base.process_output_batch = plugin_process_output_batch;
 	return (void*)p;
 }
 
@@ -1088,7 +1088,9 @@ static sos_visit_action_t tkn_add_cb(sos_index_t index,
 		}
 		/* Update the token value */
 		tkn_value = sos_obj_ptr(tkn_obj);
-		tkn_value->tkn_count++;
+		/* tkn_count is the number of occurrences to add (0 means 1) */
+		tkn_value->tkn_count += ctxt->tkn->tkn_count ?
+					ctxt->tkn->tkn_count : 1;
 		tkn_value->tkn_type_mask |= ctxt->tkn->tkn_type_mask;
 		/* Update the memory tkn */
 		ctxt->tkn->tkn_id = tkn_value->tkn_id;
@@ -1178,7 +1180,7 @@ static btkn_id_t bs_tkn_add(bstore_t bs, btkn_t tkn)
 	if (tkn_obj) {
 		/* Update the token value */
 		tkn_value = sos_obj_ptr(tkn_obj);
-		tkn_value->tkn_count++;
+		tkn_value->tkn_count += tkn->tkn_count ? tkn->tkn_count : 1;
 		tkn_value->tkn_type_mask |= tkn->tkn_type_mask;
 		/* Update the memory tkn */
 		tkn->tkn_id = tkn_value->tkn_id;
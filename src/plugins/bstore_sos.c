@@ -5,6 +5,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <time.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <stdlib.h>
@@ -17,6 +18,7 @@
 #include <unistd.h>
 #include "baler/bstore.h"
 #include "baler/butils.h"
+#include "baler/fnv_hash.h"
 
 #ifdef __be64
 #pragma message "WARNING: __be64 is already defined!"
@@ -25,7 +27,9 @@
 #define __be32
 #endif
 
-#define BSTORE_SOS_VER "3.0"
+#define BSTORE_SOS_VER "3.1"
+/* 3.0 stores use the legacy message encoding, they are still supported */
+#define BSTORE_SOS_VER_3_0 "3.0"
 
 #define ATTR_TYPE_MAX 512
 #define ATTR_VALUE_MAX 512
@@ -36,8 +40,6 @@
 
 #define OOM()	berr("Out of memory at %s:%d\n", __func__, __LINE__)
 
-int bstore_lock = 0;
-
 time_t clamp_time_to_bin(time_t time_, uint32_t bin_width)
 {
 	return (time_ / bin_width) * bin_width;
@@ -49,10 +51,77 @@ typedef struct bstore_sos_info_s {
 		struct {
 			char store_ver[64];
 			char gitsha[64];
+			/* MSG_IDX_* of the message indices not kept */
+			uint32_t msg_idx_off;
+			/* MSG_IDX_* of the message indices built in bulk */
+			uint32_t msg_idx_deferred;
+			/* the messages before this epoch_us are in the deferred
+			 * indices, see __msg_idx_scan() */
+			uint64_t msg_idx_mark;
 		};
 	};
 } *bstore_sos_info_t;
 
+/*
+ * Message indices.
+ *
+ * Message.tc_key (time:comp) is the primary message index and is always
+ * kept. The pattern (Message.pt_key) and the component (Message.ct_key)
+ * indices are configured when the store is created with
+ * BSTORE_SOS_MSG_INDICES, a comma-separated list of NAME[:MODE] where NAME is
+ * "pt" or "ct" and MODE is one of:
+ *   - sync:     index the message as it is added (the default),
+ *   - deferred: index the messages in bulk from tc_key by a background
+ *               thread every BSTORE_SOS_IDX_INTERVAL seconds,
+ *   - off:      don't keep the index, the queries by pattern or component
+ *               scan tc_key instead.
+ * The configuration is recorded in INFO. The stores without one (all zero)
+ * keep all of the indices in sync.
+ */
+#define MSG_IDX_TC 0x1
+#define MSG_IDX_PT 0x2
+#define MSG_IDX_CT 0x4
+#define MSG_IDX_SECONDARY (MSG_IDX_PT|MSG_IDX_CT)
+#define MSG_IDX_INTERVAL 10
+
+/*
+ * Read-side pattern cache.
+ *
+ * Materializing a message (__make_msg()) needs the token string of its
+ * pattern to expand the compacted argv. There are only a few thousand
+ * patterns, so their decoded token strings are kept in a per-store LRU cache
+ * keyed by ptn_id rather than looked up and decoded for every message. The
+ * token string of a pattern never changes once the pattern is created; the
+ * mutable pattern statistics (count, first/last seen) are not cached.
+ *
+ * The cache size (in patterns) is BSTORE_SOS_PTN_CACHE from the environment,
+ * 0 disables the cache.
+ */
+#define PTN_CACHE_SIZE 16384
+
+struct ptn_cache_entry {
+	LIST_ENTRY(ptn_cache_entry) hash_link; /* hash bucket link */
+	TAILQ_ENTRY(ptn_cache_entry) lru_link; /* LRU list link */
+	bptn_id_t ptn_id;
+	int ref; /* one for the cache, one for each user */
+	struct bstr str; /* the pattern token string, must be the last member */
+};
+
+LIST_HEAD(ptn_cache_bucket, ptn_cache_entry);
+TAILQ_HEAD(ptn_cache_lru, ptn_cache_entry);
+
+/*
+ * Striped locks.
+ *
+ * The SOS indices are safe for concurrent use and a single-key update through
+ * sos_index_visit() is atomic. What is not is a find-then-add of a token or
+ * an update of the pattern statistics outside of the visit. These take one of
+ * LOCK_STRIPES mutexes selected by the hash of the token text or the encoded
+ * pattern, so the adds of different tokens and patterns proceed in parallel
+ * and only those of the same key are serialized.
+ */
+#define LOCK_STRIPES 64
+
 typedef struct bstore_sos_s {
 	struct bstore_s base;
 	sos_t dict_sos;
@@ -104,15 +173,191 @@ typedef struct bstore_sos_s {
 	btkn_id_t next_host_id;
 	bptn_id_t next_ptn_id;
 
-	pthread_mutex_t dict_lock;
-	pthread_mutex_t msg_lock;
-	pthread_mutex_t ptn_lock;
-	pthread_mutex_t ptn_tkn_lock;
-	pthread_mutex_t hist_lock;
+	/* striped locks, see __lock_stripe() */
+	pthread_mutex_t dict_locks[LOCK_STRIPES]; /* by the token text */
+	pthread_mutex_t ptn_locks[LOCK_STRIPES]; /* by the encoded pattern */
+
+	/* read-side pattern cache */
+	pthread_mutex_t ptn_cache_lock;
+	size_t ptn_cache_max; /* maximum number of cached patterns */
+	size_t ptn_cache_count;
+	size_t ptn_cache_hash_size;
+	struct ptn_cache_bucket *ptn_cache_hash;
+	struct ptn_cache_lru ptn_cache_lru; /* most recently used first */
+
+	int msg_enc; /* the encoding of the new messages, MSG_ENC_* */
+
+	/* time partitions, see __part_roll() */
+	pthread_mutex_t part_lock;
+	time_t part_period; /* 0 for no partitioning */
+	time_t part_retention; /* 0 to keep all of the partitions */
+	time_t msg_part_end; /* end of the period of the primary partition */
+
+	/* message indices, see __msg_index() */
+	uint32_t msg_idx_off; /* MSG_IDX_* not kept */
+	uint32_t msg_idx_sync; /* MSG_IDX_* indexed as the messages are added */
+	uint32_t msg_idx_deferred; /* MSG_IDX_* indexed by __msg_idx_scan() */
+	pthread_rwlock_t msg_idx_rwlock; /* protects msg_idx_limit */
+	pthread_mutex_t msg_idx_scan_lock; /* held by __msg_idx_scan() */
+	uint64_t msg_idx_limit; /* the end (epoch_us) of the last scan */
+	uint64_t msg_epoch_max; /* the latest epoch_us added */
+	time_t msg_idx_interval;
+	int msg_idx_stop;
+	int msg_idx_running;
+	pthread_mutex_t msg_idx_stop_lock;
+	pthread_cond_t msg_idx_stop_cond;
+	pthread_t msg_idx_thread;
 
 	bstore_sos_info_t info;
 } *bstore_sos_t;
 
+static bptn_t bs_ptn_find(bstore_t bs, bptn_id_t ptn_id);
+
+static pthread_mutex_t *__lock_stripe(pthread_mutex_t *locks,
+				      const void *key, size_t len)
+{
+	return &locks[fnv_hash_a1_32(key, len, 0) % LOCK_STRIPES];
+}
+
+static void __lock_stripes_init(pthread_mutex_t *locks)
+{
+	int i;
+	for (i = 0; i < LOCK_STRIPES; i++)
+		pthread_mutex_init(&locks[i], NULL);
+}
+static int __msg_idx_start(bstore_sos_t bss, int flags);
+static void __msg_idx_stop(bstore_sos_t bss);
+
+static void __ptn_cache_init(bstore_sos_t bss)
+{
+	pthread_mutex_init(&bss->ptn_cache_lock, NULL);
+	TAILQ_INIT(&bss->ptn_cache_lru);
+	bss->ptn_cache_max = bgetenv_u64("BSTORE_SOS_PTN_CACHE",
+					 PTN_CACHE_SIZE);
+	if (!bss->ptn_cache_max)
+		return;
+	bss->ptn_cache_hash_size = bss->ptn_cache_max;
+	bss->ptn_cache_hash = calloc(bss->ptn_cache_hash_size,
+				     sizeof(*bss->ptn_cache_hash));
+	if (!bss->ptn_cache_hash)
+		bss->ptn_cache_max = 0; /* work without the cache */
+}
+
+static void __ptn_cache_put(struct ptn_cache_entry *e)
+{
+	if (0 == __atomic_sub_fetch(&e->ref, 1, __ATOMIC_ACQ_REL))
+		free(e);
+}
+
+/* Remove \c e from the cache, the caller holds ptn_cache_lock */
+static void __ptn_cache_remove(bstore_sos_t bss, struct ptn_cache_entry *e)
+{
+	LIST_REMOVE(e, hash_link);
+	TAILQ_REMOVE(&bss->ptn_cache_lru, e, lru_link);
+	bss->ptn_cache_count--;
+	__ptn_cache_put(e);
+}
+
+static struct ptn_cache_entry *
+__ptn_cache_lookup(bstore_sos_t bss, bptn_id_t ptn_id)
+{
+	struct ptn_cache_entry *e;
+	LIST_FOREACH(e, &bss->ptn_cache_hash[ptn_id % bss->ptn_cache_hash_size],
+		     hash_link) {
+		if (e->ptn_id == ptn_id)
+			return e;
+	}
+	return NULL;
+}
+
+/*
+ * Get the token string of the pattern \c ptn_id, from the cache or from the
+ * store. The caller must release the entry with __ptn_cache_put().
+ *
+ * \retval e The cache entry.
+ * \retval NULL If the pattern is not found, or out of memory.
+ */
+static struct ptn_cache_entry *__ptn_cache_get(bstore_sos_t bss,
+					       bptn_id_t ptn_id)
+{
+	struct ptn_cache_entry *e, *old;
+	bptn_t ptn;
+
+	if (bss->ptn_cache_max) {
+		pthread_mutex_lock(&bss->ptn_cache_lock);
+		e = __ptn_cache_lookup(bss, ptn_id);
+		if (e) {
+			TAILQ_REMOVE(&bss->ptn_cache_lru, e, lru_link);
+			TAILQ_INSERT_HEAD(&bss->ptn_cache_lru, e, lru_link);
+			__atomic_add_fetch(&e->ref, 1, __ATOMIC_RELAXED);
+		}
+		pthread_mutex_unlock(&bss->ptn_cache_lock);
+		if (e)
+			return e;
+	}
+
+	ptn = bs_ptn_find(&bss->base, ptn_id);
+	if (!ptn)
+		return NULL;
+	e = malloc(sizeof(*e) + ptn->str->blen);
+	if (!e) {
+		bptn_free(ptn);
+		return NULL;
+	}
+	e->ptn_id = ptn_id;
+	e->ref = 1;
+	e->str.blen = ptn->str->blen;
+	memcpy(e->str.cstr, ptn->str->cstr, ptn->str->blen);
+	bptn_free(ptn);
+	if (!bss->ptn_cache_max)
+		return e;
+
+	pthread_mutex_lock(&bss->ptn_cache_lock);
+	old = __ptn_cache_lookup(bss, ptn_id);
+	if (old) {
+		/* another thread got there first */
+		__atomic_add_fetch(&old->ref, 1, __ATOMIC_RELAXED);
+		pthread_mutex_unlock(&bss->ptn_cache_lock);
+		free(e);
+		return old;
+	}
+	e->ref++;
+	LIST_INSERT_HEAD(&bss->ptn_cache_hash[ptn_id % bss->ptn_cache_hash_size],
+			 e, hash_link);
+	TAILQ_INSERT_HEAD(&bss->ptn_cache_lru, e, lru_link);
+	bss->ptn_cache_count++;
+	if (bss->ptn_cache_count > bss->ptn_cache_max)
+		__ptn_cache_remove(bss, TAILQ_LAST(&bss->ptn_cache_lru,
+						   ptn_cache_lru));
+	pthread_mutex_unlock(&bss->ptn_cache_lock);
+	return e;
+}
+
+/*
+ * Drop the pattern \c ptn_id from the cache. This must be called whenever
+ * the token string of a pattern is removed or replaced in the store.
+ */
+static void __ptn_cache_invalidate(bstore_sos_t bss, bptn_id_t ptn_id)
+{
+	struct ptn_cache_entry *e;
+	if (!bss->ptn_cache_max)
+		return;
+	pthread_mutex_lock(&bss->ptn_cache_lock);
+	e = __ptn_cache_lookup(bss, ptn_id);
+	if (e)
+		__ptn_cache_remove(bss, e);
+	pthread_mutex_unlock(&bss->ptn_cache_lock);
+}
+
+/* Drop all of the cached patterns */
+static void __ptn_cache_clear(bstore_sos_t bss)
+{
+	pthread_mutex_lock(&bss->ptn_cache_lock);
+	while (!TAILQ_EMPTY(&bss->ptn_cache_lru))
+		__ptn_cache_remove(bss, TAILQ_FIRST(&bss->ptn_cache_lru));
+	pthread_mutex_unlock(&bss->ptn_cache_lock);
+}
+
 #define TKN_ID_IDX_ARGS "ORDER=5 SIZE=5"
 struct sos_schema_template token_value_schema = {
 	.name = "TokenValue",
@@ -214,10 +459,23 @@ typedef struct __attribute__ ((__packed__)) msg_s {
 	uint64_t epoch_us;
 	uint64_t ptn_id;
 	uint64_t comp_id;
-	uint64_t tkn_count;
+	uint64_t tkn_count; /* the encoding (MSG_ENC_*) and the argument count */
 	union sos_obj_ref_s tkn_ids;
 } *msg_t;
 
+/*
+ * Message argument encodings. The encoding of a message object is kept in the
+ * top byte of its tkn_count, so the objects of the legacy encoding (0) read
+ * the same as before.
+ */
+#define MSG_ENC_LV	0 /* length byte + LE bytes per argument (store 3.0) */
+#define MSG_ENC_VARINT	1 /* zigzag delta varint per argument (store 3.1) */
+#define MSG_ENC_SHIFT	56
+#define MSG_ENC(tkn_count)	((tkn_count) >> MSG_ENC_SHIFT)
+#define MSG_ARGC(tkn_count)	((tkn_count) & 0xFFFFFFFF)
+/* The maximum size of an encoded argument, in any encoding */
+#define MSG_ARG_MAX_LEN	10
+
 const char *first_seen_ptn[] = { "first_seen", "ptn_id" };
 const char *last_seen_ptn[] = { "last_seen", "ptn_id" };
 struct sos_schema_template pattern_schema = {
@@ -540,18 +798,66 @@ struct bstore_sos_info_s INFO_INIT = {
 	.store_ver = BSTORE_SOS_VER,
 };
 
+/* Set up the message indices of a new store from BSTORE_SOS_MSG_INDICES */
+static int __msg_idx_config(bstore_sos_info_t info)
+{
+	const char *env = getenv("BSTORE_SOS_MSG_INDICES");
+	char *buf, *tok, *ptr, *mode;
+	uint32_t idx;
+	int rc = 0;
+
+	if (!env)
+		return 0;
+	buf = strdup(env);
+	if (!buf)
+		return ENOMEM;
+	for (tok = strtok_r(buf, ",", &ptr); tok;
+	     tok = strtok_r(NULL, ",", &ptr)) {
+		mode = strchr(tok, ':');
+		if (mode)
+			*mode++ = '\0';
+		if (0 == strcmp(tok, "pt"))
+			idx = MSG_IDX_PT;
+		else if (0 == strcmp(tok, "ct"))
+			idx = MSG_IDX_CT;
+		else
+			goto einval;
+		info->msg_idx_off &= ~idx;
+		info->msg_idx_deferred &= ~idx;
+		if (!mode || 0 == strcmp(mode, "sync"))
+			continue;
+		if (0 == strcmp(mode, "deferred"))
+			info->msg_idx_deferred |= idx;
+		else if (0 == strcmp(mode, "off"))
+			info->msg_idx_off |= idx;
+		else
+			goto einval;
+	}
+	goto out;
+ einval:
+	berr("bstore_sos: bad BSTORE_SOS_MSG_INDICES '%s'\n", env);
+	rc = EINVAL;
+ out:
+	free(buf);
+	return rc;
+}
+
 int bstore_sos_info_create(const char *path, mode_t mode)
 {
+	struct bstore_sos_info_s info = INFO_INIT;
 	int fd = -1;
 	int rc = 0;
 	ssize_t sz;
 
+	rc = __msg_idx_config(&info);
+	if (rc)
+		goto out;
 	fd = open(path, O_CREAT|O_RDWR, mode);
 	if (fd < 0) {
 		rc = errno;
 		goto out;
 	}
-	sz = write(fd, &INFO_INIT, sizeof(INFO_INIT));
+	sz = write(fd, &info, sizeof(info));
 	if (sz < 0) {
 		rc = errno;
 		goto out;
@@ -565,7 +871,8 @@ int bstore_sos_info_create(const char *path, mode_t mode)
 static size_t encode_id(uint64_t id, uint8_t *s);
 static size_t encoded_id_len(uint64_t id);
 static size_t decode_ptn(bstr_t ptn, const uint8_t *tkn_str, size_t tkn_count);
-static size_t decode_msg(bmsg_t msg, const uint8_t *tkn_str, size_t tkn_count);
+static size_t decode_msg(bmsg_t msg, int enc, const uint8_t *tkn_str,
+			 size_t len, size_t tkn_count);
 static btkn_id_t bs_tkn_add(bstore_t bs, btkn_t tkn);
 static int bs_tkn_add_with_id(bstore_t bs, btkn_t tkn);
 static size_t encode_ptn(bstr_t ptn, size_t tkn_count);
@@ -826,7 +1133,12 @@ static bstore_t bs_open(bstore_plugin_t plugin, const char *path, int flags, int
 	/*
 	 * Check INFO for compatibility
 	 */
-	if (strcmp(BSTORE_SOS_VER, bs->info->store_ver)) {
+	if (0 == strcmp(BSTORE_SOS_VER, bs->info->store_ver)) {
+		bs->msg_enc = MSG_ENC_VARINT;
+	} else if (0 == strcmp(BSTORE_SOS_VER_3_0, bs->info->store_ver)) {
+		/* keep the store readable by the 3.0 plugins */
+		bs->msg_enc = MSG_ENC_LV;
+	} else {
 		errno = EINVAL;
 		goto err_3;
 	}
@@ -1046,11 +1358,12 @@ static bstore_t bs_open(bstore_plugin_t plugin, const char *path, int flags, int
 		sos_obj_put(last);
 	}
 	sos_iter_free(iter);
-	pthread_mutex_init(&bs->dict_lock, NULL);
-	pthread_mutex_init(&bs->msg_lock, NULL);
-	pthread_mutex_init(&bs->ptn_lock, NULL);
-	pthread_mutex_init(&bs->ptn_tkn_lock, NULL);
-	pthread_mutex_init(&bs->hist_lock, NULL);
+	__lock_stripes_init(bs->dict_locks);
+	__lock_stripes_init(bs->ptn_locks);
+	__ptn_cache_init(bs);
+	pthread_mutex_init(&bs->part_lock, NULL);
+	bs->part_period = bgetenv_u64("BSTORE_SOS_PART_PERIOD", 0);
+	bs->part_retention = bgetenv_u64("BSTORE_SOS_RETENTION", 0);
 	if (!create)
 		goto out;
 
@@ -1086,6 +1399,11 @@ static bstore_t bs_open(bstore_plugin_t plugin, const char *path, int flags, int
 		btkn_free(tkn);
 	}
  out:
+	rc = __msg_idx_start(bs, flags);
+	if (rc) {
+		errno = rc;
+		goto err_9;
+	}
 	free(cpath);
 	return &bs->base;
  err_9:
@@ -1117,6 +1435,7 @@ static void bs_close(bstore_t bs)
 	bstore_sos_t bss = (bstore_sos_t)bs;
 	if (!bs)
 		return;
+	__msg_idx_stop(bss);
 	free(bs->path);
 	if (bss->info)
 		bstore_sos_info_close(bss->info);
@@ -1126,6 +1445,8 @@ static void bs_close(bstore_t bs)
 	sos_container_close(bss->ptn_tkn_sos, SOS_COMMIT_ASYNC);
 	sos_container_close(bss->msg_sos, SOS_COMMIT_ASYNC);
 	sos_container_close(bss->hist_sos, SOS_COMMIT_ASYNC);
+	__ptn_cache_clear(bss);
+	free(bss->ptn_cache_hash);
 	free(bs);
 }
 
@@ -1300,7 +1621,9 @@ static sos_visit_action_t tkn_add_cb(sos_index_t index,
 		}
 		/* Update the token value */
 		tkn_value = sos_obj_ptr(tkn_obj);
-		tkn_value->tkn_count++;
+		/* tkn_count is the number of occurrences to add (0 means 1) */
+		tkn_value->tkn_count += ctxt->tkn->tkn_count ?
+					ctxt->tkn->tkn_count : 1;
 		tkn_value->tkn_type_mask |= ctxt->tkn->tkn_type_mask;
 		/* Update the memory tkn */
 		ctxt->tkn->tkn_id = tkn_value->tkn_id;
@@ -1368,9 +1691,11 @@ static btkn_id_t bs_tkn_add(bstore_t bs, btkn_t tkn)
 	struct missing_cb_ctxt ctxt = {.bss = bss, .tkn = tkn};
 	SOS_KEY_SZ(stack_key, 2048);
 	sos_key_t text_key = stack_key;
+	pthread_mutex_t *lock = __lock_stripe(bss->dict_locks,
+					      tkn->tkn_str->cstr,
+					      tkn->tkn_str->blen);
 
-	if (bstore_lock)
-		pthread_mutex_lock(&bss->dict_lock);
+	pthread_mutex_lock(lock);
 
 	ctxt.tkn->tkn_id = 0;
 	if (tkn->tkn_str->blen > 2048) {
@@ -1391,8 +1716,7 @@ static btkn_id_t bs_tkn_add(bstore_t bs, btkn_t tkn)
 	if (text_key != stack_key) {
 		sos_key_put(text_key);
 	}
-	if (bstore_lock)
-		pthread_mutex_unlock(&bss->dict_lock);
+	pthread_mutex_unlock(lock);
 	return ctxt.tkn->tkn_id;
 }
 
@@ -1404,9 +1728,11 @@ static int bs_tkn_add_with_id(bstore_t bs, btkn_t tkn)
 	bstore_sos_t bss = (bstore_sos_t)bs;
 	SOS_KEY_SZ(stack_key, 2048);
 	sos_key_t text_key = stack_key;
+	pthread_mutex_t *lock = __lock_stripe(bss->dict_locks,
+					      tkn->tkn_str->cstr,
+					      tkn->tkn_str->blen);
 
-	if (bstore_lock)
-		pthread_mutex_lock(&bss->dict_lock);
+	pthread_mutex_lock(lock);
 	if (tkn->tkn_str->blen > 2048) {
 		text_key = sos_key_new(tkn->tkn_str->blen);
 		if (!text_key) {
@@ -1429,8 +1755,7 @@ static int bs_tkn_add_with_id(bstore_t bs, btkn_t tkn)
 	if (text_key != stack_key) {
 		sos_key_put(text_key);
 	}
-	if (bstore_lock)
-		pthread_mutex_unlock(&bss->dict_lock);
+	pthread_mutex_unlock(lock);
 	return rc;
 }
 
@@ -1446,8 +1771,6 @@ static btkn_t bs_tkn_find_by_id(bstore_t bs, btkn_id_t tkn_id)
 	SOS_KEY(id_key);
 
 	sos_key_set(id_key, &tkn_id, sizeof(tkn_id));
-	if (bstore_lock)
-		pthread_mutex_lock(&bss->dict_lock);
 	iter = sos_attr_iter_new(bss->tkn_id_attr);
 	rc = sos_iter_find_last(iter, id_key);
 	if (rc) {
@@ -1475,8 +1798,6 @@ static btkn_t bs_tkn_find_by_id(bstore_t bs, btkn_id_t tkn_id)
 		sos_obj_put(tkn_obj);
 	if (iter)
 		sos_iter_free(iter);
-	if (bstore_lock)
-		pthread_mutex_unlock(&bss->dict_lock);
 	return token;
 }
 
@@ -1490,8 +1811,6 @@ static btkn_t bs_tkn_find_by_name(bstore_t bs,
 	SOS_KEY(text_key);
 
 	encode_tkn_key(text_key, text, text_len);
-	if (bstore_lock)
-		pthread_mutex_lock(&bss->dict_lock);
 	tkn_obj = sos_obj_find(bss->tkn_text_attr, text_key);
 	if (!tkn_obj)
 		goto out_0;
@@ -1505,8 +1824,6 @@ static btkn_t bs_tkn_find_by_name(bstore_t bs,
 		errno = ENOMEM;
 	sos_obj_put(tkn_obj);
  out_0:
-	if (bstore_lock)
-		pthread_mutex_unlock(&bss->dict_lock);
 	return token;
 }
 
@@ -1515,7 +1832,6 @@ static btkn_type_t bs_tkn_type_get(bstore_t bs, const char *typ_name, size_t nam
 	char *type_name;
 	btkn_t btkn;
 	btkn_type_t type_id;
-	bstore_sos_t bss = (bstore_sos_t)bs;
 
 	name_len = name_len + 3;
 	type_name = malloc(name_len);
@@ -1524,8 +1840,6 @@ static btkn_type_t bs_tkn_type_get(bstore_t bs, const char *typ_name, size_t nam
 		return 0;
 	}
 	snprintf(type_name, name_len, "_%s_", typ_name);
-	if (bstore_lock)
-		pthread_mutex_lock(&bss->dict_lock);
 	btkn = bs_tkn_find_by_name(bs, type_name, name_len);
 	if (!btkn) {
 		errno = ENOENT;
@@ -1535,8 +1849,6 @@ static btkn_type_t bs_tkn_type_get(bstore_t bs, const char *typ_name, size_t nam
 	type_id = btkn->tkn_id & ~BTKN_TYPE_WILDCARD;;
 	btkn_free(btkn);
  out:
-	if (bstore_lock)
-		pthread_mutex_unlock(&bss->dict_lock);
 	return type_id;
 }
 
@@ -1916,8 +2228,6 @@ static int bs_ptn_find_by_ptnstr(bstore_t bs, bptn_t ptn)
 	size_t ptn_size = encode_ptn(tmp_bstr, ptn->tkn_count);
 
 	sos_key_set(ptn_key, tmp_bstr->cstr, ptn_size);
-	if (bstore_lock)
-		pthread_mutex_lock(&bss->ptn_lock);
 
 	/* find & copy ptn info from the store to ptn */
 	ptn_obj = sos_obj_find(bss->tkn_type_ids_attr, ptn_key);
@@ -1925,7 +2235,7 @@ static int bs_ptn_find_by_ptnstr(bstore_t bs, bptn_t ptn)
 		sos_key_put(ptn_key);
 	if (!ptn_obj) {
 		rc = ENOENT;
-		goto cleanup_2;
+		goto cleanup_1;
 	}
 	ptn_value = sos_obj_ptr(ptn_obj);
 	ptn->ptn_id = ptn_value->ptn_id;
@@ -1938,9 +2248,6 @@ static int bs_ptn_find_by_ptnstr(bstore_t bs, bptn_t ptn)
 	rc = 0;
 	/* let-through for clean-up */
 
- cleanup_2:
-	if (bstore_lock)
-		pthread_mutex_unlock(&bss->ptn_lock);
  cleanup_1:
 	bstr_free(tmp_bstr);
  out:
@@ -2144,7 +2451,8 @@ static bmsg_t __make_msg(bstore_sos_t bss, bsos_iter_t i, sos_obj_t msg_obj)
 	bmsg_t dmsg;
 	msg_t smsg;
 	bptn_id_t ptn_id;
-	bptn_t ptn = NULL;
+	struct ptn_cache_entry *ptn = NULL;
+	uint64_t tkn_count;
 	int x, y;
 
 	if (!msg_obj)
@@ -2152,48 +2460,59 @@ static bmsg_t __make_msg(bstore_sos_t bss, bsos_iter_t i, sos_obj_t msg_obj)
 	smsg = sos_obj_ptr(msg_obj);
 
 	ptn_id = smsg->ptn_id;
-	ptn = bs_ptn_find(&bss->base, ptn_id);
+	ptn = __ptn_cache_get(bss, ptn_id);
 	if (!ptn)
 		goto out;
+	tkn_count = ptn->str.blen / sizeof(uint64_t);
 
 	tkn_ids = sos_value_init(&v_, msg_obj, bss->tkn_ids_attr);
 	if (!tkn_ids)
 		goto out;
 
-	dmsg = malloc(sizeof(*dmsg) + (ptn->tkn_count * sizeof(uint64_t)));
-	if (!dmsg)
+	dmsg = malloc(sizeof(*dmsg) + (tkn_count * sizeof(uint64_t)));
+	if (!dmsg) {
+		sos_value_put(tkn_ids);
 		goto out;
+	}
 
 	dmsg->ptn_id = ptn_id;
 	dmsg->timestamp.tv_sec = smsg->epoch_us / 1000000;
 	dmsg->timestamp.tv_usec = smsg->epoch_us % 1000000;
 	dmsg->comp_id = smsg->comp_id;
-	dmsg->argc = smsg->tkn_count;
-	decode_msg(dmsg, tkn_ids->data->array.data.byte_, smsg->tkn_count);
+	if (MSG_ARGC(smsg->tkn_count) > tkn_count ||
+	    decode_msg(dmsg, MSG_ENC(smsg->tkn_count),
+		       tkn_ids->data->array.data.byte_,
+		       tkn_ids->data->array.count,
+		       MSG_ARGC(smsg->tkn_count)) != MSG_ARGC(smsg->tkn_count)) {
+		berr("bstore_sos: bad message object, ptn_id %lu\n", ptn_id);
+		free(dmsg);
+		sos_value_put(tkn_ids);
+		goto out;
+	}
 
 	/* fill from the back */
 	x = dmsg->argc - 1;
-	for (y = ptn->tkn_count - 1; y >= 0; y--) {
-		btkn_id_t tkn_type_id = ptn->str->u64str[y] & BTKN_TYPE_ID_MASK;
+	for (y = tkn_count - 1; y >= 0; y--) {
+		btkn_id_t tkn_type_id = ptn->str.u64str[y] & BTKN_TYPE_ID_MASK;
 		if (tkn_type_id == BTKN_TYPE_WHITESPACE || btkn_id_is_wildcard(tkn_type_id)) {
 			dmsg->argv[y] = dmsg->argv[x];
 			x--;
 		} else {
-			dmsg->argv[y] = ptn->str->u64str[y];
+			dmsg->argv[y] = ptn->str.u64str[y];
 		}
 	}
 	assert(y == -1);
 	assert(x == -1);
-	dmsg->argc = ptn->tkn_count;
+	dmsg->argc = tkn_count;
 
-	bptn_free(ptn);
+	__ptn_cache_put(ptn);
 	sos_value_put(tkn_ids);
 	sos_obj_put(msg_obj);
 	return dmsg;
  out:
 	sos_obj_put(msg_obj);
 	if (ptn)
-		bptn_free(ptn);
+		__ptn_cache_put(ptn);
 	return NULL;
 }
 
@@ -2209,36 +2528,19 @@ static sos_obj_t __next_matching_msg(int rc, bsos_iter_t i, int forwards)
 		tv.tv_sec = msg->epoch_us / 1000000;
 		tv.tv_usec = msg->epoch_us % 1000000;
 
-		/* ptn_id specified and doesn't match, exit */
-		if (i->filter.ptn_id) {
-			/* We're using the pt_msg_key index */
+		switch (i->iter_type) {
+		case MSG_ITER_PTN_TIME:
+			/* We're using the pt_msg_key index, a different
+			 * ptn_id completes the iteration */
 			if (i->filter.ptn_id != msg->ptn_id)
 				goto enoent;
-
-			if (i->filter.tv_begin.tv_sec &&
-					timercmp(&tv, &i->filter.tv_begin, <))
-				goto enoent;
-
-			if (i->filter.tv_end.tv_sec &&
-					timercmp(&i->filter.tv_end, &tv, <))
+			break;
+		case MSG_ITER_COMP_TIME:
+			/* We're using the ct_msg_key index, a different
+			 * comp_id completes the iteration */
+			if (i->filter.comp_id != msg->comp_id)
 				goto enoent;
-
-			/* Skip component id's that don't match */
-			if (i->filter.comp_id
-			    && (i->filter.comp_id != msg->comp_id)) {
-				sos_obj_put(obj);
-				continue;
-			} else {
-				/* matching object */
-				break;
-			}
-		}
-
-		if (i->filter.comp_id && (i->filter.comp_id != msg->comp_id)) {
-			/* We're using the ct_msg_key index. If comp_id doesn't
-			 * match, we've completed the iteration
-			 */
-			goto enoent;
+			break;
 		}
 
 		if (i->filter.tv_begin.tv_sec &&
@@ -2249,7 +2551,16 @@ static sos_obj_t __next_matching_msg(int rc, bsos_iter_t i, int forwards)
 				timercmp(&i->filter.tv_end, &tv, <))
 			goto enoent;
 
-		/* We're using the tc_msg_key index, return the message */
+		/* Skip the messages that the index doesn't filter out, e.g.
+		 * comp_id on pt_msg_key or both on tc_msg_key when the store
+		 * doesn't keep the other indices */
+		if ((i->filter.ptn_id && i->filter.ptn_id != msg->ptn_id) ||
+		    (i->filter.comp_id && i->filter.comp_id != msg->comp_id)) {
+			sos_obj_put(obj);
+			continue;
+		}
+
+		/* matching object */
 		break;
 	}
 	if (!rc)
@@ -2401,9 +2712,11 @@ int bs_msg_iter_filter_set(bmsg_iter_t iter, bstore_iter_filter_t filter)
 
 	i->filter = *filter;
 
-	if (filter->ptn_id) {
+	/* fall back to the time index when the store doesn't keep the
+	 * pattern or the component index */
+	if (filter->ptn_id && !(bss->msg_idx_off & MSG_IDX_PT)) {
 		new_type = MSG_ITER_PTN_TIME;
-	} else if (filter->comp_id) {
+	} else if (filter->comp_id && !(bss->msg_idx_off & MSG_IDX_CT)) {
 		new_type = MSG_ITER_COMP_TIME;
 	} else {
 		new_type = MSG_ITER_TIME_COMP;
@@ -2558,30 +2871,164 @@ static size_t decode_ptn(bstr_t ptn, const uint8_t *tkn_str, size_t tkn_count)
 	return tkn;
 }
 
-static size_t encode_msg(bmsg_t msg)
+/*
+ * MSG_ENC_VARINT: each argument is the LEB128 varint of
+ *
+ *   zigzag(arg - prev[class]) << 1 | class
+ *
+ * where class is 0 for WHITESPACE and 1 for the wildcard (word) arguments,
+ * and prev[class] is the previous argument of the same class (0 at first).
+ * The WHITESPACE arguments are mostly the same token over and over, so they
+ * take one byte each instead of five. The token ids are below 2^56 (the top
+ * byte is reserved), so an argument takes at most 9 bytes.
+ */
+static inline uint8_t *encode_varint(uint64_t v, uint8_t *s)
+{
+	while (v >= 0x80) {
+		*s++ = (uint8_t)v | 0x80;
+		v >>= 7;
+	}
+	*s++ = (uint8_t)v;
+	return s;
+}
+
+/*
+ * Decode a varint from \c s, not going past \c end.
+ * \retval s The byte following the varint.
+ * \retval NULL If the varint is truncated.
+ */
+static inline const uint8_t *decode_varint(const uint8_t *s,
+					   const uint8_t *end, uint64_t *v)
+{
+	uint64_t x;
+	int shift;
+	if (s < end && *s < 0x80) {
+		/* the common case: a single byte */
+		*v = *s;
+		return s + 1;
+	}
+	x = 0;
+	for (shift = 0; s < end && shift < 64; shift += 7) {
+		x |= (uint64_t)(*s & 0x7F) << shift;
+		if (*s++ < 0x80) {
+			*v = x;
+			return s;
+		}
+	}
+	return NULL;
+}
+
+static size_t encode_msg_varint(bmsg_t msg, uint8_t *buf, uint32_t *argc)
+{
+	int tkn;
+	int class;
+	int64_t d;
+	uint64_t zz;
+	btkn_type_t type_id;
+	btkn_id_t prev[2] = {0, 0};
+	uint8_t *msg_str = buf;
+	*argc = 0;
+	for (tkn = 0; tkn < msg->argc; tkn++) {
+		type_id = msg->argv[tkn] & BTKN_TYPE_ID_MASK;
+		if (type_id == BTKN_TYPE_WHITESPACE)
+			class = 0;
+		else if (btkn_id_is_wildcard(type_id))
+			class = 1;
+		else
+			continue;
+		d = (int64_t)(msg->argv[tkn] - prev[class]);
+		prev[class] = msg->argv[tkn];
+		zz = ((uint64_t)d << 1) ^ (uint64_t)(d >> 63);
+		msg_str = encode_varint(zz << 1 | class, msg_str);
+		(*argc)++;
+	}
+	return msg_str - buf;
+}
+
+static size_t decode_msg_varint(bmsg_t msg, const uint8_t *tkn_str,
+				size_t len, size_t tkn_count)
+{
+	const uint8_t *end = tkn_str + len;
+	btkn_id_t prev[2] = {0, 0};
+	uint64_t v, zz;
+	int tkn;
+	int class;
+	msg->argc = 0;
+	for (tkn = 0; tkn < tkn_count; tkn++) {
+		tkn_str = decode_varint(tkn_str, end, &v);
+		if (!tkn_str)
+			break;
+		class = v & 1;
+		zz = v >> 1;
+		prev[class] += (zz >> 1) ^ -(zz & 1);
+		msg->argv[tkn] = prev[class];
+		msg->argc ++;
+	}
+	return msg->argc;
+}
+
+/*
+ * Encode the arguments of \c msg that are saved in the message object into
+ * \c buf, with the encoding \c enc (MSG_ENC_*). Only the WHITESPACE and the
+ * wildcard arguments are saved, the others can be recovered from the pattern.
+ * \c buf must have room for \c msg->argc encoded arguments of
+ * MSG_ARG_MAX_LEN bytes. \c msg is not modified.
+ *
+ * \param[out] argc The number of encoded arguments.
+ * \return The size of the encoded arguments.
+ */
+static size_t encode_msg(bmsg_t msg, int enc, uint8_t *buf, uint32_t *argc)
 {
 	int tkn;
 	size_t tkn_size;
 	size_t msg_size = 0;
-	uint8_t *msg_str = (uint8_t *)&msg->argv[0];
+	btkn_type_t type_id;
+	uint8_t *msg_str = buf;
+	if (enc == MSG_ENC_VARINT)
+		return encode_msg_varint(msg, buf, argc);
+	*argc = 0;
 	for (tkn = 0; tkn < msg->argc; tkn++) {
+		type_id = msg->argv[tkn] & BTKN_TYPE_ID_MASK;
+		if (type_id != BTKN_TYPE_WHITESPACE &&
+		    !btkn_id_is_wildcard(type_id))
+			continue;
 		msg_str++;	/* make room for the size */
 		tkn_size = encode_id(msg->argv[tkn], msg_str);
 		assert(tkn_size < 256);
 		msg_str[-1] = (uint8_t)tkn_size;
 		msg_size += tkn_size + 1;
 		msg_str += tkn_size;	/* skip the next token */
+		(*argc)++;
 	}
 	return msg_size;
 }
 
-static size_t decode_msg(bmsg_t msg, const uint8_t *tkn_str, size_t tkn_count)
+/*
+ * Decode the \c tkn_count arguments encoded with \c enc in the \c len bytes of
+ * \c tkn_str into \c msg->argv.
+ *
+ * \return The number of decoded arguments, less than \c tkn_count if the
+ *         encoded arguments are truncated or the encoding is unknown.
+ */
+static size_t decode_msg(bmsg_t msg, int enc, const uint8_t *tkn_str,
+			 size_t len, size_t tkn_count)
 {
 	int tkn;
 	uint8_t tkn_sz;
 	btkn_id_t tkn_id;
+	const uint8_t *end = tkn_str + len;
 	msg->argc = 0;
+	switch (enc) {
+	case MSG_ENC_VARINT:
+		return decode_msg_varint(msg, tkn_str, len, tkn_count);
+	case MSG_ENC_LV:
+		break;
+	default:
+		return 0;
+	}
 	for (tkn = 0; tkn < tkn_count; tkn++) {
+		if (tkn_str >= end || tkn_str + *tkn_str >= end)
+			break;
 		tkn_id = decode_id(tkn_str);
 		assert(tkn_id);
 		msg->argv[tkn] = tkn_id;
@@ -2589,7 +3036,61 @@ static size_t decode_msg(bmsg_t msg, const uint8_t *tkn_str, size_t tkn_count)
 		tkn_sz = *tkn_str; /* Get the size */
 		tkn_str += tkn_sz + 1;
 	}
-	return tkn;
+	return msg->argc;
+}
+
+/*
+ * Move the pattern's first_seen/last_seen back/forward to \c tv if needed,
+ * keeping the first_seen and last_seen indices consistent.
+ */
+static void __ptn_seen_update(bstore_sos_t bss, sos_obj_t ptn_obj,
+			      ptn_t ptn_value, const struct timeval *tv)
+{
+	int rc;
+	struct timeval last_seen;
+	struct timeval first_seen;
+	SOS_KEY(ts_key);
+	sos_index_t first_seen_idx = sos_attr_index(bss->first_seen_attr);
+	sos_index_t last_seen_idx = sos_attr_index(bss->last_seen_attr);
+
+	last_seen.tv_sec = ptn_value->last_seen.fine.secs;
+	last_seen.tv_usec = ptn_value->last_seen.fine.usecs;
+	first_seen.tv_sec = ptn_value->first_seen.fine.secs;
+	first_seen.tv_usec = ptn_value->first_seen.fine.usecs;
+	if (timercmp(&first_seen, tv, >)) {
+		/* new first seen is before the db first seen */
+		/* remove existing key */
+		rc = sos_key_join(ts_key, bss->first_seen_attr,
+				  ptn_value->first_seen, ptn_value->ptn_id);
+		assert(rc == 0);
+		rc = sos_index_remove(first_seen_idx, ts_key, ptn_obj);
+		assert(rc == 0);
+		/* add new key */
+		ptn_value->first_seen.fine.secs = tv->tv_sec;
+		ptn_value->first_seen.fine.usecs = tv->tv_usec;
+		rc = sos_key_join(ts_key, bss->first_seen_attr,
+				  ptn_value->first_seen, ptn_value->ptn_id);
+		assert(rc == 0);
+		rc = sos_index_insert(first_seen_idx, ts_key, ptn_obj);
+		assert(rc == 0);
+	}
+	if (timercmp(&last_seen, tv, <)) {
+		/* new time is after the db last seen */
+		/* remove existing key */
+		rc = sos_key_join(ts_key, bss->last_seen_attr,
+				  ptn_value->last_seen, ptn_value->ptn_id);
+		assert(rc == 0);
+		rc = sos_index_remove(last_seen_idx, ts_key, ptn_obj);
+		assert(rc == 0);
+		/* add new key */
+		ptn_value->last_seen.fine.secs = tv->tv_sec;
+		ptn_value->last_seen.fine.usecs = tv->tv_usec;
+		rc = sos_key_join(ts_key, bss->last_seen_attr,
+				  ptn_value->last_seen, ptn_value->ptn_id);
+		assert(rc == 0);
+		rc = sos_index_insert(last_seen_idx, ts_key, ptn_obj);
+		assert(rc == 0);
+	}
 }
 
 struct ptn_add_cb_ctxt {
@@ -2617,52 +3118,13 @@ static sos_visit_action_t ptn_add_cb(sos_index_t index,
 	sos_index_t last_seen_idx = sos_attr_index(ctxt->bss->last_seen_attr);
 
 	if (found) {
-		struct timeval last_seen;
-		struct timeval first_seen;
 		ptn_obj = sos_ref_as_obj(ctxt->bss->ptn_sos, ref);
 		if (!ptn_obj) {
 			OOM();
 			goto err_0;
 		}
 		ptn_value = sos_obj_ptr(ptn_obj);
-		last_seen.tv_sec = ptn_value->last_seen.fine.secs;
-		last_seen.tv_usec = ptn_value->last_seen.fine.usecs;
-		first_seen.tv_sec = ptn_value->first_seen.fine.secs;
-		first_seen.tv_usec = ptn_value->first_seen.fine.usecs;
-		if (timercmp(&first_seen, ctxt->tv, >)) {
-			/* new first seen is before the db first seen */
-			/* remove existing key */
-			rc = sos_key_join(ts_key, ctxt->bss->first_seen_attr,
-					  ptn_value->first_seen, ptn_value->ptn_id);
-			assert(rc == 0);
-			rc = sos_index_remove(first_seen_idx, ts_key, ptn_obj);
-			assert(rc == 0);
-			/* add new key */
-			ptn_value->first_seen.fine.secs = ctxt->tv->tv_sec;
-			ptn_value->first_seen.fine.usecs = ctxt->tv->tv_usec;
-			rc = sos_key_join(ts_key, ctxt->bss->first_seen_attr,
-					  ptn_value->first_seen, ptn_value->ptn_id);
-			assert(rc == 0);
-			rc = sos_index_insert(first_seen_idx, ts_key, ptn_obj);
-			assert(rc == 0);
-		}
-		if (timercmp(&last_seen, ctxt->tv, <)) {
-			/* new time is after the db last seen */
-			/* remove existing key */
-			rc = sos_key_join(ts_key, ctxt->bss->last_seen_attr,
-					  ptn_value->last_seen, ptn_value->ptn_id);
-			assert(rc == 0);
-			rc = sos_index_remove(last_seen_idx, ts_key, ptn_obj);
-			assert(rc == 0);
-			/* add new key */
-			ptn_value->last_seen.fine.secs = ctxt->tv->tv_sec;
-			ptn_value->last_seen.fine.usecs = ctxt->tv->tv_usec;
-			rc = sos_key_join(ts_key, ctxt->bss->last_seen_attr,
-					  ptn_value->last_seen, ptn_value->ptn_id);
-			assert(rc == 0);
-			rc = sos_index_insert(last_seen_idx, ts_key, ptn_obj);
-			assert(rc == 0);
-		}
+		__ptn_seen_update(ctxt->bss, ptn_obj, ptn_value, ctxt->tv);
 		ptn_value->count ++;
 		ctxt->ptn_id = ptn_value->ptn_id;
 		sos_obj_put(ptn_obj);
@@ -2723,6 +3185,7 @@ static sos_visit_action_t ptn_add_cb(sos_index_t index,
 	sos_index_remove(first_seen_idx, ts_key, ptn_obj);
  err_2:
 	sos_index_remove(ptn_id_idx, id_key, ptn_obj);
+	__ptn_cache_invalidate(ctxt->bss, ctxt->ptn_id);
  err_1:
 	sos_obj_delete(ptn_obj);
 	sos_obj_put(ptn_obj);
@@ -2730,11 +3193,27 @@ static sos_visit_action_t ptn_add_cb(sos_index_t index,
 	return SOS_VISIT_NOP;
 }
 
+/* The stripe of ptn_locks of a pattern object, by its encoded pattern */
+static pthread_mutex_t *__ptn_obj_lock(bstore_sos_t bss, sos_obj_t ptn_obj)
+{
+	struct sos_value_s v_, *v;
+	pthread_mutex_t *lock;
+
+	v = sos_value_init(&v_, ptn_obj, bss->tkn_type_ids_attr);
+	if (!v)
+		return NULL;
+	lock = __lock_stripe(bss->ptn_locks, v->data->array.data.byte_,
+			     v->data->array.count);
+	sos_value_put(v);
+	return lock;
+}
+
 static bptn_id_t bs_ptn_add(bstore_t bs, struct timeval *tv, bstr_t ptn)
 {
 	bstore_sos_t bss = (bstore_sos_t)bs;
 	SOS_KEY_SZ(stack_key, 2048);
 	sos_key_t ptn_key;
+	pthread_mutex_t *lock;
 	int rc;
 	struct ptn_add_cb_ctxt ctxt = { .bss = bss, .tv = tv, .ptn = ptn };
 
@@ -2750,22 +3229,58 @@ static bptn_id_t bs_ptn_add(bstore_t bs, struct timeval *tv, bstr_t ptn)
 	ctxt.ptn_size = encode_ptn(ptn, ctxt.tkn_count);
 	sos_key_set(ptn_key, ptn->cstr, ctxt.ptn_size);
 
-	if (bstore_lock)
-		pthread_mutex_lock(&bss->ptn_lock);
+	lock = __lock_stripe(bss->ptn_locks, ptn->cstr, ctxt.ptn_size);
+	pthread_mutex_lock(lock);
 
 	rc = sos_index_visit(sos_attr_index(bss->tkn_type_ids_attr),
 						ptn_key, ptn_add_cb, &ctxt);
 	if (ptn_key != stack_key)
 		sos_key_put(ptn_key);
 
-	if (bstore_lock)
-		pthread_mutex_unlock(&bss->ptn_lock);
+	pthread_mutex_unlock(lock);
 
 	if (rc)
 		return 0;
 	return ctxt.ptn_id;
 }
 
+static int bs_ptn_stat_update(bstore_t bs, bptn_id_t ptn_id,
+			      struct timeval *first_seen,
+			      struct timeval *last_seen, uint64_t count)
+{
+	bstore_sos_t bss = (bstore_sos_t)bs;
+	sos_obj_t ptn_obj;
+	ptn_t ptn_value;
+	pthread_mutex_t *lock;
+	SOS_KEY(id_key);
+	int rc = 0;
+
+	sos_key_set(id_key, &ptn_id, sizeof(ptn_id));
+
+	ptn_obj = sos_obj_find(bss->ptn_id_attr, id_key);
+	sos_key_put(id_key);
+	if (!ptn_obj) {
+		rc = ENOENT;
+		goto out;
+	}
+	/* serialize with bs_ptn_add() of the same pattern */
+	lock = __ptn_obj_lock(bss, ptn_obj);
+	if (!lock) {
+		rc = errno;
+		goto err;
+	}
+	pthread_mutex_lock(lock);
+	ptn_value = sos_obj_ptr(ptn_obj);
+	__ptn_seen_update(bss, ptn_obj, ptn_value, first_seen);
+	__ptn_seen_update(bss, ptn_obj, ptn_value, last_seen);
+	ptn_value->count += count;
+	pthread_mutex_unlock(lock);
+ err:
+	sos_obj_put(ptn_obj);
+ out:
+	return rc;
+}
+
 static sos_visit_action_t hist_cb(sos_index_t index,
 				  sos_key_t key, sos_idx_data_t *idx_data,
 				  int found,
@@ -2777,12 +3292,16 @@ static sos_visit_action_t hist_cb(sos_index_t index,
 	 *       uint64_t[2] for obj ref inside the part. In our `hist` case,
 	 *       they're all 0 becuase we don't have any object associated with
 	 *       the index.
+	 *
+	 *       `arg`, if not NULL, points to the (uint64_t) number of
+	 *       occurrences to add. Otherwise, the count is increased by 1.
 	 */
+	uint64_t n = arg ? *(uint64_t *)arg : 1;
 	if (!found) {
-		idx_data->uint64_[HIST_IDX] = 1;
+		idx_data->uint64_[HIST_IDX] = n;
 		return SOS_VISIT_ADD;
 	}
-	idx_data->uint64_[HIST_IDX]++;
+	idx_data->uint64_[HIST_IDX] += n;
 	return SOS_VISIT_UPD;
 }
 
@@ -2803,39 +3322,37 @@ static sos_visit_action_t hist_sub_cb(sos_index_t index,
  * Add a new token for a pattern if the token is not already present
  * at that position
  */
-static int bs_ptn_tkn_add(bstore_t bs, bptn_id_t ptn_id, uint64_t tkn_pos,
-			  btkn_id_t tkn_id)
+static int __ptn_tkn_add(bstore_sos_t bss, bptn_id_t ptn_id, uint64_t tkn_pos,
+			 btkn_id_t tkn_id, uint64_t *count)
 {
-	bstore_sos_t bss = (bstore_sos_t)bs;
 	SOS_KEY(key);
 	sos_index_t idx;
-	int rc;
 
 	sos_key_join(key, bss->ptn_pos_tkn_key_attr, ptn_id, tkn_pos, tkn_id);
-
-	if (bstore_lock)
-		pthread_mutex_lock(&bss->ptn_tkn_lock);
-
 	idx = sos_attr_index(bss->ptn_pos_tkn_key_attr);
-	rc = sos_index_visit(idx, key, hist_cb, NULL);
+	return sos_index_visit(idx, key, hist_cb, count);
+}
 
-	if (bstore_lock)
-		pthread_mutex_unlock(&bss->ptn_tkn_lock);
-	return rc;
+static int bs_ptn_tkn_add(bstore_t bs, bptn_id_t ptn_id, uint64_t tkn_pos,
+			  btkn_id_t tkn_id)
+{
+	bstore_sos_t bss = (bstore_sos_t)bs;
+
+	return __ptn_tkn_add(bss, ptn_id, tkn_pos, tkn_id, NULL);
 }
 
 static int __bs_static_ptn_tkn_rc(bstore_t bs, bptn_id_t ptn_id,
 				  uint64_t tkn_pos, btkn_id_t *tkn_id)
 {
-	bptn_t ptn = NULL;
+	struct ptn_cache_entry *ptn;
 	btkn_id_t _tkn_id;
 
-	ptn = bs_ptn_find(bs, ptn_id);
+	ptn = __ptn_cache_get((bstore_sos_t)bs, ptn_id);
 	if (!ptn)
 		return EINVAL;
 
-	_tkn_id = ptn->str->u64str[tkn_pos] >> 8;
-	bptn_free(ptn);
+	_tkn_id = ptn->str.u64str[tkn_pos] >> 8;
+	__ptn_cache_put(ptn);
 
 	if (btkn_id_is_wildcard(_tkn_id))
 		return ENOKEY;
@@ -2857,18 +3374,20 @@ static int __bs_static_ptn_tkn_rc(bstore_t bs, bptn_id_t ptn_id,
 static btkn_t __bs_static_ptn_tkn(bstore_t bs, bptn_id_t ptn_id,
 				  uint64_t tkn_pos, btkn_id_t tkn_id)
 {
+	bstore_sos_t bss = (bstore_sos_t)bs;
+	struct ptn_cache_entry *ptn;
 	btkn_t tkn;
-	bptn_t ptn = NULL;
 	btkn_id_t _tkn_id;
+	sos_obj_t ptn_obj;
 	uint64_t count;
+	SOS_KEY(ptn_key);
 
-	ptn = bs_ptn_find(bs, ptn_id);
+	ptn = __ptn_cache_get(bss, ptn_id);
 	if (!ptn)
 		return NULL;
 
-	_tkn_id = ptn->str->u64str[tkn_pos] >> 8;
-	count = ptn->count;
-	bptn_free(ptn);
+	_tkn_id = ptn->str.u64str[tkn_pos] >> 8;
+	__ptn_cache_put(ptn);
 
 	if (btkn_id_is_wildcard(_tkn_id)) {
 		errno = ENOKEY;
@@ -2881,6 +3400,17 @@ static btkn_t __bs_static_ptn_tkn(bstore_t bs, bptn_id_t ptn_id,
 		return NULL;
 	}
 
+	/* the count is not cached, it changes with every message */
+	sos_key_set(ptn_key, &ptn_id, sizeof(ptn_id));
+	ptn_obj = sos_obj_find(bss->ptn_id_attr, ptn_key);
+	sos_key_put(ptn_key);
+	if (!ptn_obj) {
+		errno = ENOENT;
+		return NULL;
+	}
+	count = ((ptn_t)sos_obj_ptr(ptn_obj))->count;
+	sos_obj_put(ptn_obj);
+
 	tkn = bs_tkn_find_by_id(bs, _tkn_id);
 	if (!tkn)
 		return NULL;
@@ -2905,8 +3435,6 @@ static btkn_t bs_ptn_tkn_find(bstore_t bs, bptn_id_t ptn_id, uint64_t tkn_pos,
 		return NULL;
 
 	sos_key_join(key, bss->ptn_pos_tkn_key_attr, ptn_id, tkn_pos, tkn_id);
-	if (bstore_lock)
-		pthread_mutex_lock(&bss->ptn_tkn_lock);
 	idx = sos_attr_index(bss->ptn_pos_tkn_key_attr);
 	rc = sos_index_find_ref(idx, key, &ref);
 	if (!rc) {
@@ -2921,16 +3449,152 @@ static btkn_t bs_ptn_tkn_find(bstore_t bs, bptn_id_t ptn_id, uint64_t tkn_pos,
 		tkn = NULL;
 	}
  out:
-	if (bstore_lock)
-		pthread_mutex_unlock(&bss->ptn_tkn_lock);
 	return tkn;
 }
 
-static int bs_ptn_hist_update(bstore_t bs,
-			      bptn_id_t ptn_id, bcomp_id_t comp_id,
-			      time_t secs, time_t bin_width)
+/*
+ * Time partitions.
+ *
+ * With BSTORE_SOS_PART_PERIOD (seconds, e.g. 86400) in the environment, the
+ * Messages container rolls over to a new SOS partition for each period of the
+ * message time. A partition is named after the start of its period (UTC,
+ * PART_NAME_FMT). The new objects go to the partition of the latest period
+ * seen, so the late messages go to the current partition. A message stamped
+ * more than a period ahead of the wall clock does not roll the container over
+ * (that would expire the current data), it is stored as a late one. The
+ * iterators see all of the ACTIVE partitions: the partitioning is
+ * transparent to the readers, and the indices of a partition only grow for a
+ * period.
+ *
+ * With BSTORE_SOS_RETENTION (seconds), the partitions of the periods that
+ * ended more than RETENTION seconds before the current period are taken
+ * offline and deleted when the container rolls over. The data expires a whole
+ * partition at a time, rather than object by object in the indices.
+ *
+ * The History container is not partitioned. The histogram bins are kept only
+ * in the index data of its keys, not in partition objects, so they are
+ * neither rolled over nor expired.
+ */
+#define PART_NAME_FMT "%Y%m%d%H%M%S"
+#define PART_NAME_LEN 32
+
+/* The start of the period of the partition \c name, -1 if \c name is not a
+ * time partition */
+static time_t __part_start(const char *name)
+{
+	struct tm tm;
+	char *end;
+	memset(&tm, 0, sizeof(tm));
+	end = strptime(name, PART_NAME_FMT, &tm);
+	if (!end || *end)
+		return -1;
+	return timegm(&tm);
+}
+
+/* Drop the partitions of \c sos that expired by \c start */
+static void __part_expire(bstore_sos_t bss, sos_t sos, time_t start)
+{
+	char (*names)[PART_NAME_LEN] = NULL, (*tmp)[PART_NAME_LEN];
+	sos_part_iter_t iter;
+	sos_part_t part;
+	time_t pstart;
+	int i, n = 0, rc;
+
+	if (!bss->part_retention)
+		return;
+	iter = sos_part_iter_new(sos);
+	if (!iter)
+		return;
+	/* collect the names first, the partitions are not deleted under the
+	 * iterator */
+	for (part = sos_part_first(iter); part; part = sos_part_next(iter)) {
+		pstart = __part_start(sos_part_name(part));
+		if (pstart >= 0 && sos_part_state(part) != SOS_PART_STATE_PRIMARY
+		    && pstart + bss->part_period + bss->part_retention <= start) {
+			tmp = realloc(names, (n + 1) * sizeof(*names));
+			if (tmp) {
+				names = tmp;
+				snprintf(names[n++], PART_NAME_LEN, "%s",
+					 sos_part_name(part));
+			}
+		}
+		sos_part_put(part);
+	}
+	sos_part_iter_free(iter);
+	for (i = 0; i < n; i++) {
+		part = sos_part_find(sos, names[i]);
+		if (!part)
+			continue;
+		rc = sos_part_state_set(part, SOS_PART_STATE_OFFLINE);
+		if (!rc)
+			rc = sos_part_delete(part);
+		if (rc)
+			berr("bstore_sos: cannot drop partition %s, error %d\n",
+			     names[i], rc);
+		else
+			binfo("bstore_sos: dropped expired partition %s",
+			      names[i]);
+		sos_part_put(part);
+	}
+	free(names);
+}
+
+/*
+ * Roll \c sos over to the partition of the period of \c t, if \c t is past
+ * \c *part_end (the end of the period of the current primary partition).
+ */
+static void __part_roll(bstore_sos_t bss, sos_t sos, time_t *part_end,
+			time_t t)
+{
+	char name[PART_NAME_LEN];
+	sos_part_t part;
+	time_t start;
+	struct tm tm;
+	int rc = 0;
+
+	if (!bss->part_period || t < *part_end)
+		return;
+	if (t > time(NULL) + bss->part_period)
+		return; /* from the future, stored as a late message */
+	pthread_mutex_lock(&bss->part_lock);
+	if (t < *part_end)
+		goto out;
+	start = t - t % bss->part_period;
+	gmtime_r(&start, &tm);
+	strftime(name, sizeof(name), PART_NAME_FMT, &tm);
+	part = sos_part_find(sos, name);
+	if (!part) {
+		rc = sos_part_create(sos, name, NULL);
+		if (rc && rc != EEXIST)
+			goto err;
+		part = sos_part_find(sos, name);
+		if (!part) {
+			rc = ENOENT;
+			goto err;
+		}
+	}
+	rc = 0;
+	if (sos_part_state(part) != SOS_PART_STATE_PRIMARY)
+		rc = sos_part_state_set(part, SOS_PART_STATE_PRIMARY);
+	sos_part_put(part);
+	if (rc)
+		goto err;
+	__part_expire(bss, sos, start);
+	goto done;
+ err:
+	berr("bstore_sos: cannot roll over to partition %s, error %d\n",
+	     name, rc);
+ done:
+	/* on error, the current partition is kept for this period */
+	*part_end = start + bss->part_period;
+ out:
+	pthread_mutex_unlock(&bss->part_lock);
+}
+
+static int __ptn_hist_update(bstore_sos_t bss,
+			     bptn_id_t ptn_id, bcomp_id_t comp_id,
+			     time_t secs, time_t bin_width, uint64_t *count)
 {
-	bstore_sos_t bss = (bstore_sos_t)bs;
 	SOS_KEY(ph_key);
 	SOS_KEY(ch_key);
 	sos_index_t idx;
@@ -2939,7 +3603,7 @@ static int bs_ptn_hist_update(bstore_t bs,
 	/* Pattern Histogram */
 	sos_key_join(ph_key, bss->ptn_hist_key_attr, bin_width, secs, ptn_id);
 	idx = sos_attr_index(bss->ptn_hist_key_attr);
-	rc = sos_index_visit(idx, ph_key, hist_cb, NULL);
+	rc = sos_index_visit(idx, ph_key, hist_cb, count);
 	if (rc && rc != EINPROGRESS)
 		goto err_0;
 
@@ -2947,7 +3611,7 @@ static int bs_ptn_hist_update(bstore_t bs,
 	sos_key_join(ph_key, bss->ptn_hist_key_attr,
 		     bin_width, secs, BPTN_ID_SUM_ALL);
 	idx = sos_attr_index(bss->ptn_hist_key_attr);
-	rc = sos_index_visit(idx, ph_key, hist_cb, NULL);
+	rc = sos_index_visit(idx, ph_key, hist_cb, count);
 	if (rc && rc != EINPROGRESS)
 		goto err_0;
 
@@ -2955,74 +3619,441 @@ static int bs_ptn_hist_update(bstore_t bs,
 	sos_key_join(ch_key, bss->comp_hist_key_attr,
 		     bin_width, secs, comp_id, ptn_id);
 	idx = sos_attr_index(bss->comp_hist_key_attr);
-	rc = sos_index_visit(idx, ch_key, hist_cb, NULL);
+	rc = sos_index_visit(idx, ch_key, hist_cb, count);
 	if (rc && rc != EINPROGRESS)
 		goto err_0;
 	sos_key_join(ch_key, bss->comp_hist_key2_attr,
 		     bin_width, comp_id, ptn_id, secs);
 	idx = sos_attr_index(bss->comp_hist_key2_attr);
-	rc = sos_index_visit(idx, ch_key, hist_cb, NULL);
+	rc = sos_index_visit(idx, ch_key, hist_cb, count);
 	if (rc && rc != EINPROGRESS)
 		goto err_0;
 
 	return 0;
  err_0:
-	// pthread_mutex_unlock(&bss->hist_lock);
 	return rc;
 }
 
-static int bs_tkn_hist_update(bstore_t bs, time_t secs, time_t bin_width, btkn_id_t tkn_id)
+static int bs_ptn_hist_update(bstore_t bs,
+			      bptn_id_t ptn_id, bcomp_id_t comp_id,
+			      time_t secs, time_t bin_width)
+{
+	return __ptn_hist_update((bstore_sos_t)bs, ptn_id, comp_id,
+				 secs, bin_width, NULL);
+}
+
+static int __tkn_hist_update(bstore_sos_t bss, time_t secs, time_t bin_width,
+			     btkn_id_t tkn_id, uint64_t *count)
 {
 	SOS_KEY(key);
-	bstore_sos_t bss = (bstore_sos_t)bs;
 	sos_index_t idx = sos_attr_index(bss->tkn_hist_key_attr);
 
 	sos_key_join(key, bss->tkn_hist_key_attr, bin_width, secs, tkn_id);
-	return sos_index_visit(idx, key, hist_cb, NULL);
+	return sos_index_visit(idx, key, hist_cb, count);
 }
 
-static int bs_msg_add(bstore_t bs, struct timeval *tv, bmsg_t msg)
+static int bs_tkn_hist_update(bstore_t bs, time_t secs, time_t bin_width, btkn_id_t tkn_id)
+{
+	return __tkn_hist_update((bstore_sos_t)bs, secs, bin_width, tkn_id,
+				 NULL);
+}
+
+static int __hist_update_cmp(const void *_a, const void *_b)
+{
+	const struct bstore_hist_update_s *a = _a, *b = _b;
+#define __CMP(f) if (a->f != b->f) return a->f < b->f ? -1 : 1
+	__CMP(type);
+	__CMP(bin_width);
+	__CMP(secs);
+	__CMP(ptn_id);
+	__CMP(comp_id);
+	__CMP(tkn_pos);
+	__CMP(tkn_id);
+#undef __CMP
+	return 0;
+}
+
+/*
+ * Sort the updates by key so that the equal updates become adjacent, then
+ * visit each distinct key once with the number of repetitions. The sort order
+ * also follows the index key order, which keeps the B-tree traversals local.
+ */
+static int bs_hist_update_batch(bstore_t bs, int n,
+				struct bstore_hist_update_s ups[])
 {
-	msg_t msg_value;
 	bstore_sos_t bss = (bstore_sos_t)bs;
-	sos_obj_t msg_obj;
-	btkn_type_t type_id;
-	int rc = ENOMEM;
-	int i, wc;
+	bstore_hist_update_t up;
+	uint64_t count;
+	int i, j, rc, ret = 0;
+
+	qsort(ups, n, sizeof(ups[0]), __hist_update_cmp);
+	/* each key is updated atomically by a single sos_index_visit() */
+	for (i = 0; i < n; i = j) {
+		up = &ups[i];
+		for (j = i + 1; j < n; j++) {
+			if (__hist_update_cmp(up, &ups[j]))
+				break;
+		}
+		count = j - i;
+		switch (up->type) {
+		case BSTORE_HIST_UPDATE_TKN:
+			rc = __tkn_hist_update(bss, up->secs, up->bin_width,
+					       up->tkn_id, &count);
+			break;
+		case BSTORE_HIST_UPDATE_PTN:
+			rc = __ptn_hist_update(bss, up->ptn_id, up->comp_id,
+					       up->secs, up->bin_width,
+					       &count);
+			break;
+		case BSTORE_HIST_UPDATE_PTN_TKN:
+			rc = __ptn_tkn_add(bss, up->ptn_id, up->tkn_pos,
+					   up->tkn_id, &count);
+			break;
+		default:
+			rc = EINVAL;
+		}
+		if (rc && rc != EINPROGRESS)
+			ret = rc;
+	}
+	return ret;
+}
 
-	/* This code trashes the msg memory */
-	msg = bmsg_dup(msg);
-	if (!msg)
-		return ENOMEM;
+static int __msg_idx_insert(bstore_sos_t bss, sos_obj_t obj, msg_t msg,
+			    uint32_t idx);
+
+/* Remove the message from the indices in idx, the missing entries are OK */
+static void __msg_idx_remove(bstore_sos_t bss, sos_obj_t obj, msg_t msg,
+			     uint32_t idx)
+{
+	SOS_KEY(key);
 
-	if (bstore_lock)
-		pthread_mutex_lock(&bss->msg_lock);
+	if (idx & MSG_IDX_TC) {
+		sos_key_join(key, bss->tc_key_attr, msg->epoch_us, msg->comp_id);
+		sos_index_remove(sos_attr_index(bss->tc_key_attr), key, obj);
+	}
+	if (idx & MSG_IDX_PT) {
+		sos_key_join(key, bss->pt_key_attr, msg->ptn_id, msg->epoch_us);
+		sos_index_remove(sos_attr_index(bss->pt_key_attr), key, obj);
+	}
+	if (idx & MSG_IDX_CT) {
+		sos_key_join(key, bss->ct_key_attr, msg->comp_id, msg->epoch_us);
+		sos_index_remove(sos_attr_index(bss->ct_key_attr), key, obj);
+	}
+}
 
-	/* Only token id's are saved in the message. If it is a type-id, it
-	 * can be recovered from the ptn and thereby save space in the
-	 * message object
-	 */
-	wc = 0;
-	for (i = 0; i < msg->argc; i++) {
-		type_id = msg->argv[i] & BTKN_TYPE_ID_MASK;
-		if (type_id == BTKN_TYPE_WHITESPACE || btkn_id_is_wildcard(type_id)) {
-			/* wc <= i */
-			msg->argv[wc] = msg->argv[i];
-			wc++;
+/* Insert the message into the indices in idx, all or nothing */
+static int __msg_idx_insert(bstore_sos_t bss, sos_obj_t obj, msg_t msg,
+			    uint32_t idx)
+{
+	SOS_KEY(key);
+	uint32_t done = 0;
+	int rc = 0;
+
+	if (idx & MSG_IDX_TC) {
+		sos_key_join(key, bss->tc_key_attr, msg->epoch_us, msg->comp_id);
+		rc = sos_index_insert(sos_attr_index(bss->tc_key_attr), key, obj);
+		if (rc)
+			goto err;
+		done |= MSG_IDX_TC;
+	}
+	if (idx & MSG_IDX_PT) {
+		sos_key_join(key, bss->pt_key_attr, msg->ptn_id, msg->epoch_us);
+		rc = sos_index_insert(sos_attr_index(bss->pt_key_attr), key, obj);
+		if (rc)
+			goto err;
+		done |= MSG_IDX_PT;
+	}
+	if (idx & MSG_IDX_CT) {
+		sos_key_join(key, bss->ct_key_attr, msg->comp_id, msg->epoch_us);
+		rc = sos_index_insert(sos_attr_index(bss->ct_key_attr), key, obj);
+		if (rc)
+			goto err;
+	}
+	return 0;
+ err:
+	__msg_idx_remove(bss, obj, msg, done);
+	return rc;
+}
+
+/*
+ * Index a new message.
+ *
+ * The deferred indices are built by __msg_idx_scan() from tc_key in the
+ * epoch_us range [info->msg_idx_mark, msg_idx_limit). A message at or above
+ * the limit only goes into tc_key and is picked up by a later scan; the
+ * rwlock keeps the limit from moving over it before it is in tc_key. A late
+ * message below the limit waits for the scan in progress and is then indexed
+ * here if the scan has already passed its time.
+ */
+static int __msg_index(bstore_sos_t bss, sos_obj_t obj, msg_t msg)
+{
+	uint32_t idx = MSG_IDX_TC | bss->msg_idx_sync;
+	uint64_t max;
+	int rc;
+
+	if (!bss->msg_idx_deferred)
+		return __msg_idx_insert(bss, obj, msg, idx);
+
+	pthread_rwlock_rdlock(&bss->msg_idx_rwlock);
+	if (msg->epoch_us >= bss->msg_idx_limit) {
+		rc = __msg_idx_insert(bss, obj, msg, idx);
+		max = bss->msg_epoch_max;
+		while (!rc && max < msg->epoch_us &&
+		       !__sync_bool_compare_and_swap(&bss->msg_epoch_max,
+						     max, msg->epoch_us))
+			max = bss->msg_epoch_max;
+		pthread_rwlock_unlock(&bss->msg_idx_rwlock);
+		return rc;
+	}
+	pthread_rwlock_unlock(&bss->msg_idx_rwlock);
+
+	pthread_mutex_lock(&bss->msg_idx_scan_lock);
+	if (msg->epoch_us < bss->info->msg_idx_mark)
+		idx |= bss->msg_idx_deferred;
+	rc = __msg_idx_insert(bss, obj, msg, idx);
+	pthread_mutex_unlock(&bss->msg_idx_scan_lock);
+	return rc;
+}
+
+/* Remove a message from all of the indices that it is in */
+static void __msg_unindex(bstore_sos_t bss, sos_obj_t obj, msg_t msg)
+{
+	uint32_t idx = MSG_IDX_TC | bss->msg_idx_sync;
+
+	if (!bss->msg_idx_deferred) {
+		__msg_idx_remove(bss, obj, msg, idx);
+		return;
+	}
+	pthread_mutex_lock(&bss->msg_idx_scan_lock);
+	/* an interrupted scan may have indexed some of the messages at mark */
+	if (msg->epoch_us <= bss->info->msg_idx_mark)
+		idx |= bss->msg_idx_deferred;
+	__msg_idx_remove(bss, obj, msg, idx);
+	pthread_mutex_unlock(&bss->msg_idx_scan_lock);
+}
+
+/* Whether \c obj is in the index of \c attr under the key (\c a, \c b) */
+static int __msg_idx_has(sos_attr_t attr, uint64_t a, uint64_t b,
+			 sos_obj_t obj)
+{
+	sos_obj_ref_t ref = sos_obj_ref(obj), r;
+	sos_iter_t itr;
+	sos_key_t k;
+	uint64_t ka, kb;
+	SOS_KEY(key);
+	int rc, found = 0;
+
+	itr = sos_attr_iter_new(attr);
+	if (!itr)
+		return 0;
+	sos_key_join(key, attr, a, b);
+	/* only the duplicates of the key are visited */
+	for (rc = sos_iter_sup(itr, key); !rc; rc = sos_iter_next(itr)) {
+		k = sos_iter_key(itr);
+		if (!k)
+			break;
+		sos_key_split(k, attr, &ka, &kb);
+		sos_key_put(k);
+		if (ka != a || kb != b)
+			break;
+		r = sos_iter_ref(itr);
+		if (0 == memcmp(&r, &ref, sizeof(ref))) {
+			found = 1;
+			break;
+		}
+	}
+	sos_iter_free(itr);
+	return found;
+}
+
+/* The MSG_IDX_* of \c idx that \c obj is not in yet */
+static uint32_t __msg_idx_missing(bstore_sos_t bss, sos_obj_t obj, msg_t msg,
+				  uint32_t idx)
+{
+	if ((idx & MSG_IDX_PT) && __msg_idx_has(bss->pt_key_attr, msg->ptn_id,
+						msg->epoch_us, obj))
+		idx &= ~MSG_IDX_PT;
+	if ((idx & MSG_IDX_CT) && __msg_idx_has(bss->ct_key_attr, msg->comp_id,
+						msg->epoch_us, obj))
+		idx &= ~MSG_IDX_CT;
+	return idx;
+}
+
+/*
+ * Bring the deferred indices up to date: walk tc_key from the mark up to the
+ * latest message added, inserting each message into the deferred indices.
+ * The mark is advanced in INFO as the walk goes so that a restart after a
+ * crash resumes from where it stopped. The interrupted walk may have indexed
+ * some of the messages at the mark, so these are only inserted into the
+ * indices that they are not in yet.
+ */
+static int __msg_idx_scan(bstore_sos_t bss)
+{
+	sos_iter_t itr = NULL;
+	sos_obj_t obj;
+	msg_t msg;
+	SOS_KEY(key);
+	uint64_t start, limit, count = 0;
+	uint32_t idx;
+	int rc = 0;
+
+	pthread_mutex_lock(&bss->msg_idx_scan_lock);
+	pthread_rwlock_wrlock(&bss->msg_idx_rwlock);
+	if (bss->msg_idx_limit <= bss->msg_epoch_max)
+		bss->msg_idx_limit = bss->msg_epoch_max + 1;
+	limit = bss->msg_idx_limit;
+	pthread_rwlock_unlock(&bss->msg_idx_rwlock);
+
+	start = bss->info->msg_idx_mark;
+	if (start >= limit)
+		goto out;
+	itr = sos_attr_iter_new(bss->tc_key_attr);
+	if (!itr) {
+		rc = errno;
+		goto out;
+	}
+	sos_key_join(key, bss->tc_key_attr, start, (uint64_t)0);
+	for (rc = sos_iter_sup(itr, key); !rc; rc = sos_iter_next(itr)) {
+		obj = sos_iter_obj(itr);
+		msg = sos_obj_ptr(obj);
+		if (msg->epoch_us >= limit) {
+			sos_obj_put(obj);
+			break;
 		}
-		/* otherwise, skip */
+		/* all of the messages before this one are indexed */
+		bss->info->msg_idx_mark = msg->epoch_us;
+		idx = bss->msg_idx_deferred;
+		if (msg->epoch_us == start)
+			idx = __msg_idx_missing(bss, obj, msg, idx);
+		rc = __msg_idx_insert(bss, obj, msg, idx);
+		sos_obj_put(obj);
+		if (rc)
+			goto out;
+		count++;
 	}
+	bss->info->msg_idx_mark = limit;
+	rc = 0;
+	if (count)
+		bdebug("bstore_sos: %lu messages indexed\n", count);
+ out:
+	pthread_mutex_unlock(&bss->msg_idx_scan_lock);
+	if (itr)
+		sos_iter_free(itr);
+	if (rc)
+		berr("bstore_sos: message index scan error %d\n", rc);
+	return rc;
+}
 
-	assert(wc <= msg->argc);
-	msg->argc = wc;
+static void *__msg_idx_proc(void *arg)
+{
+	bstore_sos_t bss = arg;
+	struct timespec ts;
+
+	pthread_mutex_lock(&bss->msg_idx_stop_lock);
+	while (!bss->msg_idx_stop) {
+		pthread_mutex_unlock(&bss->msg_idx_stop_lock);
+		__msg_idx_scan(bss);
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec += bss->msg_idx_interval;
+		pthread_mutex_lock(&bss->msg_idx_stop_lock);
+		if (!bss->msg_idx_stop)
+			pthread_cond_timedwait(&bss->msg_idx_stop_cond,
+					       &bss->msg_idx_stop_lock, &ts);
+	}
+	pthread_mutex_unlock(&bss->msg_idx_stop_lock);
+	return NULL;
+}
+
+/*
+ * Set up the message indices from INFO and, for the writers of a store with
+ * deferred indices, start the thread building them.
+ */
+static int __msg_idx_start(bstore_sos_t bss, int flags)
+{
+	sos_iter_t itr;
+	sos_obj_t obj;
+	int rc;
+
+	bss->msg_idx_off = bss->info->msg_idx_off & MSG_IDX_SECONDARY;
+	bss->msg_idx_deferred = bss->info->msg_idx_deferred & MSG_IDX_SECONDARY
+				& ~bss->msg_idx_off;
+	bss->msg_idx_sync = MSG_IDX_SECONDARY
+			    & ~(bss->msg_idx_off | bss->msg_idx_deferred);
+	if (!bss->msg_idx_deferred || (flags & O_ACCMODE) == O_RDONLY) {
+		/* only the writers index */
+		bss->msg_idx_deferred = 0;
+		return 0;
+	}
+
+	pthread_rwlock_init(&bss->msg_idx_rwlock, NULL);
+	pthread_mutex_init(&bss->msg_idx_scan_lock, NULL);
+	pthread_mutex_init(&bss->msg_idx_stop_lock, NULL);
+	pthread_cond_init(&bss->msg_idx_stop_cond, NULL);
+	bss->msg_idx_interval = bgetenv_u64("BSTORE_SOS_IDX_INTERVAL",
+					    MSG_IDX_INTERVAL);
+	bss->msg_idx_limit = bss->info->msg_idx_mark;
+	/* the messages added before this open may not be indexed yet */
+	itr = sos_attr_iter_new(bss->tc_key_attr);
+	if (!itr)
+		return errno;
+	if (0 == sos_iter_end(itr)) {
+		obj = sos_iter_obj(itr);
+		bss->msg_epoch_max = ((msg_t)sos_obj_ptr(obj))->epoch_us;
+		sos_obj_put(obj);
+	}
+	sos_iter_free(itr);
+	rc = pthread_create(&bss->msg_idx_thread, NULL, __msg_idx_proc, bss);
+	if (rc)
+		return rc;
+	bss->msg_idx_running = 1;
+	return 0;
+}
+
+/* Stop the index thread and index the remaining messages */
+static void __msg_idx_stop(bstore_sos_t bss)
+{
+	if (!bss->msg_idx_running)
+		return;
+	pthread_mutex_lock(&bss->msg_idx_stop_lock);
+	bss->msg_idx_stop = 1;
+	pthread_cond_signal(&bss->msg_idx_stop_cond);
+	pthread_mutex_unlock(&bss->msg_idx_stop_lock);
+	pthread_join(bss->msg_idx_thread, NULL);
+	bss->msg_idx_running = 0;
+	__msg_idx_scan(bss);
+}
+
+/* Messages up to this many tokens are encoded on the stack */
+#define MSG_SCRATCH_TKNS 256
+
+static int __msg_add(bstore_sos_t bss, struct timeval *tv, bmsg_t msg)
+{
+	msg_t msg_value;
+	sos_obj_t msg_obj;
+	uint8_t _scratch[MSG_SCRATCH_TKNS * MSG_ARG_MAX_LEN];
+	uint8_t *scratch = _scratch;
+	uint32_t argc;
+	int rc = ENOMEM;
+
+	/*
+	 * The message may be shared with the other output plugins, so it is
+	 * encoded into a scratch buffer rather than in place.
+	 */
+	if (msg->argc > MSG_SCRATCH_TKNS) {
+		scratch = malloc(msg->argc * MSG_ARG_MAX_LEN);
+		if (!scratch)
+			return ENOMEM;
+	}
 
 	struct sos_value_s v_, *v;
-	size_t bmsg_sz = encode_msg(msg);
+	size_t bmsg_sz = encode_msg(msg, bss->msg_enc, scratch, &argc);
+
+	__part_roll(bss, bss->msg_sos, &bss->msg_part_end, tv->tv_sec);
 
 	/* Allocate and save this new message */
 	msg_obj = sos_obj_new_size(bss->message_schema, bmsg_sz + 512);
 	if (!msg_obj)
-		goto err_0;
+		goto out;
 
 	v = sos_array_new(&v_, bss->tkn_ids_attr, msg_obj, bmsg_sz);
 	if (!v)
@@ -3030,31 +4061,48 @@ static int bs_msg_add(bstore_t bs, struct timeval *tv, bmsg_t msg)
 
 	msg_value = sos_obj_ptr(msg_obj);
 
-	msg_value->tkn_count = msg->argc;
+	msg_value->tkn_count = ((uint64_t)bss->msg_enc << MSG_ENC_SHIFT) | argc;
 	msg_value->epoch_us = tv->tv_sec * 1000000 + tv->tv_usec;
 	msg_value->ptn_id = msg->ptn_id;
 	msg_value->comp_id = msg->comp_id;
 
-	sos_value_memcpy(v, &msg->argv[0], bmsg_sz);
+	sos_value_memcpy(v, scratch, bmsg_sz);
 	sos_value_put(v);
-	rc = sos_obj_index(msg_obj);
+	rc = __msg_index(bss, msg_obj, msg_value);
 	if (rc)
 		goto err_1;
 	sos_obj_put(msg_obj);
-	if (bstore_lock)
-		pthread_mutex_unlock(&bss->msg_lock);
-	bmsg_free(msg);
-	return 0;
+	goto out;
  err_1:
 	sos_obj_delete(msg_obj);
 	sos_obj_put(msg_obj);
- err_0:
-	bmsg_free(msg);
-	if (bstore_lock)
-		pthread_mutex_unlock(&bss->msg_lock);
+ out:
+	if (scratch != _scratch)
+		free(scratch);
 	return rc;
 }
 
+static int bs_msg_add(bstore_t bs, struct timeval *tv, bmsg_t msg)
+{
+	bstore_sos_t bss = (bstore_sos_t)bs;
+
+	return __msg_add(bss, tv, msg);
+}
+
+static int bs_msg_add_batch(bstore_t bs, int n, struct timeval tv[],
+			    bmsg_t msgs[])
+{
+	bstore_sos_t bss = (bstore_sos_t)bs;
+	int i, rc, ret = 0;
+
+	for (i = 0; i < n; i++) {
+		rc = __msg_add(bss, &tv[i], msgs[i]);
+		if (rc)
+			ret = rc;
+	}
+	return ret;
+}
+
  static int __ptn_tkn_iter_check(bsos_iter_t i)
  {
 	sos_key_t key;
@@ -5094,6 +6142,7 @@ int bs_msg_iter_update(bmsg_iter_t iter, bmsg_t new_msg)
 	bstore_sos_t bss = (bstore_sos_t)i->bs;
 	sos_obj_t old_msg_obj = sos_iter_obj(i->iter);
 	sos_obj_t ptn_obj;
+	pthread_mutex_t *lock;
 	ptn_t sptn;
 	msg_t omsg;
 	SOS_KEY(key);
@@ -5110,9 +6159,14 @@ int bs_msg_iter_update(bmsg_iter_t iter, bmsg_t new_msg)
 	/* undo ptn->count */
 	sos_key_set(key, &omsg->ptn_id, sizeof(omsg->ptn_id));
 	ptn_obj = sos_obj_find(bss->ptn_id_attr, key);
+	lock = __ptn_obj_lock(bss, ptn_obj);
+	if (lock)
+		pthread_mutex_lock(lock);
 	sptn = sos_obj_ptr(ptn_obj);
 	sptn->count--;
 	sptn = NULL;
+	if (lock)
+		pthread_mutex_unlock(lock);
 	sos_obj_put(ptn_obj);
 
 	if (0 == (i->has_hist & HAS_HIST_INIT)) {
@@ -5179,7 +6233,7 @@ int bs_msg_iter_update(bmsg_iter_t iter, bmsg_t new_msg)
 	/* advance iterator position before deleting the object */
 	sos_iter_next(i->iter);
 	/* delete old msg */
-	sos_obj_remove(old_msg_obj);
+	__msg_unindex(bss, old_msg_obj, omsg);
 	sos_obj_delete(old_msg_obj);
 	sos_obj_put(old_msg_obj); /* put ref from sos_iter_obj() */
 	return 0;
@@ -5322,6 +6376,10 @@ static struct bstore_plugin_s plugin = {
 
 	.interface_version = BSTORE_INTERFACE_VERSION_INITIALIZER,
 	.msg_iter_update = bs_msg_iter_update,
+
+	.ptn_stat_update = bs_ptn_stat_update,
+	.msg_add_batch = bs_msg_add_batch,
+	.hist_update_batch = bs_hist_update_batch,
 };
 
 bstore_plugin_t get_plugin(void)
@@ -18,6 +18,15 @@ typedef struct craylog_parser {
 	int cpos;		/* character position */
 	struct bstr *input;	/* current input string */
 	struct yy_buffer_state *buffer_state;
+	void *scanner;		/* reentrant flex scanner state */
+	barena_t arena;		/* arena of the entry being parsed */
+	struct bwq_entry *wqe;	/* entry being parsed */
+	char *line;		/* the sanitized input, in the arena; the
+				 * tokens are slices of it */
+	int eol;		/* the flex scanner is at the end of the line */
+	char *bbuf;		/* the lines of the batch being parsed, for the
+				 * flex scanner (see craylog_parse_batch()) */
+	size_t bbuf_sz;
 } *craylog_parser_t;
 
 #define YYSTYPE btkn_t
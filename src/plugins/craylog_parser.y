@@ -3,6 +3,7 @@
 #define _GNU_SOURCE
 #endif
 #include <stdio.h>
+#include <ctype.h>
 #include <time.h>
 #include <string.h>
 #include <assert.h>
@@ -121,7 +122,7 @@ void init_ts_ym()
 }
 
 void yyerror(struct craylog_parser *parser, struct bstr *input,
-	     bwq_entry_t *pwqe, const char *str)
+	     bwq_entry_t *pwqe, void *scanner, const char *str)
 {
 	int pos;
 	fprintf(stderr, "%s\n", input->cstr);
@@ -129,10 +130,8 @@ void yyerror(struct craylog_parser *parser, struct bstr *input,
 	    fprintf(stderr, " ");
 	fprintf(stderr, "^\n");
 	fprintf(stderr, "%s\n", str);
-	if (*pwqe) {
-	    binq_entry_free(*pwqe);
-	    *pwqe = NULL;
-	}
+	/* The partial entry is released with the arena */
+	*pwqe = NULL;
 }
 
 static const char* craylog_get_version(binp_parser_t p)
@@ -145,8 +144,12 @@ static const char *craylog_get_name(binp_parser_t p)
 	return "craylog_parser";
 }
 
+int yylex_destroy(void *);
+
 void craylog_release(binp_parser_t p)
 {
+	yylex_destroy(((craylog_parser_t)p)->scanner);
+	free(((craylog_parser_t)p)->bbuf);
 	free(p);
 }
 
@@ -251,26 +254,147 @@ static int parse_timestamp(char *time_str, struct timeval *tv)
 	return 1;
 }
 
-int yyparse(craylog_parser_t parser, struct bstr *input, bwq_entry_t *pwqe);
-void yy_delete_buffer(struct yy_buffer_state *);
-int yylex(void*, craylog_parser_t, struct bstr *);
+int yyparse(craylog_parser_t parser, struct bstr *input, bwq_entry_t *pwqe,
+		void *scanner);
+void yy_delete_buffer(struct yy_buffer_state *, void *);
+struct yy_buffer_state *yy_scan_buffer(char *, size_t, void *);
+int yylex(void*, craylog_parser_t, struct bstr *, void *);
+int yylex_init(void **);
+
+/*
+ * Prepare \c msg for the lexer in place: terminate it (also at the trailing
+ * '\n'), and replace the non-printable characters with 'X'. Returns the
+ * length of the resulting string.
+ */
+static int craylog_sanitize(struct bstr *msg)
+{
+	int i;
+	msg->cstr[msg->blen] = '\0';
+	if (msg->blen && msg->cstr[msg->blen-1] == '\n')
+		msg->cstr[msg->blen-1] = '\0';
+	for (i = 0; i < msg->blen; i++) {
+		if (msg->cstr[i] == '\0')
+			break;
+		if (!isprint(msg->cstr[i])
+		    || ((unsigned char)msg->cstr[i] > 0x7f))
+			msg->cstr[i] = 'X';
+	}
+	return i;
+}
 
+/*
+ * Parse the line \c s, already sanitized to \c len characters. The flex
+ * scanner either reads parser->line, or is at the start of the line in the
+ * batch buffer (see craylog_parse_batch()).
+ */
 static binp_result_t
-craylog_parse(binp_parser_t p, struct bstr *s, struct bwq_entry **pent)
+__parse_line(craylog_parser_t sp, struct bstr *s, int len,
+	     struct bwq_entry **pent)
 {
-	craylog_parser_t sp = (craylog_parser_t)p;
 	int rc;
 	*pent = NULL;
+	sp->eol = 0;
+	sp->arena = barena_get();
+	if (!sp->arena)
+		return BINP_ERR_RESOURCE;
+	/* One copy of the line lives with the entry; the tokens are slices of
+	 * it */
+	sp->line = barena_alloc(sp->arena, len + 1);
+	if (!sp->line) {
+		barena_put(sp->arena);
+		sp->arena = NULL;
+		return BINP_ERR_RESOURCE;
+	}
+	memcpy(sp->line, s->cstr, len + 1);
+	sp->cpos = 0;
+	rc = yyparse(sp, s, pent, sp->scanner);
+	if (!*pent) {
+		/* Syntax error: drop the partial entry with its arena */
+		sp->wqe = NULL;
+		barena_put(sp->arena);
+	}
+	sp->arena = NULL;
+	sp->line = NULL;
+	if (rc)
+	    return BINP_ERR_SYNTAX;
+	return BINP_OK;
+}
+
+static binp_result_t
+craylog_parse(binp_parser_t p, struct bstr *s, struct bwq_entry **pent)
+{
+	craylog_parser_t sp = (craylog_parser_t)p;
 	if (sp->buffer_state) {
 		/* The previous call did not reset the lexer state */
-		yy_delete_buffer(sp->buffer_state);
+		yy_delete_buffer(sp->buffer_state, sp->scanner);
 		sp->cpos = 0;
 		sp->buffer_state = NULL;
 	}
-	rc = yyparse(sp, s, pent);
-	if (rc)
-	    return BINP_ERR_SYNTAX;
-	return BINP_OK;
+	return __parse_line(sp, s, craylog_sanitize(s), pent);
+}
+
+/*
+ * The flex scanner reads all of the lines of the batch from one buffer, the
+ * lines separated by '\n', instead of getting a buffer for each line.
+ */
+static void
+craylog_parse_batch(binp_parser_t p, struct bstr **lines, int n,
+		    struct bwq_entry **ents, binp_result_t *rcs)
+{
+	craylog_parser_t sp = (craylog_parser_t)p;
+	size_t sz, off;
+	char *buf;
+	int i, len;
+
+	if (sp->buffer_state) {
+		yy_delete_buffer(sp->buffer_state, sp->scanner);
+		sp->buffer_state = NULL;
+	}
+	/* yy_scan_buffer() needs two '\0' at the end */
+	sz = 2;
+	for (i = 0; i < n; i++)
+		sz += craylog_sanitize(lines[i]) + 1;
+	if (sz > sp->bbuf_sz) {
+		buf = realloc(sp->bbuf, sz);
+		if (!buf)
+			goto one_by_one;
+		sp->bbuf = buf;
+		sp->bbuf_sz = sz;
+	}
+	off = 0;
+	for (i = 0; i < n; i++) {
+		len = strlen(lines[i]->cstr);
+		memcpy(sp->bbuf + off, lines[i]->cstr, len);
+		sp->bbuf[off + len] = '\n';
+		off += len + 1;
+	}
+	sp->bbuf[off] = sp->bbuf[off + 1] = '\0';
+	/* If this fails, the lexer scans each line from parser->line */
+	sp->buffer_state = yy_scan_buffer(sp->bbuf, sz, sp->scanner);
+	off = 0;
+	for (i = 0; i < n; i++) {
+		len = strlen(lines[i]->cstr);
+		rcs[i] = __parse_line(sp, lines[i], len, &ents[i]);
+		off += len + 1;
+		if (sp->eol || !sp->buffer_state || i == n - 1)
+			continue;
+		/* The parse stopped before the end of the line: restart the
+		 * scanner at the next one */
+		yy_delete_buffer(sp->buffer_state, sp->scanner);
+		sp->buffer_state = yy_scan_buffer(sp->bbuf + off, sz - off,
+						  sp->scanner);
+	}
+	if (sp->buffer_state) {
+		yy_delete_buffer(sp->buffer_state, sp->scanner);
+		sp->buffer_state = NULL;
+	}
+	return;
+
+ one_by_one:
+	/* The lines are already sanitized */
+	for (i = 0; i < n; i++)
+		rcs[i] = __parse_line(sp, lines[i], strlen(lines[i]->cstr),
+				      &ents[i]);
 }
 
 static struct craylog_parser craylog_parser = {
@@ -279,6 +403,7 @@ static struct craylog_parser craylog_parser = {
 		.get_version = craylog_get_version,
 		.parse = craylog_parse,
 		.release = craylog_release,
+		.parse_batch = craylog_parse_batch,
 	},
 	.cpos = 0
 };
@@ -289,12 +414,18 @@ binp_parser_t binp_get_parser(void *d)
 	if (!p)
 		return NULL;
 	*p = craylog_parser;
+	if (yylex_init(&p->scanner)) {
+		free(p);
+		return NULL;
+	}
 	return &p->base;
 }
 
-struct bwq_entry *alloc_wqe()
+/* The entry, its tokens and its hostname are all in the parser arena */
+struct bwq_entry *alloc_wqe(craylog_parser_t parser)
 {
-    struct bwq_entry *wqe = calloc(1, sizeof *wqe);
+    struct bwq_entry *wqe = barena_zalloc(parser->arena, sizeof *wqe);
+    wqe->arena = parser->arena;
     wqe->data.in.format = BINQ_BTKN_QUEUE;
     wqe->data.in.type = BINQ_DATA_MSG;
     TAILQ_INIT(&wqe->data.in.tkn_q);
@@ -303,8 +434,6 @@ struct bwq_entry *alloc_wqe()
 
 void enqueue_token(struct bwq_entry *wqe, btkn_t tkn, btkn_type_t typ);
 
-struct bwq_entry *yy_wqe = NULL;
-
 %}
 
 %define api.pure full
@@ -313,6 +442,8 @@ struct bwq_entry *yy_wqe = NULL;
 %parse-param {craylog_parser_t parser}
 %parse-param {struct bstr *input}
 %parse-param {bwq_entry_t *pwqe}
+%lex-param {void *scanner}
+%parse-param {void *scanner}
 
 %token PRIORITY_TKN
 %token VERSION_TKN
@@ -349,39 +480,34 @@ struct bwq_entry *yy_wqe = NULL;
 
 log_msg:	msg_header
 		{
-		    *pwqe = yy_wqe;
-		    yy_wqe = NULL;
+		    *pwqe = parser->wqe;
+		    parser->wqe = NULL;
  		}
 		| msg_header msg_token_list
 		{
-		    *pwqe = yy_wqe;
-		    yy_wqe = NULL;
+		    *pwqe = parser->wqe;
+		    parser->wqe = NULL;
  		}
 		;
 
 timestamp: 	TIMESTAMP_TKN
 		{
-		    if (!yy_wqe)
-			yy_wqe = alloc_wqe();
-		    parse_timestamp($1->tkn_str->cstr, &yy_wqe->data.in.tv);
-		    btkn_free($1);
+		    if (!parser->wqe)
+			parser->wqe = alloc_wqe(parser);
+		    if (0 == barena_btkn_materialize(parser->arena, $1))
+			parse_timestamp($1->tkn_str->cstr,
+					&parser->wqe->data.in.tv);
 		}
 		;
 
 ts_wspace:	timestamp WHITESPACE_TKN
-		{
-		    btkn_free($2);
-		}
 		;
 
 prio_vers:	PRIORITY_TKN DEC_INT_TKN WHITESPACE_TKN
 		{
-		    if (!yy_wqe)
-			yy_wqe = alloc_wqe();
+		    if (!parser->wqe)
+			parser->wqe = alloc_wqe(parser);
 		    /* we don't enqueue these tokens to the token string */
-		    btkn_free($1);
-		    btkn_free($2);
-		    btkn_free($3);
 		}
 		;
 
@@ -390,88 +516,72 @@ hostname:	TEXT_TKN | IP4_ADDR_TKN | IP6_ADDR_TKN | CRAY_HOST_TKN | CRAY_NID_TKN
 
 encap_host:	| SEPARATOR_TKN hostname SEPARATOR_TKN
 		{
-		    enqueue_token(yy_wqe, $1, BTKN_TYPE_SEPARATOR); /* [( */
-		    enqueue_token(yy_wqe, $2, BTKN_TYPE_HOSTNAME);
-		    enqueue_token(yy_wqe, $3, BTKN_TYPE_SEPARATOR); /* ]) */
+		    enqueue_token(parser->wqe, $1, BTKN_TYPE_SEPARATOR); /* [( */
+		    enqueue_token(parser->wqe, $2, BTKN_TYPE_HOSTNAME);
+		    enqueue_token(parser->wqe, $3, BTKN_TYPE_SEPARATOR); /* ]) */
 		}
 		;
 
 hwerr_hdr: 	timestamp WHITESPACE_TKN SEPARATOR_TKN WHITESPACE_TKN
 		TEXT_TKN
 		{
-		    enqueue_token(yy_wqe, $3, BTKN_TYPE_SEPARATOR);
-		    enqueue_token(yy_wqe, $4, BTKN_TYPE_WHITESPACE);
-		    enqueue_token(yy_wqe, $5, BTKN_TYPE_WORD); /* HWERR */
+		    enqueue_token(parser->wqe, $3, BTKN_TYPE_SEPARATOR);
+		    enqueue_token(parser->wqe, $4, BTKN_TYPE_WHITESPACE);
+		    enqueue_token(parser->wqe, $5, BTKN_TYPE_WORD); /* HWERR */
 		} encap_host
 		;
 
 bsd_hdr:	PRIORITY_TKN timestamp WHITESPACE_TKN BSD_SVC_TKN SEPARATOR_TKN
 		{
-		    btkn_free($1); /* free the PRIORITY_TKN */
-		    btkn_free($3); /* free the WHITESPACE_TKN */
-		    enqueue_token(yy_wqe, $4, BTKN_TYPE_SERVICE);
-		    enqueue_token(yy_wqe, $5, BTKN_TYPE_SEPARATOR);
+		    enqueue_token(parser->wqe, $4, BTKN_TYPE_SERVICE);
+		    enqueue_token(parser->wqe, $5, BTKN_TYPE_SEPARATOR);
 		}
 		;
 
 /* log message w/o priority and version */
 ts_host:	timestamp WHITESPACE_TKN hostname
 		{
-		    btkn_free($2); /* free the WHITESPACE_TKN */
-		    enqueue_token(yy_wqe, $3, BTKN_TYPE_HOSTNAME);
+		    enqueue_token(parser->wqe, $3, BTKN_TYPE_HOSTNAME);
 		}
 		| timestamp WHITESPACE_TKN encap_host
-		{
-		    btkn_free($2); /* free the WHITESPACE_TKN */
-		}
 		;
 
 /* Missing syslog version */
 prio_host:	PRIORITY_TKN timestamp WHITESPACE_TKN hostname
 		{
-		    btkn_free($1); /* free the PRIORITY_TKN */
-		    btkn_free($3); /* free the WHITESPACE_TKN */
-		    enqueue_token(yy_wqe, $4, BTKN_TYPE_HOSTNAME);
+		    enqueue_token(parser->wqe, $4, BTKN_TYPE_HOSTNAME);
 		}
 		| PRIORITY_TKN timestamp WHITESPACE_TKN encap_host
-		{
-		    btkn_free($1); /* free the PRIORITY_TKN */
-		    btkn_free($3); /* free the WHITESPACE_TKN */
-		}
 		;
 
 /* log message with priority and version */
 pv_ts_host:	prio_vers timestamp WHITESPACE_TKN hostname
 		{
-		    btkn_free($3); /* free the WHITESPACE_TKN */
-		    enqueue_token(yy_wqe, $4, BTKN_TYPE_HOSTNAME);
+		    enqueue_token(parser->wqe, $4, BTKN_TYPE_HOSTNAME);
 		}
 		| prio_vers timestamp WHITESPACE_TKN encap_host
-		{
-		    btkn_free($3); /* free the WHITESPACE_TKN */
-		}
 		;
 
 pv_ts_host_pid:		/* service name is missing/nul */
 		pv_ts_host WHITESPACE_TKN DEC_INT_TKN
 		{
-		    enqueue_token(yy_wqe, $2, BTKN_TYPE_WHITESPACE);
-		    enqueue_token(yy_wqe, $3, BTKN_TYPE_PID);
+		    enqueue_token(parser->wqe, $2, BTKN_TYPE_WHITESPACE);
+		    enqueue_token(parser->wqe, $3, BTKN_TYPE_PID);
 		}
 		;
 
 pv_ts_host_svc:	pv_ts_host WHITESPACE_TKN TEXT_TKN
 		{
-		    enqueue_token(yy_wqe, $2, BTKN_TYPE_WHITESPACE);
-		    enqueue_token(yy_wqe, $3, BTKN_TYPE_SERVICE);
+		    enqueue_token(parser->wqe, $2, BTKN_TYPE_WHITESPACE);
+		    enqueue_token(parser->wqe, $3, BTKN_TYPE_SERVICE);
 		}
 		;
 
 pv_ts_host_svc_pid:
 		pv_ts_host_svc WHITESPACE_TKN DEC_INT_TKN
 		{
-		    enqueue_token(yy_wqe, $2, BTKN_TYPE_WHITESPACE);
-		    enqueue_token(yy_wqe, $3, BTKN_TYPE_PID);
+		    enqueue_token(parser->wqe, $2, BTKN_TYPE_WHITESPACE);
+		    enqueue_token(parser->wqe, $3, BTKN_TYPE_PID);
 		}
 		;
 
@@ -484,29 +594,29 @@ msg_header:	ts_wspace
 	|	pv_ts_host
 	|	pv_ts_host WHITESPACE_TKN
 		{
-		    enqueue_token(yy_wqe, $2, BTKN_TYPE_WHITESPACE);
+		    enqueue_token(parser->wqe, $2, BTKN_TYPE_WHITESPACE);
 		}
 	|	pv_ts_host SEPARATOR_TKN
 		{
-		    enqueue_token(yy_wqe, $2, BTKN_TYPE_SEPARATOR);
+		    enqueue_token(parser->wqe, $2, BTKN_TYPE_SEPARATOR);
 		}
 	|	pv_ts_host_pid
 	|	pv_ts_host_pid WHITESPACE_TKN
 		{
-		    enqueue_token(yy_wqe, $2, BTKN_TYPE_WHITESPACE);
+		    enqueue_token(parser->wqe, $2, BTKN_TYPE_WHITESPACE);
 		}
 	|	pv_ts_host_pid SEPARATOR_TKN
 		{
-		    enqueue_token(yy_wqe, $2, BTKN_TYPE_SEPARATOR);
+		    enqueue_token(parser->wqe, $2, BTKN_TYPE_SEPARATOR);
 		}
 	| 	pv_ts_host_svc
 	| 	pv_ts_host_svc WHITESPACE_TKN
 		{
-		    enqueue_token(yy_wqe, $2, BTKN_TYPE_WHITESPACE);
+		    enqueue_token(parser->wqe, $2, BTKN_TYPE_WHITESPACE);
 		}
 	| 	pv_ts_host_svc SEPARATOR_TKN
 		{
-		    enqueue_token(yy_wqe, $2, BTKN_TYPE_SEPARATOR);
+		    enqueue_token(parser->wqe, $2, BTKN_TYPE_SEPARATOR);
 		}
 	|	pv_ts_host_svc_pid
 		;
@@ -515,36 +625,36 @@ msg_token_list:	msg_token
 	|	msg_token_list msg_token
 	;
 
-msg_token:	TEXT_TKN	{ enqueue_token(yy_wqe, $1, BTKN_TYPE_TEXT); }
-	|	PRIORITY_TKN	{ enqueue_token(yy_wqe, $1, BTKN_TYPE_PRIORITY); }
-	|	VERSION_TKN	{ enqueue_token(yy_wqe, $1, BTKN_TYPE_VERSION); }
-	|	SERVICE_TKN	{ enqueue_token(yy_wqe, $1, BTKN_TYPE_SERVICE); }
-	|	PID_TKN		{ enqueue_token(yy_wqe, $1, BTKN_TYPE_PID); }
-	|	TIMESTAMP_TKN	{ enqueue_token(yy_wqe, $1, BTKN_TYPE_TIMESTAMP); }
-	|	HOSTNAME_TKN	{ enqueue_token(yy_wqe, $1, BTKN_TYPE_HOSTNAME); }
-	|	IP4_ADDR_TKN	{ enqueue_token(yy_wqe, $1, BTKN_TYPE_IP4_ADDR); }
-	|	IP6_ADDR_TKN	{ enqueue_token(yy_wqe, $1, BTKN_TYPE_IP6_ADDR); }
-	|	ETH_ADDR_TKN	{ enqueue_token(yy_wqe, $1, BTKN_TYPE_ETH_ADDR); }
-	|	HEX_INT_TKN	{ enqueue_token(yy_wqe, $1, BTKN_TYPE_NUMBER); }
-	|	DEC_INT_TKN	{ enqueue_token(yy_wqe, $1, BTKN_TYPE_NUMBER); }
-	|	FLOAT_TKN	{ enqueue_token(yy_wqe, $1, BTKN_TYPE_NUMBER); }
-	|	URL_TKN		{ enqueue_token(yy_wqe, $1, BTKN_TYPE_URL); }
-	|	PATH_TKN	{ enqueue_token(yy_wqe, $1, BTKN_TYPE_PATH); }
-	|	SEPARATOR_TKN	{ enqueue_token(yy_wqe, $1, BTKN_TYPE_SEPARATOR); }
-	|	WHITESPACE_TKN	{ enqueue_token(yy_wqe, $1, BTKN_TYPE_WHITESPACE); }
-	|	DEC_LIST_TKN	{ enqueue_token(yy_wqe, $1, BTKN_TYPE_DEC_LIST); }
-	|	HEX_DUMP_TKN	{ enqueue_token(yy_wqe, $1, BTKN_TYPE_HEX_DUMP); }
-	|	CHAR_DUMP_TKN	{ enqueue_token(yy_wqe, $1, BTKN_TYPE_CHAR_DUMP); }
-	|	NID_LIST_TKN	{ enqueue_token(yy_wqe, $1, BTKN_TYPE_NID_LIST); }
-	|	HASH_LIST_TKN	{ enqueue_token(yy_wqe, $1, BTKN_TYPE_HASH_LIST); }
-	|	CRAY_RTR_LINK_TKN	{ enqueue_token(yy_wqe, $1, BTKN_TYPE_ASIC_RTR_LINK); }
-	|	CRAY_RTR_NODE_TKN	{ enqueue_token(yy_wqe, $1, BTKN_TYPE_ASIC_RTR_NODE); }
-	|	CRAY_HOST_TKN	{ enqueue_token(yy_wqe, $1, BTKN_TYPE_HOSTNAME); }
-	|	CRAY_SLOT_TKN	{ enqueue_token(yy_wqe, $1, BTKN_TYPE_SLOT); }
-	|	CRAY_NID_TKN	{ enqueue_token(yy_wqe, $1, BTKN_TYPE_HOSTNAME); }
-	|	CRAY_SLOT_LIST_TKN	{ enqueue_token(yy_wqe, $1, BTKN_TYPE_SLOT_LIST); }
-	|	CRAY_HOST_LIST_TKN	{ enqueue_token(yy_wqe, $1, BTKN_TYPE_HOST_LIST); }
-	|	CRAY_RTR_LIST_TKN	{ enqueue_token(yy_wqe, $1, BTKN_TYPE_RTR_LIST); }
+msg_token:	TEXT_TKN	{ enqueue_token(parser->wqe, $1, BTKN_TYPE_TEXT); }
+	|	PRIORITY_TKN	{ enqueue_token(parser->wqe, $1, BTKN_TYPE_PRIORITY); }
+	|	VERSION_TKN	{ enqueue_token(parser->wqe, $1, BTKN_TYPE_VERSION); }
+	|	SERVICE_TKN	{ enqueue_token(parser->wqe, $1, BTKN_TYPE_SERVICE); }
+	|	PID_TKN		{ enqueue_token(parser->wqe, $1, BTKN_TYPE_PID); }
+	|	TIMESTAMP_TKN	{ enqueue_token(parser->wqe, $1, BTKN_TYPE_TIMESTAMP); }
+	|	HOSTNAME_TKN	{ enqueue_token(parser->wqe, $1, BTKN_TYPE_HOSTNAME); }
+	|	IP4_ADDR_TKN	{ enqueue_token(parser->wqe, $1, BTKN_TYPE_IP4_ADDR); }
+	|	IP6_ADDR_TKN	{ enqueue_token(parser->wqe, $1, BTKN_TYPE_IP6_ADDR); }
+	|	ETH_ADDR_TKN	{ enqueue_token(parser->wqe, $1, BTKN_TYPE_ETH_ADDR); }
+	|	HEX_INT_TKN	{ enqueue_token(parser->wqe, $1, BTKN_TYPE_NUMBER); }
+	|	DEC_INT_TKN	{ enqueue_token(parser->wqe, $1, BTKN_TYPE_NUMBER); }
+	|	FLOAT_TKN	{ enqueue_token(parser->wqe, $1, BTKN_TYPE_NUMBER); }
+	|	URL_TKN		{ enqueue_token(parser->wqe, $1, BTKN_TYPE_URL); }
+	|	PATH_TKN	{ enqueue_token(parser->wqe, $1, BTKN_TYPE_PATH); }
+	|	SEPARATOR_TKN	{ enqueue_token(parser->wqe, $1, BTKN_TYPE_SEPARATOR); }
+	|	WHITESPACE_TKN	{ enqueue_token(parser->wqe, $1, BTKN_TYPE_WHITESPACE); }
+	|	DEC_LIST_TKN	{ enqueue_token(parser->wqe, $1, BTKN_TYPE_DEC_LIST); }
+	|	HEX_DUMP_TKN	{ enqueue_token(parser->wqe, $1, BTKN_TYPE_HEX_DUMP); }
+	|	CHAR_DUMP_TKN	{ enqueue_token(parser->wqe, $1, BTKN_TYPE_CHAR_DUMP); }
+	|	NID_LIST_TKN	{ enqueue_token(parser->wqe, $1, BTKN_TYPE_NID_LIST); }
+	|	HASH_LIST_TKN	{ enqueue_token(parser->wqe, $1, BTKN_TYPE_HASH_LIST); }
+	|	CRAY_RTR_LINK_TKN	{ enqueue_token(parser->wqe, $1, BTKN_TYPE_ASIC_RTR_LINK); }
+	|	CRAY_RTR_NODE_TKN	{ enqueue_token(parser->wqe, $1, BTKN_TYPE_ASIC_RTR_NODE); }
+	|	CRAY_HOST_TKN	{ enqueue_token(parser->wqe, $1, BTKN_TYPE_HOSTNAME); }
+	|	CRAY_SLOT_TKN	{ enqueue_token(parser->wqe, $1, BTKN_TYPE_SLOT); }
+	|	CRAY_NID_TKN	{ enqueue_token(parser->wqe, $1, BTKN_TYPE_HOSTNAME); }
+	|	CRAY_SLOT_LIST_TKN	{ enqueue_token(parser->wqe, $1, BTKN_TYPE_SLOT_LIST); }
+	|	CRAY_HOST_LIST_TKN	{ enqueue_token(parser->wqe, $1, BTKN_TYPE_HOST_LIST); }
+	|	CRAY_RTR_LIST_TKN	{ enqueue_token(parser->wqe, $1, BTKN_TYPE_RTR_LIST); }
 	;
 
 %%
@@ -555,15 +665,17 @@ void enqueue_token(struct bwq_entry *wqe, btkn_t tkn, btkn_type_t typ)
 	int rc;
 	btkn_tailq_entry_t e;
 
-	e = malloc(sizeof *e);
+	e = barena_alloc(wqe->arena, sizeof *e);
 	assert(e);
 	e->tkn = tkn;
 	tkn->tkn_type_mask = BTKN_TYPE_MASK(typ);
 	TAILQ_INSERT_TAIL(&wqe->data.in.tkn_q, e, link);
 	wqe->data.in.tkn_count++;
 
-	if (typ == BTKN_TYPE_HOSTNAME)
-		wqe->data.in.hostname = bstr_dup(tkn->tkn_str);
+	/* The hostname is the only token text used as a bstr */
+	if (typ == BTKN_TYPE_HOSTNAME &&
+	    0 == barena_btkn_materialize(wqe->arena, tkn))
+		wqe->data.in.hostname = tkn->tkn_str; /* same lifetime */
 }
 
 static void __attribute__ ((constructor)) parser_lib_init(void)
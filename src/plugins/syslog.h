@@ -12,14 +12,63 @@ enum syslog_parser_state {
 	STATE_EOF,
 	STATE_ERROR,
 };
+/* A token found by the fast tokenizer (see syslog_fastlex.c) */
+struct syslog_ftkn {
+	int type;		/* token type (e.g. TEXT_TKN) */
+	int off;		/* offset in the message */
+	int len;
+};
+
+/*
+ * The hour of the last timestamp parsed (see parse_timestamp()). The
+ * timestamps of the same hour only need the minutes and seconds (and the
+ * offset) added to \c hour.
+ */
+struct syslog_ts_cache {
+	char key[32];		/* timestamp up to the hour, e.g. "May 29 18" */
+	int key_len;		/* 0 if the cache is empty */
+	int tz;			/* the timestamps have ".US" and an offset */
+	time_t hour;		/* Unix time of minute 0, second 0 of the hour */
+	time_t expire;		/* the entry is stale from then on, 0 for never */
+};
+
 typedef struct syslog_parser {
 	struct binp_parser base;
 	enum syslog_parser_state state;
 	int cpos;		/* character position */
 	struct bstr *input;	/* current input string */
 	struct yy_buffer_state *buffer_state;
+	void *scanner;		/* reentrant flex scanner state */
+	barena_t arena;		/* arena of the entry being parsed */
+	struct bwq_entry *wqe;	/* entry being parsed */
+	char *line;		/* the sanitized input, in the arena; the
+				 * tokens are slices of it */
+	int eol;		/* the flex scanner is at the end of the line */
+	char *bbuf;		/* the lines of the batch being parsed, for the
+				 * flex scanner (see syslog_parse_batch()) */
+	size_t bbuf_sz;
+	int fast_lex;		/* use the fast tokenizer (lexer=fast) */
+	struct syslog_ftkn *ftkn; /* the fast tokenizer tokens */
+	int ftkn_n;		/* number of tokens, -1 to use flex */
+	int ftkn_max;
+	int ftkn_idx;		/* next token to return */
+	struct syslog_ts_cache ts_cache;
 } *syslog_parser_t;
 
+/*
+ * Prepare \c msg for the lexers in place: terminate it (also at the
+ * trailing '\n'), and replace the non-printable characters with 'X'.
+ * Returns the length of the resulting string.
+ */
+int syslog_sanitize(struct bstr *msg);
+
+/*
+ * Tokenize \c parser->line (of length \c len) with the fast tokenizer for
+ * the next parse. Returns 0 on success, or an errno if the message has to go
+ * through the flex scanner.
+ */
+int syslog_fastlex_scan(syslog_parser_t parser, int len);
+
 #define __SYSLOG__STYPE btkn_t
 #ifndef YYSTYPE
 #define YYSTYPE btkn_t
@@ -0,0 +1,564 @@
+/* -*- c-basic-offset: 8 -*-
+ * Copyright (c) 2026 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2026 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * \file syslog_fastlex.c
+ * \brief Hand-written tokenizer for the syslog parser.
+ *
+ * The flex scanner (syslog_lexer.l) runs a large DFA over every byte of the
+ * message. Most of the syslog messages however are made of words, numbers,
+ * spaces and single-character separators, whose boundaries can be found by
+ * scanning character classes 16 bytes at a time (SSE2). This tokenizer does
+ * that, and returns exactly the tokens that the flex scanner would return:
+ * for each token, only the rules that can start with its first character are
+ * tried, and the longest match wins (the earliest rule on a tie).
+ *
+ * The whole message is tokenized before the parser runs. If a token cannot
+ * be classified, or the token array cannot be allocated, the tokenizer gives
+ * up on the message and the message goes through the flex scanner instead.
+ *
+ * The tokenizer is enabled with the parser option \c lexer=fast.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "syslog.h"
+#include "syslog_parser.h"
+
+int __syslog__flex_lex(YYSTYPE *lvalp, syslog_parser_t parser,
+		       struct bstr *msg_buf, void *yyscanner);
+
+#define __IS_ALPHA(c) ((unsigned)(((c) | 0x20) - 'a') < 26)
+#define __IS_DIGIT(c) ((unsigned)((c) - '0') < 10)
+#define __IS_XDIGIT(c) (__IS_DIGIT(c) || (unsigned)(((c) | 0x20) - 'a') < 6)
+/* [[:alnum:]\-_.], the characters of a TEXT token */
+#define __IS_TEXT(c) (__IS_ALPHA(c) || __IS_DIGIT(c) || (c) == '-' || \
+		      (c) == '_' || (c) == '.')
+/* [[:alnum:]_\-~.], the characters of a PATH component */
+#define __IS_PATH(c) (__IS_TEXT(c) || (c) == '~')
+
+#ifdef __SSE2__
+/*
+ * The masks of the bytes of v in a character class. The bytes are printable
+ * ASCII (see syslog_sanitize()), so the signed comparisons are fine.
+ */
+static inline __m128i __range(__m128i v, char lo, char hi)
+{
+	return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(lo - 1)),
+			     _mm_cmplt_epi8(v, _mm_set1_epi8(hi + 1)));
+}
+
+static inline __m128i __v_alpha(__m128i v)
+{
+	return __range(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z');
+}
+
+static inline __m128i __v_digit(__m128i v)
+{
+	return __range(v, '0', '9');
+}
+
+static inline __m128i __v_xdigit(__m128i v)
+{
+	return _mm_or_si128(__v_digit(v),
+		__range(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'f'));
+}
+
+static inline __m128i __v_text(__m128i v)
+{
+	__m128i m = _mm_or_si128(__v_alpha(v), __v_digit(v));
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('-')));
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+	return _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('.')));
+}
+
+static inline __m128i __v_space(__m128i v)
+{
+	return _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+}
+
+/*
+ * Generate __span_X(s, p, n): the end of the run of class X characters in
+ * s[p..n), 16 bytes at a time, and the remainder one byte at a time.
+ */
+#define __SPAN_FN(X, IS_X) \
+static inline int __span_##X(const char *s, int p, int n) \
+{ \
+	uint32_t m; \
+	while (p + 16 <= n) { \
+		__m128i v = _mm_loadu_si128((const __m128i *)(s + p)); \
+		m = ~_mm_movemask_epi8(__v_##X(v)) & 0xffff; \
+		if (m) \
+			return p + __builtin_ctz(m); \
+		p += 16; \
+	} \
+	while (p < n && IS_X(s[p])) \
+		p++; \
+	return p; \
+}
+#else
+#define __SPAN_FN(X, IS_X) \
+static inline int __span_##X(const char *s, int p, int n) \
+{ \
+	while (p < n && IS_X(s[p])) \
+		p++; \
+	return p; \
+}
+#endif
+
+#define __IS_SPACE(c) ((c) == ' ')
+__SPAN_FN(digit, __IS_DIGIT)
+__SPAN_FN(xdigit, __IS_XDIGIT)
+__SPAN_FN(text, __IS_TEXT)
+__SPAN_FN(space, __IS_SPACE)
+
+int syslog_sanitize(struct bstr *msg)
+{
+	char *s = msg->cstr;
+	int i = 0;
+	int n = msg->blen;
+	s[n] = '\0';
+	if (n && s[n-1] == '\n')
+		s[n-1] = '\0';
+#ifdef __SSE2__
+	while (i + 16 <= n) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+		/* < 0x20 (incl. '\0') or >= 0x7f, as signed bytes */
+		__m128i bad = _mm_or_si128(
+				_mm_cmplt_epi8(v, _mm_set1_epi8(0x20)),
+				_mm_cmpeq_epi8(v, _mm_set1_epi8(0x7f)));
+		if (_mm_movemask_epi8(bad))
+			break;
+		i += 16;
+	}
+#endif
+	for (; i < n; i++) {
+		if (s[i] == '\0')
+			break;
+		if ((unsigned char)s[i] < 0x20 || (unsigned char)s[i] >= 0x7f)
+			s[i] = 'X';
+	}
+	return i;
+}
+
+static int __ftkn_add(syslog_parser_t parser, int type, int off, int len)
+{
+	struct syslog_ftkn *t;
+	if (parser->ftkn_n == parser->ftkn_max) {
+		int max = parser->ftkn_max ? 2 * parser->ftkn_max : 64;
+		t = realloc(parser->ftkn, max * sizeof(*t));
+		if (!t)
+			return ENOMEM;
+		parser->ftkn = t;
+		parser->ftkn_max = max;
+	}
+	t = &parser->ftkn[parser->ftkn_n++];
+	t->type = type;
+	t->off = off;
+	t->len = len;
+	return 0;
+}
+
+static const char __months[12][4] = {
+	"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+	"Jul", "Aug", "Sep", "Oct", "Nov", "Dec",
+};
+
+/*
+ * The matchers below return the length of the longest match of a flex rule
+ * at s[p], or 0 if the rule does not match. s[n] is '\0', and every class
+ * test fails on '\0', so they never read past the end of the message.
+ */
+
+/* Match s[p] against pat, where 'd' is a digit and the rest are literals. */
+static int __m_fixed(const char *s, int p, const char *pat)
+{
+	int i;
+	for (i = 0; pat[i]; i++) {
+		if (pat[i] == 'd' ? !__IS_DIGIT(s[p+i]) : s[p+i] != pat[i])
+			return 0;
+	}
+	return i;
+}
+
+/* Up to max digits, or none */
+static int __m_digits(const char *s, int p, int max)
+{
+	int i = 0;
+	while (i < max && __IS_DIGIT(s[p+i]))
+		i++;
+	return i;
+}
+
+/* MAC_ADDR */
+static int __m_mac(const char *s, int p)
+{
+	int i;
+	for (i = 0; i < 17; i++) {
+		if (i % 3 == 2 ? s[p+i] != ':' : !__IS_XDIGIT(s[p+i]))
+			return 0;
+	}
+	return 17;
+}
+
+/* ^<[[:digit:]]+> */
+static int __m_priority(const char *s, int p, int n)
+{
+	int d;
+	if (p || s[p] != '<')
+		return 0;
+	d = __span_digit(s, p + 1, n);
+	if (d == p + 1 || s[d] != '>')
+		return 0;
+	return d + 1 - p;
+}
+
+/*
+ * TEXT: a run of [[:alnum:]\-_.] starting with [[:alpha:]_], without the
+ * trailing '.'. A run starting with '_' must be at least 2 characters long.
+ */
+static int __m_text(const char *s, int p, int n)
+{
+	int e;
+	if (!__IS_ALPHA(s[p]) && s[p] != '_')
+		return 0;
+	e = __span_text(s, p, n);
+	while (s[e-1] == '.')
+		e--;
+	if (s[p] == '_' && e - p < 2)
+		return 0;
+	return e - p;
+}
+
+/* IP4_ADDR */
+static int __m_ip4(const char *s, int p, int n)
+{
+	int i, d, q = p;
+	for (i = 0; i < 3; i++) {
+		d = __span_digit(s, q, n);
+		if (d == q || d - q > 3 || s[d] != '.')
+			return 0;
+		q = d + 1;
+	}
+	d = __m_digits(s, q, 3);
+	if (!d)
+		return 0;
+	q += d;
+	if (s[q] == '/' && (d = __m_digits(s, q + 1, 2)))
+		q += 1 + d;
+	return q - p;
+}
+
+/* IP6_ADDR: 5 groups of up to 4 hex digits followed by ':', then a group
+ * of 1 to 4 hex digits */
+static int __m_ip6(const char *s, int p, int n)
+{
+	int i, d, q = p;
+	for (i = 0; i < 5; i++) {
+		d = __span_xdigit(s, q, n);
+		if (d - q > 4 || s[d] != ':')
+			return 0;
+		q = d + 1;
+	}
+	d = __span_xdigit(s, q, n);
+	if (d == q)
+		return 0;
+	q = d - q > 4 ? q + 4 : d;
+	if (s[q] == '/' && (d = __m_digits(s, q + 1, 3)))
+		q += 1 + d;
+	return q - p;
+}
+
+/* HEX_INT */
+static int __m_hex(const char *s, int p, int n)
+{
+	if (s[p] == '0' && (s[p+1] | 0x20) == 'x' && __IS_XDIGIT(s[p+2]))
+		return __span_xdigit(s, p + 2, n) - p;
+	return __span_xdigit(s, p, n) - p;
+}
+
+/* FLOAT */
+static int __m_float(const char *s, int p, int n)
+{
+	int d, e;
+	d = __span_digit(s, p, n);
+	if (d == p || s[d] != '.')
+		return 0;
+	d = __span_digit(s, d + 1, n);
+	if ((s[d] | 0x20) == 'e') {
+		e = __span_digit(s, d + 1, n);
+		if (e > d + 1 && s[e] == '.')
+			d = __span_digit(s, e + 1, n);
+	}
+	return d - p;
+}
+
+/* PATH is "(/[[:alnum:]_\-~.]+)+" */
+static int __m_path(const char *s, int p)
+{
+	int q = p;
+	while (s[q] == '/' && __IS_PATH(s[q+1])) {
+		q++;
+		while (__IS_PATH(s[q]))
+			q++;
+	}
+	return q - p;
+}
+
+/* {HTTP}{TEXT}(\/{TEXT})*\/? */
+static int __m_url(const char *s, int p, int n)
+{
+	int q, l;
+	if (strncasecmp(s + p, "http", 4))
+		return 0;
+	q = p + 4;
+	if ((s[q] | 0x20) == 's')
+		q++;
+	if (strncmp(s + q, "://", 3))
+		return 0;
+	q += 3;
+	l = __m_text(s, q, n);
+	if (!l)
+		return 0;
+	q += l;
+	while (s[q] == '/' && (l = __m_text(s, q + 1, n)))
+		q += 1 + l;
+	if (s[q] == '/')
+		q++;
+	return q - p;
+}
+
+/* TIMESTAMP (RFC3339) */
+static int __m_ts(const char *s, int p, int n)
+{
+	int q, l;
+	l = __m_fixed(s, p, "dddd-dd-ddTdd:dd:dd");
+	if (!l)
+		return 0;
+	q = p + l;
+	if (s[q] == '.' && __IS_DIGIT(s[q+1]))
+		q = __span_digit(s, q + 1, n);
+	if (s[q] == 'Z')
+		return q + 1 - p;
+	if ((s[q] == '+' || s[q] == '-') && (l = __m_fixed(s, q + 1, "dd:dd")))
+		return q + 1 + l - p;
+	return 0;
+}
+
+/* TIMESTAMP2, e.g. "Jan  2 03:04:05" or "Jan 2, 2015 03:04:05" */
+static int __m_ts2(const char *s, int p, int n)
+{
+	int i, d, q, l;
+	for (i = 0; i < 12; i++) {
+		if (0 == strncmp(s + p, __months[i], 3))
+			break;
+	}
+	if (i == 12 || s[p+3] != ' ')
+		return 0;
+	q = __span_space(s, p + 3, n);
+	d = __span_digit(s, q, n);
+	if (d == q || d - q > 2)
+		return 0;
+	q = d;
+	if (s[q] == ',')
+		q++;
+	if (s[q] != ' ')
+		return 0;
+	q = __span_space(s, q, n);
+	if (__m_fixed(s, q, "dddd "))
+		q = __span_space(s, q + 4, n);
+	l = __m_fixed(s, q, "dd:dd:dd");
+	if (!l)
+		return 0;
+	return q + l - p;
+}
+
+/* TIMESTAMP3 */
+static int __m_ts3(const char *s, int p)
+{
+	return __m_fixed(s, p, "dddd-dd-dd dd:dd:dd");
+}
+
+#define __IS_SVC(c) (__IS_ALPHA(c) || (c) == '_' || (c) == '-')
+
+/* BSD_SVC, e.g. "[a.b:c]" */
+static int __m_bsd_svc(const char *s, int p)
+{
+	int q = p + 1;
+	if (s[p] != '[' || !__IS_SVC(s[q]))
+		return 0;
+	while (__IS_SVC(s[q]))
+		q++;
+	while (s[q] == '.' && __IS_SVC(s[q+1])) {
+		q++;
+		while (__IS_SVC(s[q]))
+			q++;
+	}
+	if (s[q] != ':' || !__IS_SVC(s[q+1]))
+		return 0;
+	q++;
+	while (__IS_SVC(s[q]))
+		q++;
+	if (s[q] != ']')
+		return 0;
+	return q + 1 - p;
+}
+
+/*
+ * SEPARATOR is "[[^:alnum:]]|[[:punct:]]". The first part is one of
+ * "[^:alnum" followed by ']'.
+ */
+static int __m_sep(const char *s, int p)
+{
+	char c = s[p];
+	if (s[p+1] == ']' && strchr("[^:alnum", c))
+		return 2;
+	if (__IS_ALPHA(c) || __IS_DIGIT(c))
+		return 0;
+	return 1;
+}
+
+/*
+ * Classify the token at s[p] like flex does: the longest match, and the
+ * earliest rule of syslog_lexer.l on a tie. Only the rules that can start
+ * with s[p] are tried. Returns the length of the token and sets *type, or
+ * returns 0 if the token cannot be classified.
+ */
+static int __fast_tkn(const char *s, int p, int n, int *type)
+{
+	char c = s[p];
+	int alpha = __IS_ALPHA(c);
+	int digit = __IS_DIGIT(c);
+	int xdigit = __IS_XDIGIT(c);
+	int best = 0;
+	int l;
+
+#define __RULE(cond, tkn_type, match) do { \
+	if ((cond) && (l = (match)) > best) { \
+		best = l; \
+		*type = tkn_type; \
+	} \
+} while (0)
+
+	if (c == ' ') {
+		/* The only rule that matches a space */
+		*type = WHITESPACE_TKN;
+		return __span_space(s, p, n) - p;
+	}
+	/* In the order of the rules in syslog_lexer.l */
+	__RULE(xdigit, ETH_ADDR_TKN, __m_mac(s, p));
+	__RULE(c == '<', PRIORITY_TKN, __m_priority(s, p, n));
+	__RULE(alpha || c == '_', TEXT_TKN, __m_text(s, p, n));
+	__RULE(digit, IP4_ADDR_TKN, __m_ip4(s, p, n));
+	__RULE(xdigit || c == ':', IP6_ADDR_TKN, __m_ip6(s, p, n));
+	__RULE(digit, DEC_INT_TKN, __span_digit(s, p, n) - p);
+	__RULE(xdigit, HEX_INT_TKN, __m_hex(s, p, n));
+	__RULE(digit, FLOAT_TKN, __m_float(s, p, n));
+	__RULE(c == '/', PATH_TKN, __m_path(s, p));
+	__RULE((c | 0x20) == 'h', URL_TKN, __m_url(s, p, n));
+	__RULE(digit, TIMESTAMP_TKN, __m_ts(s, p, n));
+	__RULE(alpha, TIMESTAMP_TKN, __m_ts2(s, p, n));
+	__RULE(digit, TIMESTAMP_TKN, __m_ts3(s, p));
+	__RULE(c == '[', BSD_SVC_TKN, __m_bsd_svc(s, p));
+	__RULE(1, SEPARATOR_TKN, __m_sep(s, p));
+#undef __RULE
+	return best;
+}
+
+int syslog_fastlex_scan(syslog_parser_t parser, int n)
+{
+	const char *s = parser->line;
+	int p, len, type, rc;
+
+	parser->ftkn_n = 0;
+	parser->ftkn_idx = 0;
+	for (p = 0; p < n; p += len) {
+		len = __fast_tkn(s, p, n, &type);
+		if (!len) {
+			rc = ENOTSUP;
+			goto err;
+		}
+		rc = __ftkn_add(parser, type, p, len);
+		if (rc)
+			goto err;
+	}
+	parser->cpos = 0;
+	return 0;
+ err:
+	parser->ftkn_n = -1;
+	return rc;
+}
+
+/*
+ * The lexer called by the grammar: return the tokens of
+ * syslog_fastlex_scan(), or the ones from the flex scanner if the fast
+ * tokenizer is not used for the message.
+ */
+int __syslog__lex(YYSTYPE *lvalp, syslog_parser_t parser,
+		  struct bstr *msg_buf, void *yyscanner)
+{
+	struct syslog_ftkn *t;
+	btkn_t tkn;
+	if (parser->ftkn_n < 0)
+		return __syslog__flex_lex(lvalp, parser, msg_buf, yyscanner);
+	if (parser->ftkn_idx == parser->ftkn_n)
+		return 0;
+	t = &parser->ftkn[parser->ftkn_idx++];
+	parser->cpos += t->len;
+	tkn = barena_btkn_slice(parser->arena, 0, parser->line + t->off,
+				t->len);
+	if (!tkn)
+		return 0;
+	*lvalp = tkn;
+	return t->type;
+}
@@ -119,7 +119,7 @@ void init_ts_ym()
 }
 
 void yyerror(struct syslog_parser *parser, struct bstr *input,
-	     bwq_entry_t *pwqe, const char *str)
+	     bwq_entry_t *pwqe, void *scanner, const char *str)
 {
 	int pos;
 	fprintf(stderr, "%s\n", input->cstr);
@@ -127,10 +127,8 @@ void yyerror(struct syslog_parser *parser, struct bstr *input,
 	    fprintf(stderr, " ");
 	fprintf(stderr, "^\n");
 	fprintf(stderr, "%s\n", str);
-	if (*pwqe) {
-	    binq_entry_free(*pwqe);
-	    *pwqe = NULL;
-	}
+	/* The partial entry is released with the arena */
+	*pwqe = NULL;
 }
 
 static const char* syslog_get_version(binp_parser_t p)
@@ -143,12 +141,158 @@ static const char *syslog_get_name(binp_parser_t p)
 	return "syslog_parser";
 }
 
+int yylex_destroy(void *);
+
 void syslog_release(binp_parser_t p)
 {
+	yylex_destroy(((syslog_parser_t)p)->scanner);
+	free(((syslog_parser_t)p)->ftkn);
+	free(((syslog_parser_t)p)->bbuf);
 	free(p);
 }
 
-static int parse_timestamp(char *time_str, struct timeval *tv)
+/*
+ * Parser options:
+ *   lexer=fast|flex  Tokenize the messages with the hand-written tokenizer in
+ *                    syslog_fastlex.c (falling back to the flex scanner for
+ *                    the messages it cannot tokenize), or with the flex
+ *                    scanner only (default: flex).
+ */
+static int syslog_config(binp_parser_t p, struct bpair_str_head *args)
+{
+	syslog_parser_t sp = (syslog_parser_t)p;
+	struct bpair_str *bp = bpair_str_search(args, "lexer", NULL);
+	if (!bp)
+		return 0;
+	if (0 == strcmp(bp->s1, "fast")) {
+		sp->fast_lex = 1;
+	} else if (0 == strcmp(bp->s1, "flex")) {
+		sp->fast_lex = 0;
+	} else {
+		berr("syslog_parser: unknown lexer '%s'", bp->s1);
+		return EINVAL;
+	}
+	return 0;
+}
+
+#define __TS_DIGIT(c) ((unsigned)((c) - '0') < 10)
+#define __TS_2DIGITS(s) (__TS_DIGIT((s)[0]) && __TS_DIGIT((s)[1]))
+#define __TS_2DIGITS_VAL(s) (10 * ((s)[0] - '0') + (s)[1] - '0')
+
+/*
+ * Parse the ":MM:SS" that follows the hour of a timestamp, and if \c tz is
+ * set, also the optional ".US" and the "Z" or "+HH:MM" offset. \c *sec is
+ * set to the seconds since the hour (less the offset). Only the exact
+ * forms are accepted, anything else is left to parse_timestamp().
+ * Returns 0 on success, or -1.
+ */
+static int __ts_tail(const char *s, int tz, int *sec, int *usec)
+{
+	int MM, SS, US = 0, off, n;
+	if (s[0] != ':' || !__TS_2DIGITS(s + 1) || s[3] != ':' ||
+	    !__TS_2DIGITS(s + 4))
+		return -1;
+	MM = __TS_2DIGITS_VAL(s + 1);
+	SS = __TS_2DIGITS_VAL(s + 4);
+	/* strptime() range, and no normalization by mktime() */
+	if (MM > 59 || SS > 61)
+		return -1;
+	*sec = 60 * MM + SS;
+	*usec = 0;
+	s += 6;
+	if (!tz)
+		return *s ? -1 : 0;
+	if (*s == '.') {
+		for (n = 0, s++; n < 6 && __TS_DIGIT(*s); n++, s++)
+			US = 10 * US + *s - '0';
+		if (!n || __TS_DIGIT(*s))
+			return -1;
+	}
+	*usec = US;
+	if (s[0] == 'Z')
+		return s[1] ? -1 : 0;
+	if ((s[0] != '+' && s[0] != '-') || !__TS_2DIGITS(s + 1) ||
+	    s[3] != ':' || !__TS_2DIGITS(s + 4) || s[6])
+		return -1;
+	off = 3600 * __TS_2DIGITS_VAL(s + 1) + 60 * __TS_2DIGITS_VAL(s + 4);
+	*sec -= (s[0] == '+') ? off : -off;
+	return 0;
+}
+
+/*
+ * Look \c time_str up in the cache. Returns 0 and sets \c tv on a hit, or
+ * -1.
+ */
+static int __ts_cache_get(struct syslog_ts_cache *c, const char *time_str,
+			  struct timeval *tv)
+{
+	int sec, usec;
+	if (!c->key_len || strncmp(time_str, c->key, c->key_len))
+		return -1;
+	if (c->expire && time(NULL) >= c->expire)
+		return -1;
+	if (__ts_tail(time_str + c->key_len, c->tz, &sec, &usec))
+		return -1;
+	tv->tv_sec = c->hour + sec;
+	tv->tv_usec = usec;
+	return 0;
+}
+
+/*
+ * Whether the local time from \c t0 on is \c HH:00:00 through \c HH:59:59,
+ * and \c HH does not occur again in the hours around it. This is not the
+ * case for the hours of the DST changes, where mktime() is not linear in the
+ * minutes and seconds.
+ */
+static int __ts_hour_regular(time_t t0, int HH)
+{
+	struct tm tm;
+	time_t t;
+	if (!localtime_r(&t0, &tm) || tm.tm_hour != HH || tm.tm_min ||
+	    tm.tm_sec)
+		return 0;
+	t = t0 + 3599;
+	if (!localtime_r(&t, &tm) || tm.tm_hour != HH || tm.tm_min != 59 ||
+	    tm.tm_sec != 59)
+		return 0;
+	t = t0 - 3600;
+	if (!localtime_r(&t, &tm) || tm.tm_hour == HH)
+		return 0;
+	t = t0 + 3600;
+	if (!localtime_r(&t, &tm) || tm.tm_hour == HH)
+		return 0;
+	return 1;
+}
+
+/*
+ * Cache the hour of \c time_str, which parse_timestamp() converted to
+ * \c tv. The hour is the 2 digits before the first ':' in all of the
+ * formats. \c tz is 0 for the local time formats.
+ */
+static void __ts_cache_put(struct syslog_ts_cache *c, const char *time_str,
+			   int tz, time_t expire, const struct timeval *tv)
+{
+	const char *p = strchr(time_str, ':');
+	int sec, usec, len;
+	if (!p)
+		return;
+	len = p - time_str;
+	if (len < 2 || len >= sizeof(c->key) || !__TS_2DIGITS(p - 2) ||
+	    __ts_tail(p, tz, &sec, &usec))
+		return;
+	if (!tz && !__ts_hour_regular(tv->tv_sec - sec,
+				      __TS_2DIGITS_VAL(p - 2)))
+		return;
+	memcpy(c->key, time_str, len);
+	c->key[len] = '\0';
+	c->key_len = len;
+	c->tz = tz;
+	c->hour = tv->tv_sec - sec;
+	c->expire = expire;
+}
+
+static int parse_timestamp(syslog_parser_t parser, char *time_str,
+			   struct timeval *tv)
 {
 	extern long timezone;
 	char *str = time_str;
@@ -158,10 +302,14 @@ static int parse_timestamp(char *time_str, struct timeval *tv)
 	int TZM = 0;
 	int n, len;
 	char p;
-	struct tm tm;
+	struct tm tm, tm_eoy;
 	time_t t;
 	char *s;
 
+	/* Bursts of messages share the same hour */
+	if (0 == __ts_cache_get(&parser->ts_cache, time_str, tv))
+		return 0;
+
 	/* There are 3 formats currently supported. By example:
 	 * 2015-03-29T18:40:01-06:00
 	 * 2015-03-29T18:40:01+06:00
@@ -215,6 +363,7 @@ static int parse_timestamp(char *time_str, struct timeval *tv)
 			t = mktime(&tm);
 			tv->tv_sec = t;
 			tv->tv_usec = 0;
+			__ts_cache_put(&parser->ts_cache, time_str, 0, 0, tv);
 			return 0;
 		default:
 			goto err;
@@ -236,12 +385,20 @@ static int parse_timestamp(char *time_str, struct timeval *tv)
 		t = mktime(&tm);
 		tv->tv_sec = t;
 		tv->tv_usec = 0;
+		/* The year is the current one, until the end of it */
+		memset(&tm_eoy, 0, sizeof(tm_eoy));
+		tm_eoy.tm_year = tm.tm_year + 1;
+		tm_eoy.tm_mday = 1;
+		tm_eoy.tm_isdst = -1;
+		__ts_cache_put(&parser->ts_cache, time_str, 0, mktime(&tm_eoy),
+			       tv);
 		return 0;
 	}
 	tv->tv_sec = __get_utc_ts(yyyy, mm, dd, HH, MM, SS);
 	tv->tv_sec -= 3600 * TZH;
 	tv->tv_sec -= 60 * TZM;
 	tv->tv_usec = US;
+	__ts_cache_put(&parser->ts_cache, time_str, 1, 0, tv);
 	return 0;
 
  err:
@@ -249,26 +406,131 @@ static int parse_timestamp(char *time_str, struct timeval *tv)
 	return 1;
 }
 
-int __syslog__parse(syslog_parser_t parser, struct bstr *input, bwq_entry_t *pwqe);
-void yy_delete_buffer(struct yy_buffer_state *);
-int yylex(void*, syslog_parser_t, struct bstr *);
+int __syslog__parse(syslog_parser_t parser, struct bstr *input, bwq_entry_t *pwqe,
+		void *scanner);
+void yy_delete_buffer(struct yy_buffer_state *, void *);
+struct yy_buffer_state *yy_scan_buffer(char *, size_t, void *);
+int yylex(void*, syslog_parser_t, struct bstr *, void *);
+int yylex_init(void **);
 
+/*
+ * Parse the line \c s, already sanitized to \c len characters. The flex
+ * scanner either reads parser->line, or is at the start of the line in the
+ * batch buffer (see syslog_parse_batch()).
+ */
 static binp_result_t
-syslog_parse(binp_parser_t p, struct bstr *s, struct bwq_entry **pent)
+__parse_line(syslog_parser_t sp, struct bstr *s, int len,
+	     struct bwq_entry **pent)
 {
-	syslog_parser_t sp = (syslog_parser_t)p;
 	int rc;
 	*pent = NULL;
+	sp->eol = 0;
+	sp->arena = barena_get();
+	if (!sp->arena)
+		return BINP_ERR_RESOURCE;
+	/* One copy of the line lives with the entry; the tokens are slices of
+	 * it */
+	sp->line = barena_alloc(sp->arena, len + 1);
+	if (!sp->line) {
+		barena_put(sp->arena);
+		sp->arena = NULL;
+		return BINP_ERR_RESOURCE;
+	}
+	memcpy(sp->line, s->cstr, len + 1);
+	sp->cpos = 0;
+	sp->ftkn_n = -1;
+	if (sp->fast_lex)
+		syslog_fastlex_scan(sp, len);
+	rc = __syslog__parse(sp, s, pent, sp->scanner);
+	if (!*pent) {
+		/* Syntax error: drop the partial entry with its arena */
+		sp->wqe = NULL;
+		barena_put(sp->arena);
+	}
+	sp->arena = NULL;
+	sp->line = NULL;
+	if (rc)
+	    return BINP_ERR_SYNTAX;
+	return BINP_OK;
+}
+
+static binp_result_t
+syslog_parse(binp_parser_t p, struct bstr *s, struct bwq_entry **pent)
+{
+	syslog_parser_t sp = (syslog_parser_t)p;
 	if (sp->buffer_state) {
 		/* The previous call did not reset the lexer state */
-		yy_delete_buffer(sp->buffer_state);
+		yy_delete_buffer(sp->buffer_state, sp->scanner);
 		sp->cpos = 0;
 		sp->buffer_state = NULL;
 	}
-	rc = __syslog__parse(sp, s, pent);
-	if (rc)
-	    return BINP_ERR_SYNTAX;
-	return BINP_OK;
+	return __parse_line(sp, s, syslog_sanitize(s), pent);
+}
+
+/*
+ * The flex scanner reads all of the lines of the batch from one buffer, the
+ * lines separated by '\n', instead of getting a buffer for each line. The
+ * fast tokenizer does not use flex for most messages, so with lexer=fast the
+ * lines are just parsed one by one.
+ */
+static void
+syslog_parse_batch(binp_parser_t p, struct bstr **lines, int n,
+		   struct bwq_entry **ents, binp_result_t *rcs)
+{
+	syslog_parser_t sp = (syslog_parser_t)p;
+	size_t sz, off;
+	char *buf;
+	int i, len;
+
+	if (sp->fast_lex)
+		goto one_by_one;
+	if (sp->buffer_state) {
+		yy_delete_buffer(sp->buffer_state, sp->scanner);
+		sp->buffer_state = NULL;
+	}
+	/* yy_scan_buffer() needs two '\0' at the end */
+	sz = 2;
+	for (i = 0; i < n; i++)
+		sz += syslog_sanitize(lines[i]) + 1;
+	if (sz > sp->bbuf_sz) {
+		buf = realloc(sp->bbuf, sz);
+		if (!buf)
+			goto one_by_one;
+		sp->bbuf = buf;
+		sp->bbuf_sz = sz;
+	}
+	off = 0;
+	for (i = 0; i < n; i++) {
+		len = strlen(lines[i]->cstr);
+		memcpy(sp->bbuf + off, lines[i]->cstr, len);
+		sp->bbuf[off + len] = '\n';
+		off += len + 1;
+	}
+	sp->bbuf[off] = sp->bbuf[off + 1] = '\0';
+	/* If this fails, the lexer scans each line from parser->line */
+	sp->buffer_state = yy_scan_buffer(sp->bbuf, sz, sp->scanner);
+	off = 0;
+	for (i = 0; i < n; i++) {
+		len = strlen(lines[i]->cstr);
+		rcs[i] = __parse_line(sp, lines[i], len, &ents[i]);
+		off += len + 1;
+		if (sp->eol || !sp->buffer_state || i == n - 1)
+			continue;
+		/* The parse stopped before the end of the line: restart the
+		 * scanner at the next one */
+		yy_delete_buffer(sp->buffer_state, sp->scanner);
+		sp->buffer_state = yy_scan_buffer(sp->bbuf + off, sz - off,
+						  sp->scanner);
+	}
+	if (sp->buffer_state) {
+		yy_delete_buffer(sp->buffer_state, sp->scanner);
+		sp->buffer_state = NULL;
+	}
+	return;
+
+ one_by_one:
+	for (i = 0; i < n; i++)
+		rcs[i] = syslog_parse(p, lines[i], &ents[i]);
 }
 
 static struct syslog_parser syslog_parser = {
@@ -277,6 +539,8 @@ static struct syslog_parser syslog_parser = {
 		.get_version = syslog_get_version,
 		.parse = syslog_parse,
 		.release = syslog_release,
+		.config = syslog_config,
+		.parse_batch = syslog_parse_batch,
 	},
 	.cpos = 0
 };
@@ -287,12 +551,18 @@ binp_parser_t binp_get_parser(void *d)
 	if (!p)
 		return NULL;
 	*p = syslog_parser;
+	if (yylex_init(&p->scanner)) {
+		free(p);
+		return NULL;
+	}
 	return &p->base;
 }
 
-struct bwq_entry *alloc_wqe()
+/* The entry, its tokens and its hostname are all in the parser arena */
+struct bwq_entry *alloc_wqe(syslog_parser_t parser)
 {
-    struct bwq_entry *wqe = calloc(1, sizeof *wqe);
+    struct bwq_entry *wqe = barena_zalloc(parser->arena, sizeof *wqe);
+    wqe->arena = parser->arena;
     wqe->data.in.format = BINQ_BTKN_QUEUE;
     wqe->data.in.type = BINQ_DATA_MSG;
     TAILQ_INIT(&wqe->data.in.tkn_q);
@@ -301,8 +571,6 @@ struct bwq_entry *alloc_wqe()
 
 void enqueue_token(struct bwq_entry *wqe, btkn_t tkn, btkn_type_t typ);
 
-struct bwq_entry *yy_wqe = NULL;
-
 %}
 
 %define api.pure full
@@ -311,6 +579,8 @@ struct bwq_entry *yy_wqe = NULL;
 %parse-param {syslog_parser_t parser}
 %parse-param {struct bstr *input}
 %parse-param {bwq_entry_t *pwqe}
+%lex-param {void *scanner}
+%parse-param {void *scanner}
 
 %token PRIORITY_TKN
 %token VERSION_TKN
@@ -335,39 +605,34 @@ struct bwq_entry *yy_wqe = NULL;
 
 log_msg:	msg_header
 		{
-		    *pwqe = yy_wqe;
-		    yy_wqe = NULL;
+		    *pwqe = parser->wqe;
+		    parser->wqe = NULL;
 		}
 		| msg_header msg_token_list
 		{
-		    *pwqe = yy_wqe;
-		    yy_wqe = NULL;
+		    *pwqe = parser->wqe;
+		    parser->wqe = NULL;
 		}
 		;
 
 timestamp: 	TIMESTAMP_TKN
 		{
-		    if (!yy_wqe)
-			yy_wqe = alloc_wqe();
-		    parse_timestamp($1->tkn_str->cstr, &yy_wqe->data.in.tv);
-		    btkn_free($1);
+		    if (!parser->wqe)
+			parser->wqe = alloc_wqe(parser);
+		    if (0 == barena_btkn_materialize(parser->arena, $1))
+			parse_timestamp(parser, $1->tkn_str->cstr,
+					&parser->wqe->data.in.tv);
 		}
 		;
 
 ts_wspace:	timestamp WHITESPACE_TKN
-		{
-		    btkn_free($2);
-		}
 		;
 
 prio_vers:	PRIORITY_TKN DEC_INT_TKN WHITESPACE_TKN
 		{
-		    if (!yy_wqe)
-			yy_wqe = alloc_wqe();
+		    if (!parser->wqe)
+			parser->wqe = alloc_wqe(parser);
 		    /* we don't enqueue these tokens to the token string */
-		    btkn_free($1);
-		    btkn_free($2);
-		    btkn_free($3);
 		}
 		;
 
@@ -376,88 +641,72 @@ hostname:	TEXT_TKN | IP4_ADDR_TKN | IP6_ADDR_TKN
 
 encap_host:	| SEPARATOR_TKN hostname SEPARATOR_TKN
 		{
-		    enqueue_token(yy_wqe, $1, BTKN_TYPE_SEPARATOR); /* [( */
-		    enqueue_token(yy_wqe, $2, BTKN_TYPE_HOSTNAME);
-		    enqueue_token(yy_wqe, $3, BTKN_TYPE_SEPARATOR); /* ]) */
+		    enqueue_token(parser->wqe, $1, BTKN_TYPE_SEPARATOR); /* [( */
+		    enqueue_token(parser->wqe, $2, BTKN_TYPE_HOSTNAME);
+		    enqueue_token(parser->wqe, $3, BTKN_TYPE_SEPARATOR); /* ]) */
 		}
 		;
 
 hwerr_hdr: 	timestamp WHITESPACE_TKN SEPARATOR_TKN WHITESPACE_TKN
 		TEXT_TKN
 		{
-		    enqueue_token(yy_wqe, $3, BTKN_TYPE_SEPARATOR);
-		    enqueue_token(yy_wqe, $4, BTKN_TYPE_WHITESPACE);
-		    enqueue_token(yy_wqe, $5, BTKN_TYPE_WORD); /* HWERR */
+		    enqueue_token(parser->wqe, $3, BTKN_TYPE_SEPARATOR);
+		    enqueue_token(parser->wqe, $4, BTKN_TYPE_WHITESPACE);
+		    enqueue_token(parser->wqe, $5, BTKN_TYPE_WORD); /* HWERR */
 		} encap_host
 		;
 
 bsd_hdr:	PRIORITY_TKN timestamp WHITESPACE_TKN BSD_SVC_TKN SEPARATOR_TKN
 		{
-		    btkn_free($1); /* free the PRIORITY_TKN */
-		    btkn_free($3); /* free the WHITESPACE_TKN */
-		    enqueue_token(yy_wqe, $4, BTKN_TYPE_SERVICE);
-		    enqueue_token(yy_wqe, $5, BTKN_TYPE_SEPARATOR);
+		    enqueue_token(parser->wqe, $4, BTKN_TYPE_SERVICE);
+		    enqueue_token(parser->wqe, $5, BTKN_TYPE_SEPARATOR);
 		}
 		;
 
 /* log message w/o priority and version */
 ts_host:	timestamp WHITESPACE_TKN hostname
 		{
-		    btkn_free($2); /* free the WHITESPACE_TKN */
-		    enqueue_token(yy_wqe, $3, BTKN_TYPE_HOSTNAME);
+		    enqueue_token(parser->wqe, $3, BTKN_TYPE_HOSTNAME);
 		}
 		| timestamp WHITESPACE_TKN encap_host
-		{
-		    btkn_free($2); /* free the WHITESPACE_TKN */
-		}
 		;
 
 /* Missing syslog version */
 prio_host:	PRIORITY_TKN timestamp WHITESPACE_TKN hostname
 		{
-		    btkn_free($1); /* free the PRIORITY_TKN */
-		    btkn_free($3); /* free the WHITESPACE_TKN */
-		    enqueue_token(yy_wqe, $4, BTKN_TYPE_HOSTNAME);
+		    enqueue_token(parser->wqe, $4, BTKN_TYPE_HOSTNAME);
 		}
 		| PRIORITY_TKN timestamp WHITESPACE_TKN encap_host
-		{
-		    btkn_free($1); /* free the PRIORITY_TKN */
-		    btkn_free($3); /* free the WHITESPACE_TKN */
-		}
 		;
 
 /* log message with priority and version */
 pv_ts_host:	prio_vers timestamp WHITESPACE_TKN hostname
 		{
-		    btkn_free($3); /* free the WHITESPACE_TKN */
-		    enqueue_token(yy_wqe, $4, BTKN_TYPE_HOSTNAME);
+		    enqueue_token(parser->wqe, $4, BTKN_TYPE_HOSTNAME);
 		}
 		| prio_vers timestamp WHITESPACE_TKN encap_host
-		{
-		    btkn_free($3); /* free the WHITESPACE_TKN */
-		}
 		;
 
 pv_ts_host_pid:		/* service name is missing/nul */
 		pv_ts_host WHITESPACE_TKN DEC_INT_TKN
 		{
-		    enqueue_token(yy_wqe, $2, BTKN_TYPE_WHITESPACE);
-		    enqueue_token(yy_wqe, $3, BTKN_TYPE_PID);
+		    enqueue_token(parser->wqe, $2, BTKN_TYPE_WHITESPACE);
+		    enqueue_token(parser->wqe, $3, BTKN_TYPE_PID);
 		}
 		;
 
 pv_ts_host_svc:	pv_ts_host WHITESPACE_TKN TEXT_TKN
 		{
-		    enqueue_token(yy_wqe, $2, BTKN_TYPE_WHITESPACE);
-		    enqueue_token(yy_wqe, $3, BTKN_TYPE_SERVICE);
+		    enqueue_token(parser->wqe, $2, BTKN_TYPE_WHITESPACE);
+		    enqueue_token(parser->wqe, $3, BTKN_TYPE_SERVICE);
 		}
 		;
 
 pv_ts_host_svc_pid:
 		pv_ts_host_svc WHITESPACE_TKN DEC_INT_TKN
 		{
-		    enqueue_token(yy_wqe, $2, BTKN_TYPE_WHITESPACE);
-		    enqueue_token(yy_wqe, $3, BTKN_TYPE_PID);
+		    enqueue_token(parser->wqe, $2, BTKN_TYPE_WHITESPACE);
+		    enqueue_token(parser->wqe, $3, BTKN_TYPE_PID);
 		}
 		;
 
@@ -470,29 +719,29 @@ msg_header:	ts_wspace
 	|	pv_ts_host
 	|	pv_ts_host WHITESPACE_TKN
 		{
-		    enqueue_token(yy_wqe, $2, BTKN_TYPE_WHITESPACE);
+		    enqueue_token(parser->wqe, $2, BTKN_TYPE_WHITESPACE);
 		}
 	|	pv_ts_host SEPARATOR_TKN
 		{
-		    enqueue_token(yy_wqe, $2, BTKN_TYPE_SEPARATOR);
+		    enqueue_token(parser->wqe, $2, BTKN_TYPE_SEPARATOR);
 		}
 	|	pv_ts_host_pid
 	|	pv_ts_host_pid WHITESPACE_TKN
 		{
-		    enqueue_token(yy_wqe, $2, BTKN_TYPE_WHITESPACE);
+		    enqueue_token(parser->wqe, $2, BTKN_TYPE_WHITESPACE);
 		}
 	|	pv_ts_host_pid SEPARATOR_TKN
 		{
-		    enqueue_token(yy_wqe, $2, BTKN_TYPE_SEPARATOR);
+		    enqueue_token(parser->wqe, $2, BTKN_TYPE_SEPARATOR);
 		}
 	| 	pv_ts_host_svc
 	| 	pv_ts_host_svc WHITESPACE_TKN
 		{
-		    enqueue_token(yy_wqe, $2, BTKN_TYPE_WHITESPACE);
+		    enqueue_token(parser->wqe, $2, BTKN_TYPE_WHITESPACE);
 		}
 	| 	pv_ts_host_svc SEPARATOR_TKN
 		{
-		    enqueue_token(yy_wqe, $2, BTKN_TYPE_SEPARATOR);
+		    enqueue_token(parser->wqe, $2, BTKN_TYPE_SEPARATOR);
 		}
 	|	pv_ts_host_svc_pid
 		;
@@ -501,36 +750,38 @@ msg_token_list:	msg_token
 	|	msg_token_list msg_token
 	;
 
-msg_token:	TEXT_TKN	{ enqueue_token(yy_wqe, $1, BTKN_TYPE_TEXT); }
-	|	PRIORITY_TKN	{ enqueue_token(yy_wqe, $1, BTKN_TYPE_PRIORITY); }
-	|	VERSION_TKN	{ enqueue_token(yy_wqe, $1, BTKN_TYPE_VERSION); }
-	|	SERVICE_TKN	{ enqueue_token(yy_wqe, $1, BTKN_TYPE_SERVICE); }
-	|	PID_TKN		{ enqueue_token(yy_wqe, $1, BTKN_TYPE_PID); }
-	|	TIMESTAMP_TKN	{ enqueue_token(yy_wqe, $1, BTKN_TYPE_TIMESTAMP); }
-	|	HOSTNAME_TKN	{ enqueue_token(yy_wqe, $1, BTKN_TYPE_HOSTNAME); }
-	|	IP4_ADDR_TKN	{ enqueue_token(yy_wqe, $1, BTKN_TYPE_IP4_ADDR); }
-	|	IP6_ADDR_TKN	{ enqueue_token(yy_wqe, $1, BTKN_TYPE_IP6_ADDR); }
-	|	ETH_ADDR_TKN	{ enqueue_token(yy_wqe, $1, BTKN_TYPE_ETH_ADDR); }
-	|	HEX_INT_TKN	{ enqueue_token(yy_wqe, $1, BTKN_TYPE_HEX_INT); }
-	|	DEC_INT_TKN	{ enqueue_token(yy_wqe, $1, BTKN_TYPE_DEC_INT); }
-	|	FLOAT_TKN	{ enqueue_token(yy_wqe, $1, BTKN_TYPE_FLOAT); }
-	|	URL_TKN		{ enqueue_token(yy_wqe, $1, BTKN_TYPE_URL); }
-	|	PATH_TKN	{ enqueue_token(yy_wqe, $1, BTKN_TYPE_PATH); }
-	|	SEPARATOR_TKN	{ enqueue_token(yy_wqe, $1, BTKN_TYPE_SEPARATOR); }
-	|	WHITESPACE_TKN	{ enqueue_token(yy_wqe, $1, BTKN_TYPE_WHITESPACE); }
+msg_token:	TEXT_TKN	{ enqueue_token(parser->wqe, $1, BTKN_TYPE_TEXT); }
+	|	PRIORITY_TKN	{ enqueue_token(parser->wqe, $1, BTKN_TYPE_PRIORITY); }
+	|	VERSION_TKN	{ enqueue_token(parser->wqe, $1, BTKN_TYPE_VERSION); }
+	|	SERVICE_TKN	{ enqueue_token(parser->wqe, $1, BTKN_TYPE_SERVICE); }
+	|	PID_TKN		{ enqueue_token(parser->wqe, $1, BTKN_TYPE_PID); }
+	|	TIMESTAMP_TKN	{ enqueue_token(parser->wqe, $1, BTKN_TYPE_TIMESTAMP); }
+	|	HOSTNAME_TKN	{ enqueue_token(parser->wqe, $1, BTKN_TYPE_HOSTNAME); }
+	|	IP4_ADDR_TKN	{ enqueue_token(parser->wqe, $1, BTKN_TYPE_IP4_ADDR); }
+	|	IP6_ADDR_TKN	{ enqueue_token(parser->wqe, $1, BTKN_TYPE_IP6_ADDR); }
+	|	ETH_ADDR_TKN	{ enqueue_token(parser->wqe, $1, BTKN_TYPE_ETH_ADDR); }
+	|	HEX_INT_TKN	{ enqueue_token(parser->wqe, $1, BTKN_TYPE_HEX_INT); }
+	|	DEC_INT_TKN	{ enqueue_token(parser->wqe, $1, BTKN_TYPE_DEC_INT); }
+	|	FLOAT_TKN	{ enqueue_token(parser->wqe, $1, BTKN_TYPE_FLOAT); }
+	|	URL_TKN		{ enqueue_token(parser->wqe, $1, BTKN_TYPE_URL); }
+	|	PATH_TKN	{ enqueue_token(parser->wqe, $1, BTKN_TYPE_PATH); }
+	|	SEPARATOR_TKN	{ enqueue_token(parser->wqe, $1, BTKN_TYPE_SEPARATOR); }
+	|	WHITESPACE_TKN	{ enqueue_token(parser->wqe, $1, BTKN_TYPE_WHITESPACE); }
 	;
 
 %%
 
 void enqueue_token(struct bwq_entry *wqe, btkn_t tkn, btkn_type_t typ)
 {
-    btkn_tailq_entry_t e = malloc(sizeof *e);
+    btkn_tailq_entry_t e = barena_alloc(wqe->arena, sizeof *e);
     e->tkn = tkn;
     tkn->tkn_type_mask = BTKN_TYPE_MASK(typ);
     TAILQ_INSERT_TAIL(&wqe->data.in.tkn_q, e, link);
     wqe->data.in.tkn_count++;
-    if (typ == BTKN_TYPE_HOSTNAME)
-	wqe->data.in.hostname = bstr_dup(tkn->tkn_str);
+    /* The hostname is the only token text used as a bstr */
+    if (typ == BTKN_TYPE_HOSTNAME &&
+	0 == barena_btkn_materialize(wqe->arena, tkn))
+	wqe->data.in.hostname = tkn->tkn_str; /* same lifetime */
 }
 
 static void __attribute__ ((constructor)) parser_lib_init(void)
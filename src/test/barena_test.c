@@ -0,0 +1,145 @@
+/* -*- c-basic-offset: 8 -*-
+ * Copyright (c) 2026 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2026 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "baler/barena.h"
+#include "baler/bwqueue.h"
+
+#define N 100000
+
+struct bwq *q;
+
+/* fill the arena with a few tokens and a large object, like a parser */
+void *prod_proc(void *arg)
+{
+	struct bwq_entry *ent;
+	barena_t a;
+	btkn_t tkn;
+	char buf[32];
+	int i, len;
+	for (i = 0; i < N; i++) {
+		a = barena_get();
+		assert(a);
+		ent = barena_zalloc(a, sizeof(*ent));
+		assert(ent);
+		ent->arena = a;
+		ent->id = i;
+		len = snprintf(buf, sizeof(buf), "token-%d", i);
+		tkn = barena_btkn_alloc(a, i, 0, buf, len);
+		assert(tkn);
+		ent->ctxt = tkn;
+		if (i % 100 == 0) {
+			/* goes to an additional chunk */
+			char *big = barena_alloc(a, 2 * BARENA_SZ);
+			assert(big);
+			big[2 * BARENA_SZ - 1] = 1;
+		}
+		bwq_nq(q, ent);
+	}
+	return NULL;
+}
+
+/* check and release the arenas, like an input worker */
+void *cons_proc(void *arg)
+{
+	struct bwq_entry *ent;
+	btkn_t tkn;
+	char buf[32];
+	int i, len;
+	for (i = 0; i < N; i++) {
+		ent = bwq_dq(q);
+		assert(ent->id == i);
+		tkn = ent->ctxt;
+		len = snprintf(buf, sizeof(buf), "token-%d", i);
+		assert(tkn->tkn_id == i);
+		assert(tkn->tkn_str->blen == len);
+		assert(0 == strcmp(tkn->tkn_str->cstr, buf));
+		barena_put(ent->arena);
+	}
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	pthread_t prod, cons;
+	barena_t a, b;
+	void *p0, *p1;
+
+	/* single-threaded test */
+	a = barena_get();
+	assert(a);
+	p0 = barena_alloc(a, 1);
+	p1 = barena_alloc(a, 1);
+	assert(((uint64_t)p0 & 7) == 0);
+	assert((char*)p1 - (char*)p0 == 8);
+	p0 = barena_alloc(a, BARENA_SZ);
+	assert(p0 && ((uint64_t)p0 & 7) == 0);
+	assert(a->chunks);
+	barena_put(a);
+	assert(!a->chunks);
+	b = barena_get();
+	assert(b == a); /* recycled */
+	barena_put(b);
+
+	/* an input plugin thread and an input worker thread */
+	q = bwq_alloci(64);
+	assert(q);
+	pthread_create(&prod, NULL, prod_proc, NULL);
+	pthread_create(&cons, NULL, cons_proc, NULL);
+	pthread_join(prod, NULL);
+	pthread_join(cons, NULL);
+
+	printf("barena test: OK\n");
+	return 0;
+}
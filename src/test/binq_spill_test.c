@@ -0,0 +1,175 @@
+/* -*- c-basic-offset: 8 -*-
+ * Copyright (c) 2026 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2026 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <ftw.h>
+#include <assert.h>
+
+#include "baler/barena.h"
+#include "baler/bwqueue.h"
+#include "baler/binput_private.h"
+
+#define N 16
+
+struct bwq_entry *new_entry(int i)
+{
+	char buff[64];
+	barena_t a = barena_get();
+	struct bwq_entry *e;
+	struct binq_data *in;
+	btkn_tailq_entry_t t;
+	int j;
+	assert(a);
+	e = barena_zalloc(a, sizeof(*e));
+	assert(e);
+	e->arena = a;
+	in = &e->data.in;
+	in->type = BINQ_DATA_MSG;
+	in->format = BINQ_BTKN_QUEUE;
+	in->tv.tv_sec = i;
+	TAILQ_INIT(&in->tkn_q);
+	snprintf(buff, sizeof(buff), "host%d", i);
+	in->hostname = barena_bstr_alloc_init_cstr(a, buff);
+	for (j = 0; j <= i; j++) {
+		snprintf(buff, sizeof(buff), "tkn%d.%d", i, j);
+		t = barena_alloc(a, sizeof(*t));
+		assert(t);
+		t->tkn = barena_btkn_alloc(a, 0, BTKN_TYPE_MASK(BTKN_TYPE_WORD),
+					   buff, strlen(buff));
+		assert(t->tkn);
+		TAILQ_INSERT_TAIL(&in->tkn_q, t, link);
+		in->tkn_count++;
+	}
+	return e;
+}
+
+void check_entry(struct bwq_entry *e, int i)
+{
+	char buff[64];
+	struct binq_data *in = &e->data.in;
+	btkn_tailq_entry_t t;
+	int j = 0;
+	assert(in->type == BINQ_DATA_MSG);
+	assert(in->tv.tv_sec == i);
+	assert(in->tkn_count == i + 1);
+	snprintf(buff, sizeof(buff), "host%d", i);
+	assert(0 == strcmp(in->hostname->cstr, buff));
+	TAILQ_FOREACH(t, &in->tkn_q, link) {
+		snprintf(buff, sizeof(buff), "tkn%d.%d", i, j);
+		assert(0 == strcmp(t->tkn->tkn_str->cstr, buff));
+		assert(t->tkn->tkn_type_mask == BTKN_TYPE_MASK(BTKN_TYPE_WORD));
+		j++;
+	}
+	assert(j == i + 1);
+	binq_entry_free(e);
+}
+
+static int rm_cb(const char *fpath, const struct stat *sb, int flag,
+		 struct FTW *ftwbuf)
+{
+	if (remove(fpath))
+		perror(fpath);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	char path[] = "/tmp/binq_spill_test.XXXXXX";
+	char qpath[PATH_MAX];
+	struct bwq_entry *ents[N];
+	int i, n, rc;
+
+	if (!mkdtemp(path)) {
+		perror("mkdtemp");
+		return 1;
+	}
+	snprintf(qpath, sizeof(qpath), "%s/spill", path);
+
+	binq = bwq_alloci(4);
+	assert(binq);
+	rc = binq_spill_open(qpath, 2);
+	assert(rc == 0);
+	assert(binq_spill_pending() == 0);
+
+	/* binq takes the first two entries, the rest are spilled */
+	for (i = 0; i < N; i++)
+		binq_post(new_entry(i));
+	assert(bwq_depth(binq) == 2);
+	assert(binq_spill_pending() == N - 2);
+	n = bwq_dq_batch(binq, ents, N);
+	assert(n == 2);
+	for (i = 0; i < n; i++)
+		check_entry(ents[i], i);
+
+	/* drain a few, the rest must survive close/open */
+	n = binq_spill_dq_batch(ents, 4);
+	assert(n == 4);
+	for (i = 0; i < n; i++)
+		check_entry(ents[i], i + 2);
+	binq_spill_close();
+	rc = binq_spill_open(qpath, 2);
+	assert(rc == 0);
+	assert(binq_spill_pending() == N - 6);
+	n = binq_spill_dq_batch(ents, N);
+	assert(n == N - 6);
+	for (i = 0; i < n; i++)
+		check_entry(ents[i], i + 6);
+	assert(binq_spill_pending() == 0);
+	n = binq_spill_dq_batch(ents, N);
+	assert(n == 0);
+	binq_spill_close();
+	nftw(path, rm_cb, 16, FTW_DEPTH | FTW_PHYS);
+
+	printf("binq_spill_test: OK\n");
+	return 0;
+}
@@ -0,0 +1,208 @@
+/* -*- c-basic-offset: 8 -*-
+ * Copyright (c) 2026 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2026 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include "baler/binput_private.h"
+#include "baler/bparse_pool.h"
+
+#define NLINES 100000
+#define NTHREADS 4
+
+/*
+ * A trivial parser: the line is the hostname, and the entry has no tokens.
+ * Lines starting with '!' are syntax errors, and lines starting with '-' have
+ * no hostname.
+ */
+static binp_result_t test_parse(binp_parser_t p, struct bstr *s,
+				struct bwq_entry **pent)
+{
+	struct bwq_entry *ent;
+	barena_t a;
+	if (s->cstr[0] == '!')
+		return BINP_ERR_SYNTAX;
+	a = barena_get();
+	assert(a);
+	ent = barena_zalloc(a, sizeof(*ent));
+	assert(ent);
+	ent->arena = a;
+	ent->data.in.type = BINQ_DATA_MSG;
+	ent->data.in.format = BINQ_BTKN_QUEUE;
+	TAILQ_INIT(&ent->data.in.tkn_q);
+	if (s->cstr[0] != '-')
+		ent->data.in.hostname = barena_bstr_alloc_init_cstr(a, s->cstr);
+	*pent = ent;
+	return BINP_OK;
+}
+
+static int nparsers;
+
+static void test_release(binp_parser_t p)
+{
+	__sync_fetch_and_sub(&nparsers, 1);
+	free(p);
+}
+
+static binp_parser_t test_get_parser(void *lib)
+{
+	binp_parser_t p = calloc(1, sizeof(*p));
+	assert(p);
+	p->parse = test_parse;
+	p->release = test_release;
+	__sync_fetch_and_add(&nparsers, 1);
+	return p;
+}
+
+static struct bparse_line *new_line(const char *s)
+{
+	struct bparse_line *line = bparse_line_alloc(strlen(s) + 1);
+	assert(line);
+	strcpy(line->str.cstr, s);
+	line->sin.sin_family = AF_INET;
+	line->sin.sin_addr.s_addr = htonl(0x0a000001); /* 10.0.0.1 */
+	return line;
+}
+
+int main(int argc, char **argv)
+{
+	struct bwq_entry *ents[64];
+	struct bparse_line *lines[BPARSE_BATCH_MAX + 3];
+	char buff[32];
+	bparse_pool_t pool;
+	binp_parser_t p, *parsers;
+	int i, n, got, rc;
+	uint64_t sum = 0, expect = 0;
+
+	binq = bwq_alloci(1024);
+	assert(binq);
+
+	/* inline */
+	p = test_get_parser(NULL);
+	bparse_line_process(p, new_line("node1"));
+	bparse_line_process(p, new_line("-"));
+	bparse_line_process(p, new_line("!"));
+	p->release(p);
+	ents[0] = bwq_dq(binq);
+	assert(0 == strcmp(ents[0]->data.in.hostname->cstr, "node1"));
+	binq_entry_free(ents[0]);
+	ents[0] = bwq_dq(binq);
+	assert(0 == strcmp(ents[0]->data.in.hostname->cstr, "10.0.0.1"));
+	binq_entry_free(ents[0]);
+	assert(bwq_depth(binq) == 0);
+
+	/* inline, more lines than a parser batch, in order */
+	p = test_get_parser(NULL);
+	for (i = 0; i < BPARSE_BATCH_MAX + 3; i++) {
+		snprintf(buff, sizeof(buff), "%d", i);
+		lines[i] = new_line(buff);
+	}
+	bparse_lines_process(p, lines, BPARSE_BATCH_MAX + 3);
+	p->release(p);
+	for (i = 0; i < BPARSE_BATCH_MAX + 3; i++) {
+		ents[0] = bwq_dq(binq);
+		assert(atoi(ents[0]->data.in.hostname->cstr) == i);
+		binq_entry_free(ents[0]);
+	}
+	assert(bwq_depth(binq) == 0);
+
+	/* per-thread parsers: the first one is the caller's */
+	nparsers = 0;
+	p = test_get_parser(NULL);
+	parsers = bparse_parsers_new(NTHREADS, p, test_get_parser, NULL, NULL);
+	assert(parsers);
+	assert(nparsers == NTHREADS);
+	assert(parsers[0] == p);
+	for (i = 1; i < NTHREADS; i++)
+		assert(parsers[i] && parsers[i] != parsers[i - 1]);
+	bparse_parsers_free(parsers, NTHREADS, p);
+	assert(nparsers == 1);
+	p->release(p);
+
+	/* pool: every line (but the syntax errors) arrives exactly once */
+	nparsers = 0;
+	pool = bparse_pool_new(NTHREADS, test_get_parser, NULL, NULL);
+	assert(pool);
+	assert(nparsers == NTHREADS);
+	rc = bparse_pool_start(pool);
+	assert(rc == 0);
+	got = 0;
+	for (i = 0; i < NLINES; i++) {
+		if (i % 1000 == 999) {
+			bparse_pool_post(pool, new_line("!"));
+		} else {
+			snprintf(buff, sizeof(buff), "%d", i);
+			bparse_pool_post(pool, new_line(buff));
+			expect += i;
+		}
+		while ((n = bwq_try_dq_batch(binq, ents, 64))) {
+			for (; n; n--, got++) {
+				sum += atoi(ents[n-1]->data.in.hostname->cstr);
+				binq_entry_free(ents[n-1]);
+			}
+		}
+	}
+	while (got < NLINES - NLINES / 1000) {
+		n = bwq_dq_batch(binq, ents, 64);
+		for (; n; n--, got++) {
+			sum += atoi(ents[n-1]->data.in.hostname->cstr);
+			binq_entry_free(ents[n-1]);
+		}
+	}
+	assert(sum == expect);
+	bparse_pool_free(pool);
+	assert(nparsers == 0);
+	assert(bwq_depth(binq) == 0);
+
+	printf("bparse_pool_test: OK\n");
+	return 0;
+}
@@ -0,0 +1,173 @@
+/* -*- c-basic-offset: 8 -*-
+ * Copyright (c) 2026 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2026 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Time partitions of the messages: a message stamped far in the future must
+ * not roll the store over to its period, or the retention would drop all of
+ * the current messages. With daily partitions and a day of retention, the
+ * messages stamped now, ten years ahead, and now again must all be kept.
+ *
+ * usage: bstore_sos_part_test [PLUGIN]   (default: bstore_sos)
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <time.h>
+#include <assert.h>
+
+#include "baler/bstore.h"
+
+#define DAY 86400
+
+static btkn_id_t tkn_add(bstore_t bs, const char *s, btkn_type_t type)
+{
+	btkn_t tkn;
+	btkn_id_t id;
+	tkn = btkn_alloc(0, BTKN_TYPE_MASK(type), s, strlen(s));
+	assert(tkn);
+	tkn->tkn_count = 1;
+	id = bstore_tkn_add(bs, tkn);
+	assert(id);
+	btkn_free(tkn);
+	return id;
+}
+
+static int rm_cb(const char *fpath, const struct stat *sb, int flag,
+		 struct FTW *ftwbuf)
+{
+	if (remove(fpath))
+		perror(fpath);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	char path[] = "/tmp/bstore_sos_part_test.XXXXXX";
+	char spath[PATH_MAX];
+	const char *plugin = argc > 1 ? argv[1] : "bstore_sos";
+	struct timeval tv[3];
+	btkn_id_t word, host;
+	bmsg_iter_t iter;
+	bstore_t bs;
+	bstr_t ptn;
+	bmsg_t msg;
+	time_t now;
+	int i, n, rc;
+
+	if (!mkdtemp(path)) {
+		perror("mkdtemp");
+		return 1;
+	}
+	snprintf(spath, sizeof(spath), "%s/store", path);
+	setenv("BSTORE_SOS_PART_PERIOD", "86400", 1);
+	setenv("BSTORE_SOS_RETENTION", "86400", 1);
+	bs = bstore_open(plugin, spath, O_CREAT | O_RDWR, 0660);
+	assert(bs);
+
+	now = time(NULL);
+	tv[0].tv_sec = now;
+	tv[1].tv_sec = now + 10 * 365 * DAY;
+	tv[2].tv_sec = now;
+	for (i = 0; i < 3; i++)
+		tv[i].tv_usec = i;
+
+	/* "hello <host>" */
+	word = tkn_add(bs, "hello", BTKN_TYPE_WORD);
+	host = tkn_add(bs, "node1", BTKN_TYPE_HOSTNAME);
+	ptn = bstr_alloc(2 * sizeof(uint64_t));
+	assert(ptn);
+	ptn->blen = 2 * sizeof(uint64_t);
+	ptn->u64str[0] = (word << 8) | BTKN_TYPE_WORD;
+	ptn->u64str[1] = (BTKN_TYPE_HOSTNAME << 8) | BTKN_TYPE_HOSTNAME;
+	msg = malloc(sizeof(*msg) + 2 * sizeof(uint64_t));
+	assert(msg);
+	msg->ptn_id = bstore_ptn_add(bs, &tv[0], ptn);
+	assert(msg->ptn_id);
+	free(ptn);
+	msg->comp_id = host;
+	msg->argc = 2;
+	msg->argv[0] = (word << 8) | BTKN_TYPE_WORD;
+	msg->argv[1] = (host << 8) | BTKN_TYPE_HOSTNAME;
+	for (i = 0; i < 3; i++) {
+		msg->timestamp = tv[i];
+		rc = bstore_msg_add(bs, &tv[i], msg);
+		assert(rc == 0);
+	}
+	free(msg);
+
+	/* none of the messages is dropped */
+	iter = bstore_msg_iter_new(bs);
+	assert(iter);
+	n = 0;
+	for (rc = bstore_msg_iter_first(iter); !rc;
+	     rc = bstore_msg_iter_next(iter)) {
+		msg = bstore_msg_iter_obj(iter);
+		assert(msg);
+		for (i = 0; i < 3; i++) {
+			if (msg->timestamp.tv_sec == tv[i].tv_sec &&
+			    msg->timestamp.tv_usec == tv[i].tv_usec)
+				break;
+		}
+		assert(i < 3);
+		bmsg_free(msg);
+		n++;
+	}
+	assert(n == 3);
+	bstore_msg_iter_free(iter);
+
+	bstore_close(bs);
+	nftw(path, rm_cb, 16, FTW_DEPTH | FTW_PHYS);
+	printf("bstore_sos_part_test: OK\n");
+	return 0;
+}
@@ -0,0 +1,213 @@
+/* -*- c-basic-offset: 8 -*-
+ * Copyright (c) 2026 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2026 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Concurrent token and pattern adds on a store: every thread adds the same
+ * tokens and patterns. The threads start in NGROUPS groups at different
+ * offsets, so the threads of a group race on the same keys while the groups
+ * work on the different ones. Each key must come out with a single id, the
+ * ids of the different keys must be unique and no count update may be lost.
+ *
+ * usage: bstore_sos_stress_test [PLUGIN]   (default: bstore_sos)
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include "baler/bstore.h"
+
+#define NTHREADS 16
+#define NGROUPS 4
+#define NTKNS 20000
+#define NPTNS 2000
+#define PTN_LEN 4
+
+static bstore_t bs;
+static btkn_id_t tkn_ids[NTHREADS][NTKNS];
+static bptn_id_t ptn_ids[NTHREADS][NPTNS];
+
+static void tkn_text(int k, char *buff, size_t sz)
+{
+	snprintf(buff, sz, "token-%d", k);
+}
+
+static bstr_t ptn_str(int k)
+{
+	bstr_t s = bstr_alloc(PTN_LEN * sizeof(uint64_t));
+	int i;
+	assert(s);
+	s->blen = PTN_LEN * sizeof(uint64_t);
+	for (i = 0; i < PTN_LEN; i++)
+		s->u64str[i] = BTKN_TYPE_LAST_BUILTIN + 1 + (k >> (8 * i) & 0xff);
+	return s;
+}
+
+static void *add_proc(void *arg)
+{
+	long t = (long)arg;
+	struct timeval tv = { .tv_sec = 1500000000 + t };
+	char buff[32];
+	btkn_t tkn;
+	bstr_t ptn;
+	int i, k, rc;
+
+	for (i = 0; i < NTKNS; i++) {
+		k = (i + t % NGROUPS * NTKNS / NGROUPS) % NTKNS;
+		tkn_text(k, buff, sizeof(buff));
+		tkn = btkn_alloc(0, BTKN_TYPE_MASK(BTKN_TYPE_WORD),
+				 buff, strlen(buff));
+		assert(tkn);
+		tkn->tkn_count = 1;
+		tkn_ids[t][k] = bstore_tkn_add(bs, tkn);
+		assert(tkn_ids[t][k]);
+		btkn_free(tkn);
+	}
+	for (i = 0; i < NPTNS; i++) {
+		k = (i + t % NGROUPS * NPTNS / NGROUPS) % NPTNS;
+		/* bstore_ptn_add() encodes the pattern in place */
+		ptn = ptn_str(k);
+		ptn_ids[t][k] = bstore_ptn_add(bs, &tv, ptn);
+		assert(ptn_ids[t][k]);
+		free(ptn);
+		rc = bstore_ptn_stat_update(bs, ptn_ids[t][k], &tv, &tv, 1);
+		assert(rc == 0);
+	}
+	return NULL;
+}
+
+static int id_cmp(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+static int rm_cb(const char *fpath, const struct stat *sb, int flag,
+		 struct FTW *ftwbuf)
+{
+	if (remove(fpath))
+		perror(fpath);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	char path[] = "/tmp/bstore_sos_stress_test.XXXXXX";
+	char spath[PATH_MAX];
+	const char *plugin = argc > 1 ? argv[1] : "bstore_sos";
+	pthread_t th[NTHREADS];
+	uint64_t *ids;
+	char buff[32];
+	btkn_t tkn;
+	bptn_t ptn;
+	long t;
+	int k, rc;
+
+	if (!mkdtemp(path)) {
+		perror("mkdtemp");
+		return 1;
+	}
+	snprintf(spath, sizeof(spath), "%s/store", path);
+	bs = bstore_open(plugin, spath, O_CREAT | O_RDWR, 0660);
+	assert(bs);
+
+	for (t = 0; t < NTHREADS; t++) {
+		rc = pthread_create(&th[t], NULL, add_proc, (void *)t);
+		assert(rc == 0);
+	}
+	for (t = 0; t < NTHREADS; t++)
+		pthread_join(th[t], NULL);
+
+	/* a token has one id, counted by every thread */
+	ids = calloc(NTKNS > NPTNS ? NTKNS : NPTNS, sizeof(*ids));
+	assert(ids);
+	for (k = 0; k < NTKNS; k++) {
+		for (t = 1; t < NTHREADS; t++)
+			assert(tkn_ids[t][k] == tkn_ids[0][k]);
+		tkn_text(k, buff, sizeof(buff));
+		tkn = bstore_tkn_find_by_name(bs, buff, strlen(buff));
+		assert(tkn);
+		assert(tkn->tkn_id == tkn_ids[0][k]);
+		assert(tkn->tkn_count == NTHREADS);
+		btkn_free(tkn);
+		ids[k] = tkn_ids[0][k];
+	}
+	qsort(ids, NTKNS, sizeof(*ids), id_cmp);
+	for (k = 1; k < NTKNS; k++)
+		assert(ids[k - 1] != ids[k]);
+
+	/* same for the patterns, with the stat updates on top of the adds */
+	for (k = 0; k < NPTNS; k++) {
+		for (t = 1; t < NTHREADS; t++)
+			assert(ptn_ids[t][k] == ptn_ids[0][k]);
+		ptn = bstore_ptn_find(bs, ptn_ids[0][k]);
+		assert(ptn);
+		assert(ptn->count == 2 * NTHREADS);
+		assert(ptn->first_seen.tv_sec == 1500000000);
+		assert(ptn->last_seen.tv_sec == 1500000000 + NTHREADS - 1);
+		bptn_free(ptn);
+		ids[k] = ptn_ids[0][k];
+	}
+	qsort(ids, NPTNS, sizeof(*ids), id_cmp);
+	for (k = 1; k < NPTNS; k++)
+		assert(ids[k - 1] != ids[k]);
+
+	free(ids);
+	bstore_close(bs);
+	nftw(path, rm_cb, 16, FTW_DEPTH | FTW_PHYS);
+	printf("bstore_sos_stress_test: OK\n");
+	return 0;
+}
@@ -0,0 +1,165 @@
+/* -*- c-basic-offset: 8 -*-
+ * Copyright (c) 2026 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2026 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "baler/bwqueue.h"
+
+#define N 4096
+#define NTHR 4
+
+struct bwq *q;
+
+uint64_t dlen = 0;
+uint64_t data[NTHR*N];
+struct bwq_entry ents[NTHR][N];
+
+void *wrthr_proc(void *arg)
+{
+	struct bwq_entry *e = arg;
+	uint64_t i;
+	for (i = 0; i < N; i++) {
+		e[i].id = i;
+		bwq_nq(q, &e[i]);
+	}
+	return NULL;
+}
+
+void *rdthr_proc(void *arg)
+{
+	struct bwq_entry *e[8];
+	uint64_t idx;
+	int i, n, term = 0;
+	while (!term) {
+		n = bwq_dq_batch(q, e, 8);
+		for (i = 0; i < n; i++) {
+			if (e[i]->id < 0) {
+				/* terminate, leave the other terminators to
+				 * the other readers */
+				if (term)
+					bwq_nq(q, e[i]);
+				term = 1;
+				continue;
+			}
+			idx = __sync_fetch_and_add(&dlen, 1);
+			data[idx] = e[i]->id;
+		}
+	}
+	return NULL;
+}
+
+int u64_cmp(const void *a, const void *b)
+{
+	uint64_t _a = *(uint64_t*)a;
+	uint64_t _b = *(uint64_t*)b;
+	if (_a < _b)
+		return -1;
+	if (_a > _b)
+		return 1;
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	pthread_t wrthr[NTHR];
+	pthread_t rdthr[NTHR];
+	struct bwq_entry term = { .id = -1 };
+	struct bwq_entry *e[N];
+	uint64_t i;
+	int n, rc;
+
+	/* single-threaded test */
+	q = bwq_alloci(N);
+	assert(q);
+	wrthr_proc(ents[0]);
+	rc = bwq_try_nq(q, &term);
+	assert(rc == EAGAIN); /* full */
+	for (i = 0; i < N; i++) {
+		e[0] = bwq_dq(q);
+		assert(e[0] == &ents[0][i]);
+	}
+	e[0] = bwq_try_dq(q);
+	assert(e[0] == NULL); /* empty */
+	wrthr_proc(ents[0]);
+	n = bwq_dq_batch(q, e, N);
+	assert(n == N);
+	for (i = 0; i < N; i++)
+		assert(e[i] == &ents[0][i]);
+	bwq_free(q);
+	printf("single-threaded: OK\n");
+
+	/* multi-threaded test with a small queue so that both the producers
+	 * and the consumers have to wait */
+	q = bwq_alloci(16);
+	assert(q);
+	for (i = 0; i < NTHR; i++)
+		pthread_create(&rdthr[i], NULL, rdthr_proc, NULL);
+	for (i = 0; i < NTHR; i++)
+		pthread_create(&wrthr[i], NULL, wrthr_proc, ents[i]);
+	for (i = 0; i < NTHR; i++)
+		pthread_join(wrthr[i], NULL);
+	for (i = 0; i < NTHR; i++)
+		bwq_nq(q, &term);
+	for (i = 0; i < NTHR; i++)
+		pthread_join(rdthr[i], NULL);
+	bwq_free(q);
+
+	assert(dlen == sizeof(data)/sizeof(data[0]));
+	qsort(data, dlen, sizeof(data[0]), u64_cmp);
+	for (i = 0; i < dlen; i++) {
+		assert(data[i] == i/NTHR);
+	}
+
+	printf("bwqueue test: OK\n");
+	return 0;
+}
@@ -0,0 +1,298 @@
+/* -*- c-basic-offset: 8 -*-
+ * Copyright (c) 2026 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2026 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Differential test of the fast syslog tokenizer (syslog_parser option
+ * lexer=fast) against the flex scanner: both parsers must produce the same
+ * entries, token for token. The messages are also parsed in batches
+ * (::binp_parser::parse_batch) with the flex scanner, which must give the
+ * same entries as parsing them one by one.
+ *
+ * usage: syslog_fastlex_test [CORPUS_FILE]
+ *
+ * Without CORPUS_FILE, the test uses the built-in sample messages and a
+ * set of messages generated from fragments. libsyslog_parser.so must be in
+ * the library path.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <dlfcn.h>
+
+#include "baler/bplugin.h"
+#include "baler/bwqueue.h"
+
+#define NGEN 100000
+#define NBATCH 16
+
+static const char *samples[] = {
+	"<13>Oct 12 10:11:12 nid00012 kernel: [1234.567890] LNetError: "
+		"3:0:(o2iblnd_cb.c:3041:kiblnd_check_conns()) Timed out RDMA "
+		"with 10.128.0.1@o2ib (52): c: 0, oc: 0, rc: 8\n",
+	"<30>1 2016-03-04T05:06:07.123456-06:00 c0-0c0s1n2 systemd 1 - - "
+		"Started Session 1234 of user root.\n",
+	"<13>1 2015-01-02T03:04:05Z 10.0.0.1 sshd[1234]: Accepted publickey "
+		"for root from fe80::1:2:3:4 port 22 ssh2: RSA "
+		"12:ab:cd:ef:01:23:45:67\n",
+	"Jan  3 00:00:01 host [kernel:warn] eth0 link up 00:1b:21:ab:cd:ef "
+		"http://x.y/z/ /var/log/messages 0x7fff1234 3.14 1.5e3.2\n",
+	"2015-01-02 03:04:05 node1 a] [] :] ^] _x __ x. a..b 1.2.3.4/24\n",
+	"Feb 12, 2015 03:04:05 node2 \t\x01\xff tabs and binary\n",
+	"<1",
+};
+
+/* Fragments of the generated messages */
+static const char *frags[] = {
+	"Jan", "Oct 12 10:11:12", "2015-01-02T03:04:05Z", "2015-01-02 03:04:05",
+	"2015-01-02T03:04:05.123+07:00", "2015-01-02T03:04:05.", "Apr 123 1",
+	"Mar 1 2015  10:11:12", "http://a.b/c", "HtTpS://_a//b", "http://",
+	"HTTP", "abc", "a]", "l]", "[]", ":]", "^]", "[abc:def]", "[a.b:c]",
+	"[a.:b]", "fe80::1", "::::::1", "a:b:c:d:e:f/1289", "1:2:3:4:5:6",
+	"ab:cd:ef:01:23:45", "10.0.0.1", "10.0.0", "1.2.3.4/123", "1.2.3.4567",
+	"1.5", "1.e", "1.5E7.", "0x1f", "0X", "00x1", "deadbeef", "123abc",
+	"12:34", "_x", "-x", "/usr/lib/x.so", "/", "//", "~", "kernel:",
+	"[1234]", "abc_def-1", "x.", "<13>", "<", ">", "...", " ", "   ", "\t",
+	"\x01", "\xff", "abcd:", "abcde:", "g1:", "1234-", "12345-", "X",
+};
+
+static char chars[] = "aZ09_-.:/[]^<>~ xXlnum,+";
+
+static int nlines;
+static int nfail;
+static char *batch[NBATCH];
+static int nbatch;
+
+static void gen(char *buff, size_t sz)
+{
+	int i, n;
+	size_t len = 0;
+	const char *f;
+	buff[0] = '\0';
+	if (rand() % 3 == 0)
+		len = snprintf(buff, sz, "<%d>", rand() % 200);
+	if (rand() % 2) {
+		n = 1 + rand() % 8;
+		for (i = 0; i < n; i++) {
+			f = frags[rand() % (sizeof(frags)/sizeof(*frags))];
+			if (len + strlen(f) + 2 >= sz)
+				break;
+			len += sprintf(buff + len, "%s%s", f,
+				       (rand() % 2) ? " " : "");
+		}
+	} else {
+		n = 1 + rand() % 30;
+		for (i = 0; i < n && len + 1 < sz; i++)
+			buff[len++] = chars[rand() % (sizeof(chars) - 1)];
+		buff[len] = '\0';
+	}
+	if (rand() % 2 && len + 1 < sz)
+		strcpy(buff + len, "\n");
+}
+
+static struct bstr *msg_bstr(const char *msg)
+{
+	size_t len = strlen(msg);
+	struct bstr *s = bstr_alloc(len);
+	assert(s);
+	s->blen = len;
+	memcpy(s->cstr, msg, len + 1);
+	return s;
+}
+
+static struct bwq_entry *parse(binp_parser_t p, const char *msg,
+			       binp_result_t *rc)
+{
+	struct bwq_entry *ent;
+	struct bstr *s = msg_bstr(msg);
+	*rc = p->parse(p, s, &ent);
+	free(s);
+	return ent;
+}
+
+static int tkn_eq(btkn_t a, btkn_t b)
+{
+	return a->tkn_type_mask == b->tkn_type_mask &&
+		btkn_len(a) == btkn_len(b) &&
+		0 == memcmp(btkn_text(a), btkn_text(b), btkn_len(a));
+}
+
+static int ent_eq(struct bwq_entry *a, struct bwq_entry *b)
+{
+	struct btkn_tailq_entry *ta, *tb;
+	if (!a || !b)
+		return a == b;
+	if (!a->data.in.hostname != !b->data.in.hostname)
+		return 0;
+	if (a->data.in.hostname &&
+	    0 != bstr_cmp(a->data.in.hostname, b->data.in.hostname))
+		return 0;
+	if (a->data.in.tv.tv_sec != b->data.in.tv.tv_sec ||
+	    a->data.in.tv.tv_usec != b->data.in.tv.tv_usec)
+		return 0;
+	tb = TAILQ_FIRST(&b->data.in.tkn_q);
+	TAILQ_FOREACH(ta, &a->data.in.tkn_q, link) {
+		if (!tb || !tkn_eq(ta->tkn, tb->tkn))
+			return 0;
+		tb = TAILQ_NEXT(tb, link);
+	}
+	return tb == NULL;
+}
+
+/* Parse the messages in batch[] together with bat, and one by one with flex */
+static void check_batch(binp_parser_t flex, binp_parser_t bat)
+{
+	struct bstr *strs[NBATCH];
+	struct bwq_entry *ents[NBATCH], *e;
+	binp_result_t rcs[NBATCH], rc;
+	int i;
+
+	for (i = 0; i < nbatch; i++)
+		strs[i] = msg_bstr(batch[i]);
+	binp_parse_batch(bat, strs, nbatch, ents, rcs);
+	for (i = 0; i < nbatch; i++) {
+		e = parse(flex, batch[i], &rc);
+		if (rc != rcs[i] || !ent_eq(e, ents[i])) {
+			nfail++;
+			printf("BATCH MISMATCH: %s%s", batch[i],
+			       batch[i][0] && batch[i][strlen(batch[i])-1] == '\n' ?
+			       "" : "\n");
+		}
+		if (e)
+			binq_entry_free(e);
+		if (ents[i])
+			binq_entry_free(ents[i]);
+		free(strs[i]);
+		free(batch[i]);
+	}
+	nbatch = 0;
+}
+
+static void check(binp_parser_t flex, binp_parser_t fast, binp_parser_t bat,
+		  const char *msg)
+{
+	binp_result_t rc0, rc1;
+	struct bwq_entry *e0 = parse(flex, msg, &rc0);
+	struct bwq_entry *e1 = parse(fast, msg, &rc1);
+	nlines++;
+	if (rc0 != rc1 || !ent_eq(e0, e1)) {
+		nfail++;
+		printf("MISMATCH: %s%s", msg,
+		       msg[0] && msg[strlen(msg)-1] == '\n' ? "" : "\n");
+	}
+	if (e0)
+		binq_entry_free(e0);
+	if (e1)
+		binq_entry_free(e1);
+	batch[nbatch] = strdup(msg);
+	assert(batch[nbatch]);
+	if (++nbatch == NBATCH)
+		check_batch(flex, bat);
+}
+
+int main(int argc, char **argv)
+{
+	binp_parser_t flex, fast, bat;
+	binp_get_parser_fn_t get_parser;
+	struct bpair_str_head args;
+	struct bpair_str lexer = {.s0 = "lexer", .s1 = "fast"};
+	char buff[4096];
+	void *lib;
+	FILE *f;
+	int i, rc;
+
+	lib = dlopen("libsyslog_parser.so", RTLD_NOW);
+	if (!lib) {
+		printf("dlopen: %s\n", dlerror());
+		exit(-1);
+	}
+	get_parser = dlsym(lib, "binp_get_parser");
+	assert(get_parser);
+	flex = get_parser(lib);
+	fast = get_parser(lib);
+	bat = get_parser(lib);
+	assert(flex && fast && bat && fast->config && bat->parse_batch);
+	LIST_INIT(&args);
+	LIST_INSERT_HEAD(&args, &lexer, link);
+	rc = fast->config(fast, &args);
+	assert(rc == 0);
+
+	if (argc > 1) {
+		f = fopen(argv[1], "r");
+		if (!f) {
+			perror(argv[1]);
+			exit(-1);
+		}
+		while (fgets(buff, sizeof(buff), f))
+			check(flex, fast, bat, buff);
+		fclose(f);
+	} else {
+		for (i = 0; i < sizeof(samples)/sizeof(*samples); i++)
+			check(flex, fast, bat, samples[i]);
+		srand(1);
+		for (i = 0; i < NGEN; i++) {
+			gen(buff, sizeof(buff));
+			check(flex, fast, bat, buff);
+		}
+	}
+	if (nbatch)
+		check_batch(flex, bat);
+
+	flex->release(flex);
+	fast->release(fast);
+	bat->release(bat);
+	dlclose(lib);
+	if (nfail) {
+		printf("syslog_fastlex_test: %d/%d mismatches\n", nfail, nlines);
+		return -1;
+	}
+	printf("syslog_fastlex_test: OK (%d messages)\n", nlines);
+	return 0;
+}